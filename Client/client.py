@@ -60,6 +60,7 @@ class Client(cmd.Cmd):
         self.dataBuffer = queue.Queue()  # Outgoing measurement data message buffer
         self.submitInterval = 10  # Interval (in seconds) how often to submit dataBuffer
         self.submitUrl = None  # URL to submit dataBuffer to
+        self.fillGaps = False  # Whether to read back lost measurement data from the SD card after a measurement
         # Start measurement data sender thread
         threading.Thread(daemon=True, target=self.submitThread).start()
 
@@ -82,6 +83,10 @@ class Client(cmd.Cmd):
         "Configure the interval (in seconds) how often measurement data should be submitted."
         self.submitInterval = float(arg)
     
+    def do_setfillgaps(self, arg):
+        "Configure whether measurement data lost on the radio link should be read back from the SD card (if recorded there)."
+        self.fillGaps = parseBool(arg)
+    
     def do_printusbpackets(self, arg):
         "Configure whether to print USB packets or not."
         self.receiver.printUSBPackets = parseBool(arg)
@@ -107,7 +112,7 @@ class Client(cmd.Cmd):
         checkStatus(*self.receiver.stopRadio())
     
     def do_startradio(self, arg):
-        ("startradio <channel> <speed> <txPower> <receiverTxPower> <guardBits> <preGapBits> <postGapBits> <netId>\n"
+        ("startradio <channel> <speed> <txPower> <receiverTxPower> <guardBits> <preGapBits> <postGapBits> <netId> <minSlots> <burst>\n"
          "Configures the radio receiver and starts up communication.\n"
          "    <channel>         - Center frequency is 2400 + <channel> MHz\n"
          "    <speed>           - Air data rate: 0: 2Mbit/s, 1: 1Mbit/s, 3: 250kbit/s, default 0\n"
@@ -116,7 +121,9 @@ class Client(cmd.Cmd):
          "    <guardBits>       - Number of guard bits between time slots, default 16\n"
          "    <preGapBits>      - Number of additional gap bits before the first RX time slot, default 0\n"
          "    <postGapBits>     - Number of additional gap bits after the last RX time slot, default 0\n"
-         "    <netId>           - Network session identifier (0-255), default is random\n")
+         "    <netId>           - Network session identifier (0-255), default is random\n"
+         "    <minSlots>        - Shorten frames with unused slots down to this many slots (0: disabled), default 0\n"
+         "    <burst>           - 1: Nodes send consecutive slots back to back, without guard bits, default 0\n")
         args = list(map(int, shlex.split(arg)))
         if len(args) == 0: raise Exception("No channel frequency specified.")
         checkStatus(*self.receiver.startRadio(*args))
@@ -224,7 +231,7 @@ class Client(cmd.Cmd):
         globalTime = (struct.unpack("<I", self.receiver.getRadioStats()[4][:4])[0] + prepareTime * 1000) & 0xfffffff
         unixTime = int((datetime.datetime.utcnow() - datetime.datetime(1970, 1, 1)).total_seconds() * 1000) + prepareTime
         # Initiate measurement on all participating sensor nodes
-        for d in self.measuring: d.check(d.startMeasurement(targets, globalTime, unixTime))
+        for d in self.measuring: d.check(d.startMeasurement(targets, globalTime, unixTime, self.fillGaps))
     
     def do_stopmeasurement(self, arg):
         "Stops the currently running measurement."
@@ -307,6 +314,10 @@ class Client(cmd.Cmd):
         "Configure the RF statistics summarization interval."
         self.manager.telemetryInterval = float(arg)
     
+    def do_setpacketbatching(self, arg):
+        "Configure how many USB packets a batched received radio packet notification may span (1: disable batching)."
+        checkStatus(*self.receiver.setPacketBatching(int(arg)))
+    
     def do_rfstats(self, arg):
         "Show radio layer statistics"
         rd = self.receiver.telemetryDelta
@@ -320,6 +331,8 @@ class Client(cmd.Cmd):
         print("        RX packets per second: %6.1f (%9.1fkbit/s)" % (rd[2], rd[2] * 28 * 8))
         print("        RX rejects per second: %6.1f" % rd[3])
         print("        RX overflows per second: %4.1f" % rd[4])
+        if rd[6]: print("        RX forwarding cost: %7.1f CPU cycles per packet" % (rd[5] / rd[6]))
+        print("        Data ACK broadcasts per second: %5.1f" % rd[7])
         print("    Nodes:")
         for id in self.manager.devices:
             d = self.manager.getDevice(id)
@@ -329,8 +342,11 @@ class Client(cmd.Cmd):
             if nid == 0: info = "Connection lost"
             elif dd is None: info = "No data available"
             elif dd[0] == 0: info = "Outdated information"
-            else: info = "Frames: %5.1f%% lost, %5.1f%% discont, %5.1f%% syncerr, TX: %6.1f/s (%5.1f%% lost), RX: %5.1f/s" % \
-                         (100 * (1 - dd[1] / dd[0]), 100 * dd[3] / dd[1] if dd[1] else 0, 100 * dd[2] / dd[1] if dd[1] else 0, dd[4], 100 * (1 - dd[5] / dd[4]) if dd[4] else 0, dd[6])
+            else:
+                info = "Frames: %5.1f%% lost, %5.1f%% discont, %5.1f%% syncerr, TX: %6.1f/s (%5.1f%% lost), RX: %5.1f/s" % \
+                       (100 * (1 - dd[1] / dd[0]), 100 * dd[3] / dd[1] if dd[1] else 0, 100 * dd[2] / dd[1] if dd[1] else 0, dd[4], 100 * (1 - dd[5] / dd[4]) if dd[4] else 0, dd[6])
+                # Outages that the device recovered from during the interval
+                if dd[7]: info += ", rejoined after %.0fms" % (dd[8] / dd[7])
             print("        Serial %08X: %s" % (id.serial, info))
             
     def do_rfthroughputtest(self, arg):
@@ -43,7 +43,7 @@ manager = sensorplatform.rfmanager.RFManager()
 receiver = sensorplatform.receiver.Receiver()
 manager.addReceiver(receiver)
 # Start radio communication with the specified parameters (adapt to your needs)
-receiver.startRadio(70, 0, 0, 0, 32, 0, 0)
+receiver.startRadio(70, 0, 0, 0, 32, 0, 0, burst=1)
 
 # Collect devices that participate in the measurement
 measuring = []
@@ -58,6 +58,10 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
         self.decoderBuffer = {}  # Out-of-order data packets pending to be decoded
         self.decoderSchedule = None  # Sensor sampling schedule timestamp list
         self.decoderSensor = None  # Sensor sampling schedule sensor object list
+        self.decoderPacked = False  # Measurement data is recorded in the packed (compressed) block format
+        self.decoderBlock = []  # Pages of the packed block that is currently being received
+        self.decoderBlockLost = []  # Indices of pages within decoderBlock that were lost (zero filled)
+        self.decoderRecord = 0  # Number of records that were decoded or skipped so far (packed format)
         self.decoderLastProgress = 0  # (Local) time at which the decoder last made progress
         self.decoderLastSkipSeq = 0  # Packet sequence number that the decoder skipped to last
         self.decoderEndTime = None  # Total measurement time reported by device at end of measurement (microseconds)
@@ -65,6 +69,9 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
         self.txOverflowLost = 0  # Data packets lost on radio link reported by device at end of measurement
         self.sdOverflowLost = 0  # Data packets lost on SD card reported by device at end of measurement
         self.lostPackets = 0  # Data packets considered lost (and skipped) during decoding
+        self.decoderFillGaps = False  # Hold missing packets until the end of the measurement and read them back from the SD card
+        self.readbackPages = None  # Data packets received during a running readback (None if there is none)
+        self.readbackSeq = 0  # Sequence number of the last data packet received during a running readback
         self.measurementEndLastNoData = 0  # Last no data info time at the time when a measurement stop was requested
         self.rawDataHook = None  # Raw measurement data stream packet hook
         self.attrDataHook = None  # Sensor configuration/attribute hook
@@ -307,7 +314,10 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
 
         
     # Initiate a measurement at the specified time
-    def startMeasurement(self, targets, globalTime, unixTime):
+    # If fillGaps is set (only effective when recording to the SD card), the decoder won't skip packets that
+    # didn't arrive in time, but wait until endMeasurement() reads the missing ones back from the SD card.
+    # Decoded data will be delivered late if packets are lost in that case.
+    def startMeasurement(self, targets, globalTime, unixTime, fillGaps=False):
         # Apply any pending sensor configuration changes
         self.commitAllSensorAttrs()
         # Initialize decoder state:
@@ -319,12 +329,17 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
             self.decoderBuffer = {}
             self.decoderSchedule = collections.deque()
             self.decoderSensor = collections.deque()
+            self.decoderPacked = False
+            self.decoderBlock = []
+            self.decoderBlockLost = []
+            self.decoderRecord = 0
             self.decoderLastProgress = time.monotonic() + 3  # Wait up to 5 seconds for header data
             self.decoderLastSkipSeq = 0
             self.decoderActive = True
             self.decoderEndTime = None
             self.decoderEndOffset = 0xffffffffffffffff
             self.lostPackets = 0
+            self.decoderFillGaps = fillGaps and targets & 2 != 0
             self.measurementEndLastNoData = 0
         # Start the measurement on the sensor node
         return self.cmd(0x0110, targets, struct.pack("<IQ", globalTime, unixTime))
@@ -353,24 +368,95 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
         while self.lastNoData == self.measurementEndLastNoData: time.sleep(0.01)
         # Mark the measurement as finished.
         self.decoderActive = False
+        # If requested, try to read any missing data packets back from the SD card.
+        if self.decoderFillGaps:
+            with self.decoderLock:
+                end = (self.decoderEndOffset + 27) // 28
+                missing = [seq for seq in range(self.decoderSeq, end) if not seq in self.decoderBuffer]
+            if missing:
+                recovered = self.readback(missing)
+                print("%.6f" % time.monotonic(), "READBACK", self.id.serial, len(missing), len(recovered))
+                with self.decoderLock: self.decoderBuffer.update(recovered)
         # Decode any remaining data packets. If any data is still missing, it will never arrive.
         with self.decoderLock:
             while self.decoderSeq * 28 < self.decoderEndOffset:
-                self.decodePacket(self.decoderBuffer.pop(self.decoderSeq, b"\0" * 28))
+                data = self.decoderBuffer.pop(self.decoderSeq, None)
+                # The decoder didn't skip any packets while filling gaps, account for them here
+                if data is None and self.decoderFillGaps: self.lostPackets += 1
+                self.decodePacket(b"\0" * 28 if data is None else data, data is None)
         # Report measurement completion information:
         #     decoderEndTime: Measurement duration in microseconds (will wrap after exceeding 32 bits)
         #     decoderEndOffset: Measurement data size in bytes
         #     decoderSeq: Number of data packets in the measurement
-        #     lostPackets: Packets skipped by the decoder because they didn't arrive in time
+        #     lostPackets: Packets skipped by the decoder because they didn't arrive in time (or couldn't be read back)
         #     txOverflowLost: Packets never transmitted by the sensor node due to buffer overflows
         #     sdOverflowLost: Packets not written to the SD card due to it not being able to keep up
         return self.decoderEndTime, self.decoderEndOffset, self.decoderSeq, self.lostPackets, self.txOverflowLost, self.sdOverflowLost
 
         
+    # Read back recorded measurement data packets (of the last measurement) from the SD card.
+    # Takes an iterable of packet sequence numbers and returns a dict of the ones that could be recovered.
+    # The sensor node transfers whole 17-page blocks, blocks that weren't completely recorded are skipped.
+    def readback(self, seqs, timeout=5):
+        wanted = set(seqs)
+        result = {}
+        # Merge the blocks containing the wanted packets into runs of consecutive blocks
+        runs = []
+        for block in sorted(set(seq // 17 for seq in wanted)):
+            if runs and runs[-1][1] == block: runs[-1][1] = block + 1
+            else: runs.append([block, block + 1])
+        for first, end in runs:
+            with self.decoderLock:
+                self.readbackPages = {}
+                self.readbackSeq = first * 17
+            try:
+                # Start the readback. The sensor node might still be busy finishing the measurement, retry while it is.
+                deadline = time.monotonic() + timeout
+                while True:
+                    status, data = self.cmd(0x0112, 0, struct.pack("<II", first, end - first))
+                    if status != 5 or time.monotonic() > deadline: break
+                    time.sleep(0.1)
+                # If the sensor node can't read back the recording, there's no point in trying the other runs.
+                if status != 0: break
+                # Wait for the run to arrive, until nothing new has shown up for a while
+                # (the sensor node doesn't send blocks that weren't completely recorded).
+                received = 0
+                lastProgress = time.monotonic()
+                while time.monotonic() - lastProgress < timeout:
+                    with self.decoderLock:
+                        if all(seq in self.readbackPages for seq in range(first * 17, end * 17)): break
+                        if len(self.readbackPages) != received:
+                            received = len(self.readbackPages)
+                            lastProgress = time.monotonic()
+                    time.sleep(0.05)
+                self.cmd(0x0113, 0)
+            finally:
+                with self.decoderLock:
+                    pages = self.readbackPages
+                    self.readbackPages = None
+            for seq, data in pages.items():
+                if seq in wanted: result[seq] = data
+        return result
+
+
+    # Abort a running readback on the sensor node
+    def stopReadback(self):
+        return self.cmd(0x0113, 0)
+
+
     # Process an incoming measurement data packet (which is possibly out of sequence)
     def handleDataPacket(self, frame, seq, data):
         # Kill anything that tries to communicate with lost/disconnected devices
         if self.drop: return
+        with self.decoderLock:
+            if self.readbackPages is not None:
+                # This packet belongs to a running readback. The sequence number is tracked separately,
+                # as the device's sequence number was reset at the end of the measurement.
+                delta = (seq - self.readbackSeq) & 0x7fff
+                if delta & 0x4000: delta -= 0x8000
+                self.readbackSeq += delta
+                self.readbackPages[self.readbackSeq] = data
+                return
         #print("%.6f" % time.monotonic(), "got", self.id.serial, seq, self.decoderSeq)
         # Pass the raw received packet to the hook if there is one
         if self.rawDataHook is not None: self.rawDataHook(self, frame, seq, data)
@@ -379,8 +465,9 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
             if not self.decoderActive: return
             # If we have been stuck waiting for a missing packet for more than 2 seconds,
             # it will probably never arrive. Move on and try to catch up again.
+            # (Unless it will be read back from the SD card at the end of the measurement.)
             now = time.monotonic()
-            skip = now - self.decoderLastProgress > 2
+            skip = now - self.decoderLastProgress > 2 and not self.decoderFillGaps
             # If the packet is in sequence, just process it.
             if seq == self.decoderSeq: self.decodePacket(data)
             # If packets are missing in between, just enqueue the just
@@ -403,7 +490,7 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
                             # If it was a header packet, this might confuse the decoder. Warn about that.
                             print("WARNING! Lost series header packet %d for device %08X, decoded data may be garbage!" % (self.decoderSeq, self.id.serial))
                         # Insert zero bytes and increment the lost packet counter
-                        self.decodePacket(b"\0" * 28)
+                        self.decodePacket(b"\0" * 28, True)
                         self.lostPackets += 1
                 # If the next required packet is in the buffer, process it
                 else: self.decodePacket(self.decoderBuffer.pop(self.decoderSeq))
@@ -418,8 +505,8 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
                 self.decoderLastProgress = now
         
         
-    # Decode a single data packet (called with packets in sequence and gaps filled with zeros)
-    def decodePacket(self, data):
+    # Decode a single data packet (called with packets in sequence and gaps filled with zeros and lost set)
+    def decodePacket(self, data, lost=False):
         # If we would go past the end of the measurement (into the padding at the end), stop here.
         offset = self.decoderSeq * 28
         if offset >= self.decoderEndOffset: return
@@ -436,10 +523,21 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
                     if s.decoder.interval > 0 and s.decoder.recordBytes > 0:
                         # The sensor is active. Insert it into the schedule.
                         self.scheduleSensor(s, s.decoder.offset)
+                        # If any active sensor uses the packed format, the whole data stream does.
+                        if s.decoder.packed: self.decoderPacked = True
                         if self.attrDataHook is not None:
                             # There is a sensor attribute hook. Emit all attributes of the sensor.
                             for attr in s.attrs.keys():
                                 self.attrDataHook(self, s, attr, s.getAttr(attr))
+        # This is a sensor measurement packet in packed format. Collect the pages of the
+        # block (data starts at a block boundary) and decode it once it is complete.
+        elif self.decoderPacked:
+            if lost: self.decoderBlockLost.append(len(self.decoderBlock))
+            self.decoderBlock.append(data)
+            if len(self.decoderBlock) == 17:
+                self.decodeBlock(b"".join(self.decoderBlock), self.decoderBlockLost)
+                self.decoderBlock = []
+                self.decoderBlockLost = []
         # This is a sensor measurement packet.
         # If there are any active sensors, attempt to decode it.
         elif len(self.decoderSensor) > 0:
@@ -453,7 +551,7 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
                 # let its decoder decode the data,
                 sample = sensor.decoder.decode(self.decoderData[:sensor.decoder.recordBytes])
                 # pass the decoded data to the decoded data hook if present,
-                if self.decodedDataHook is not None: self.decodedDataHook(self, sensor, self.decoderTime / 1000., sample)
+                if self.decodedDataHook is not None: self.decodedDataHook(self, sensor, (self.decoderTime - sensor.decoder.delay) / 1000., sample)
                 # remove the raw data from the decoder buffer
                 self.decoderData = self.decoderData[sensor.decoder.recordBytes:]
                 # and re-schedule the sensor for its next measurement time.
@@ -462,6 +560,63 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
         self.decoderSeq += 1
         
         
+    # Decode a block of packed measurement data (see Firmware/src/target/sensorplatform/multisensor/codec.h)
+    def decodeBlock(self, data, lost):
+        # If the block header was lost, skip the block. The next one tells us where to continue.
+        if 0 in lost: return
+        bits = int.from_bytes(data, "little")
+        count = bits & 0xffff
+        first = (bits >> 16) & 0xffffffff
+        pos = 48
+        # Any data beyond the start of the first lost page can't be decoded
+        end = min(lost) * 28 * 8 if len(lost) > 0 else len(data) * 8
+        # If previous blocks were lost, skip the records that they contained
+        while self.decoderRecord < first: self.skipRecord()
+        # Predictors start from zero in every block
+        prev = {}
+        for i in range(count):
+            sensor = self.decoderSensor[0]
+            words = sensor.decoder.recordBytes // 2
+            if sensor.decoder.packed:
+                # Packed record: width code followed by zigzag encoded differences to the previous record
+                # (of the big endian sample values, which are turned back into the raw byte order below)
+                width = (bits >> pos) & 0xf
+                if width == 15: width = 16
+                pos += 4
+                record = prev.get(sensor, [0] * words)
+                for j in range(words):
+                    code = (bits >> pos) & ((1 << width) - 1)
+                    record[j] = (record[j] + ((code >> 1) ^ -(code & 1))) & 0xffff
+                    pos += width
+                prev[sensor] = record
+                record = [((value >> 8) | (value << 8)) & 0xffff for value in record]
+            else:
+                # Raw record
+                record = [(bits >> (pos + 16 * j)) & 0xffff for j in range(words)]
+                pos += 16 * words
+            # If the record reached into lost data, skip it and the rest of the block
+            if pos > end:
+                for j in range(i, count): self.skipRecord()
+                return
+            # Grab the next sensor in the schedule,
+            self.decoderTime = self.decoderSchedule.popleft()
+            self.decoderSensor.popleft()
+            # let its decoder decode the data (which looks exactly like a raw record again),
+            sample = sensor.decoder.decode(struct.pack("<%dH" % words, *record))
+            # pass the decoded data to the decoded data hook if present,
+            if self.decodedDataHook is not None: self.decodedDataHook(self, sensor, (self.decoderTime - sensor.decoder.delay) / 1000., sample)
+            # and re-schedule the sensor for its next measurement time.
+            self.scheduleSensor(sensor)
+            self.decoderRecord += 1
+
+
+    # Skip the next record in the decoder's measurement schedule (packed format, data was lost)
+    def skipRecord(self):
+        self.decoderTime = self.decoderSchedule.popleft()
+        self.scheduleSensor(self.decoderSensor.popleft())
+        self.decoderRecord += 1
+
+
     # Insert a sensor into the decoder's measurement schedule.
     # This needs to exactly match the corresponding behavior on the sensor node side
     # in order to yield the sensors in the right order for decoding the recorded data.
@@ -469,7 +624,8 @@ class MultiSensorDevice(sensorplatform.rfdevice.RFDevice):
         # Move the sensor forward by its measurement interval (or the specified interval)
         if interval is None: interval = sensor.decoder.interval
         time = self.decoderTime + interval
-        # Figure out at which position in the queue it needs to be inserted
+        # Figure out at which position in the queue it needs to be inserted. Sensors that are due at
+        # the same time are sampled in insertion order, so insert it behind all of those (see taskqueue.h).
         index = bisect.bisect(self.decoderSchedule, time)
         # Insert the sensor (and its next sampling time) into the queue
         self.decoderSchedule.insert(index, time)
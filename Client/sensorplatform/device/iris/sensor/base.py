@@ -172,6 +172,8 @@ class Decoder(object):
         self.offset = 0  # The sensor's measurement schedule offset
         self.interval = 0  # The sensor's measurement schedule interval
         self.recordBytes = 0  # The number of bytes per data point of this sensor
+        self.packed = False  # Whether the data points are recorded in packed (compressed) format
+        self.delay = 0  # usec by which the data points were sampled before their schedule time
         self.printAs = "UNKNOWN(NO_DECODER)"  # String formatting pattern how to print measurements
         self.component = ()  # Tuple of symbols of the components of each data point
         self.unit = ()  # Tuple of units of the components of each data point
@@ -183,6 +185,8 @@ class Decoder(object):
         self.offset = self.sensor.getAttr("scheduleOffset")
         self.interval = self.sensor.getAttr("scheduleInterval")
         self.recordBytes = self.sensor.getAttr("recordSize") // 8
+        # Format version 1 is the packed format (delta + zigzag + bit packing)
+        self.packed = self.sensor.getAttr("formatVersion") == 1
         
         
     # Decode a captured data point, passed as a binary string
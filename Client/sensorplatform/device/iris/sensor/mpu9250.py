@@ -65,6 +65,8 @@ class GyroSensor(Sensor):
         self.attrs["selfTestZ"] = Attribute(2, 8, "B", mask=1, shift=5)
         self.attrs["fullScale"] = Attribute(2, 8, "B", mask=3, shift=3, map={0:250, 1:500, 2:1000, 3:2000})
         self.attrs["fchoiceB"] = Attribute(2, 8, "B", mask=3, shift=0)
+        # Number of samples to read from the IMU FIFO at once (0: read the data registers for every sample)
+        self.attrs["fifoBurst"] = Attribute(2, 26, "B")
         # Which channels of the sensor shall be sampled
         self.attrs["enableX"] = Attribute(2, 27, "B", mask=1, shift=2)
         self.attrs["enableY"] = Attribute(2, 27, "B", mask=1, shift=1)
@@ -149,6 +151,8 @@ class GyroDecoder(Decoder):
                        self.sensor.getAttr("enableY"),
                        self.sensor.getAttr("enableZ"))
         self.factor = self.sensor.getAttr("fullScale") / 32767.
+        # In FIFO mode, the recorded samples lag one burst behind their schedule time
+        self.delay = self.sensor.getAttr("fifoBurst") * self.interval
         
     def decode(self, sample):
         result = []
@@ -44,11 +44,13 @@ class Receiver(sensorplatform.usb.USBDevice):
         self.pollQueue = []  # List of device NodeIDs that should be polled for packets soon
         # Start node poll request sender thread
         threading.Thread(daemon=True, target=self.pollThread).start()
+        # Ask the receiver to pack up to 16 USB packets worth of radio packets into a single notification
+        self.setPacketBatching(16)
 
 
     # Read current telemetry counter values from the receiver device
     def updateTelemetry(self):
-        self.curTelemetry = struct.unpack("<IIIII", self.getRadioStats()[4][4:24])
+        self.curTelemetry = struct.unpack("<IIIIIIII", self.getRadioStats()[4][4:36])
 
 
     # Determine the change rate per second of the telemetry counters.
@@ -70,18 +72,25 @@ class Receiver(sensorplatform.usb.USBDevice):
         return self.cmd(0x0100)
         
 
+    # Configure the maximum size (in USB packets) of batched radio packet notifications (1: disable batching)
+    def setPacketBatching(self, maxSize):
+        return self.cmd(0x0101, struct.pack("B", maxSize))
+        
+
     # Shut down the receiver's radio
     def stopRadio(self):
         return self.cmd(0x0200)
         
 
     # Configure and start up the receiver's radio
-    def startRadio(self, channel, speed=0, txPower=0, receiverTxPower=0, guardBits=0, preGapBits=0, postGapBits=0, netId=None):
+    # minSlots enables shortening frames with unused slots down to that number of slots (0: always use 28 slots)
+    # burst lets nodes send consecutive slots back to back, without guard bits in between
+    def startRadio(self, channel, speed=0, txPower=0, receiverTxPower=0, guardBits=0, preGapBits=0, postGapBits=0, netId=None, minSlots=0, burst=0):
         # If NetId was passed as None (or not at all), choose a random one
         if netId is None: netId = random.randrange(256)
         print("Starting radio communication on %d MHz with netId %d..." % (2400 + channel, netId))
         return self.cmd(0x0201, struct.pack("<BBHBBHIBB", channel, netId, preGapBits | (speed << 14), guardBits,
-                                                          txPower << 4, 0, 0, postGapBits, receiverTxPower))
+                                                          txPower << 4, (minSlots & 0x1f) | ((burst & 1) << 5), 0, postGapBits, receiverTxPower))
 
 
     # Enqueue an device NodeId to be polled for packets soon
@@ -112,6 +121,15 @@ class Receiver(sensorplatform.usb.USBDevice):
         return self.cmd(0x027f, struct.pack("28B", *slotOwners))
 
 
+    # Set dynamic slot assignment weights (dict of NodeID => weight, 0 restores the default of 16).
+    # A node's share of the available slots is proportional to its weight. The receiver restores
+    # the default when the node disconnects, so this needs to be called again once it is back.
+    def setNodeWeights(self, weights):
+        items = list(weights.items())
+        for i in range(0, len(items), 30):
+            self.cmd(0x027d, b"".join(struct.pack("BB", nodeId, weight) for nodeId, weight in items[i:i+30]))
+
+
     # Send a radio packet to the specified NodeID
     def sendRFPacket(self, target, packet):
         # Dump the packet if requested
@@ -124,10 +142,22 @@ class Receiver(sensorplatform.usb.USBDevice):
         msg, seq, reserved = struct.unpack("<HBB", packet[:4])
         if msg == 0xc001:
             # This is a notification about a received radio packet.
-            # Get the packet contents and the current radio frame number.
-            sofCount = struct.unpack("<H", packet[4:6])[0]
-            data = packet[32:]
-            # Dump the packet if requested
-            if self.printRFPackets: print("RF 00 <<< %04X " % sofCount + self.hex(data))
-            # Call received packet hook to pass the packet to RFManager for further handling
-            if self.packetReceivedHook is not None: self.packetReceivedHook(self, sofCount, data)
+            # Get the packet contents and its reception info.
+            self.handleRFPacket(packet[12:20], packet[32:])
+        elif msg == 0xc002:
+            # This is a batch of received radio packets that spans multiple USB packets.
+            # Get the number of packets and handle each of them along with its reception info.
+            size, count, sofCount, rxCount, index = struct.unpack("<BBHHH", packet[4:12])
+            for i in range(count):
+                entry = packet[12 + i * 40 : 52 + i * 40]
+                self.handleRFPacket(entry[:8], entry[8:])
+
+
+    # Handle a received radio packet, given its reception info
+    def handleRFPacket(self, info, data):
+        # Get the receiver's microsecond timestamp, the frame number and time slot at which the packet arrived
+        rxTime, sofCount, slot = struct.unpack("<IHB", info[:7])
+        # Dump the packet if requested
+        if self.printRFPackets: print("RF 00 <<< %04X:%02d " % (sofCount, slot) + self.hex(data))
+        # Call received packet hook to pass the packet to RFManager for further handling
+        if self.packetReceivedHook is not None: self.packetReceivedHook(self, sofCount, data, rxTime, slot)
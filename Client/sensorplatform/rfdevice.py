@@ -71,6 +71,8 @@ class RFDevice(object):
         self.lastTx = [0] * 32  # Time of the last transmission attempt of the command packet
         self.lastRx = 0  # Time at which the last packet (of any kind) from the device was received
         self.lastNoData = 0  # Time at which the last buffer empty status packet was received from the device
+        self.lastRxTimestamp = 0  # Receiver microsecond timer value at which the last packet arrived over the air
+        self.lastRxSlot = 0  # Time slot that the last packet from the device was received in
         self.activeListeners = 0  # Number of command sequence numbers being in use
         self.curTelemetry = None  # Most recently captured set of telemetry counter values
         self.lastTelemetry = None  # Telemetry counter state after last snapshotTelemetry
@@ -229,13 +231,17 @@ class RFDevice(object):
 
     
     # Handle incoming radio packets from this device
-    def handlePacket(self, sofCount, packet):
+    def handlePacket(self, sofCount, packet, rxTime, slot):
         # Kill anything that tries to communicate with lost/disconnected devices
         if self.drop: return
         with self.commLock:
             # Notify other threads about reception of a packet and
             # keep track of the last successful communication time with the device.
             self.lastRx = time.monotonic()
+            # Also keep track of when the packet actually arrived at the receiver for latency analysis.
+            # (sofCount is the number of the frame that the packet was received in.)
+            self.lastRxTimestamp = rxTime
+            self.lastRxSlot = slot
             self.packetReceived.notify_all()
             if packet[3] == 0xff:
                 # This is a no data info packet, signalling that the device didn't have
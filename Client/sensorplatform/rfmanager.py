@@ -140,15 +140,15 @@ class RFManager(object):
         
 
     # Called whenever a radio packet is received on any receiver. Puts it into rxDataQueue.
-    def handlePacket(self, receiver, sofCount, data):
-        self.rxDataQueue.put((self.receivers[receiver], sofCount, data))
+    def handlePacket(self, receiver, sofCount, data, rxTime, slot):
+        self.rxDataQueue.put((self.receivers[receiver], sofCount, data, rxTime, slot))
 
 
     # Received packet processor thread (processes packets from rxDataQueue)
     def rxThread(self):
         while True:
             # Get a packet from the queue (blocks if there is none)
-            r, sofCount, data = self.rxDataQueue.get()
+            r, sofCount, data, rxTime, slot = self.rxDataQueue.get()
             now = time.monotonic()
             if data[0] == 0x7f:  # Notify
                 if data[1] == 0x00:  # NodeId
@@ -170,6 +170,17 @@ class RFManager(object):
                             # Otherwise attempt to assign a new NodeId and register the route.
                             self.devices[id].lastAssignAttempt = now
                             r.assignAddr(self.devices[id])
+                    else:
+                        with self.rfLock:
+                            # This is a device telling us its NodeId. It either confirms the one that we have just
+                            # assigned, or it is announcing that it is back after losing contact with the receiver
+                            # for a while, which will have stopped polling it. If we still know that NodeId, make
+                            # the receiver poll the device again. Otherwise the device will drop it soon.
+                            d = self.devices.get(sensorplatform.rfdevice.RFDevID(data[4:]))
+                            addr = d.addr if d is not None else None
+                            if addr is not None and addr.receiver == r and addr.nodeid == data[3] and not addr.expired():
+                                addr.refresh()
+                                r.receiver.pollDevice(addr.nodeid)
             else:
                 # Determine which device this packet originates from.
                 d = None
@@ -179,7 +190,7 @@ class RFManager(object):
                         addr.refresh()  # Reset the device's deassociation timeout
                         d = addr.device
                 # If we found the device, pass the packet to its driver.
-                if d is not None: d.device.handlePacket(sofCount, data)
+                if d is not None: d.device.handlePacket(sofCount, data, rxTime, slot)
                 # Otherwise print a notification about a spurious packet (if requested)
                 elif self.printDroppedPackets:
                     print("Dropped packet from unknown nodeId %02x (frame %04X): %s" % (data[0], sofCount, binascii.hexlify(data).decode("ascii")))
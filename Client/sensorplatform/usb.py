@@ -84,15 +84,22 @@ class USBDevice(object):
 
     # Received USB packet processor thread: Processes packets from rxDataQueue
     def procThread(self):
+        data = b""
         while True:
-            # Grab an element from the queue and split it into packets
-            data = self.rxDataQueue.get()
-            if len(data) < 64: continue  # Should never actually happen
-            for packet in [data[i:i+64] for i in range(0, len(data), 64)]:
+            # Grab an element from the queue, append it to any incomplete leftovers and split it into packets
+            data += self.rxDataQueue.get()
+            offset = 0
+            while len(data) - offset >= 64:
+                # Parse the header
+                msg, seq, reserved = struct.unpack("<HBB", data[offset:offset+4])
+                # Batched radio packet notifications span multiple USB packets
+                size = data[offset+4] if msg == 0xc002 else 1
+                if size < 1: size = 1  # Should never actually happen
+                if len(data) - offset < size * 64: break  # Wait for the rest of the batch
+                packet = data[offset:offset+size*64]
+                offset += size * 64
                 # Dump the received packet if requested
                 if self.printUSBPackets: print("  USB <<< " + self.hex(packet))
-                # Parse the header
-                msg, seq, reserved = struct.unpack("<HBB", packet[:4])
                 if msg >> 14 == 2 and self.replyListener[seq] is not None:
                     # This is a reply packet. Extract the result code, put it into the
                     # corresponding listener's mailbox and wake up that listener.
@@ -103,6 +110,7 @@ class USBDevice(object):
                     # This is a notify packet (usually about a received radio packet),
                     # so pass it to the notify packet handler (implemented by a subclass)
                     self.handleNotify(packet)
+            data = data[offset:]
                   
 
     # Send a USB packet to the device
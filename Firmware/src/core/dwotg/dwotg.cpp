@@ -463,6 +463,7 @@ void DWOTG::drvStart()
     regs->gregs.gccfg.d32 = gccfg.d32;
     DWOTGRegs::dcfg dcfg = { 0 };
     dcfg.b.nzstsouthshk = true;
+    dcfg.b.devspd = speed;
     regs->dregs.dcfg.d32 = dcfg.d32;
 
     // Configure the FIFOs
@@ -25,6 +25,15 @@
 // Synopsys DesignWare USB OTG hardware interface driver
 class __attribute__((packed,aligned(4))) DWOTG : public USB::USB
 {
+public:
+    // Device speed (DCFG.DSPD), depends on the PHY that the core is wired to
+    enum Speed
+    {
+        Speed_High = 0,  // High speed using a high speed PHY
+        Speed_FullOnHighSpeedPhy = 1,  // Full speed using a high speed PHY
+        Speed_Full = 3,  // Full speed using the internal full speed PHY
+    };
+private:
     // Hardware register base address
     volatile DWOTGRegs::core_regs* regs __attribute__((aligned(4)));
 protected:
@@ -34,7 +43,8 @@ protected:
     bool useDma : 1;
     bool sharedTxFifo : 1;
     bool disableDoubleBuffering : 1;
-    uint32_t : 3;
+    Speed speed : 2;
+    uint32_t : 1;
     uint8_t fifoCount;
     uint16_t totalFifoSize;
     const uint16_t* fifoSizeList;
@@ -81,12 +91,12 @@ public:
                     const ::USB::Descriptor::StringDescriptor* const* stringDescriptors, uint8_t stringDescriptorCount,
                     ::USB::Configuration* const* configurations, uint8_t configurationCount,
                     volatile DWOTGRegs::core_regs* regs, bool phy16bit, bool phyUlpi, bool useDma,
-                    bool sharedTxFifo, bool disableDoubleBuffering,
+                    bool sharedTxFifo, bool disableDoubleBuffering, Speed speed,
                     uint8_t fifoCount, uint16_t totalFifoSize, const uint16_t* fifoSizeList)
         : USB(deviceDescriptor, bosDescriptor, stringDescriptors, stringDescriptorCount,
               configurations, configurationCount, &buffer, true),
           regs(regs), phy16bit(phy16bit), phyUlpi(phyUlpi), useDma(useDma), sharedTxFifo(sharedTxFifo),
-          disableDoubleBuffering(disableDoubleBuffering), fifoCount(fifoCount), totalFifoSize(totalFifoSize),
-          fifoSizeList(fifoSizeList), endpoints() {}
+          disableDoubleBuffering(disableDoubleBuffering), speed(speed), fifoCount(fifoCount),
+          totalFifoSize(totalFifoSize), fifoSizeList(fifoSizeList), endpoints() {}
 };
 
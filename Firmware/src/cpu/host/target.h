@@ -0,0 +1,24 @@
+#pragma once
+
+// Generic Microcontroller Firmware Platform
+// Copyright (C) 2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Hosted build (Linux/x86-64) for simulations and benchmarks of hardware independent code.
+// There is no platform initialization, main() is called by the C library.
+
+
+#define CPU_HOST
+#define ENDIANNESS_LITTLE
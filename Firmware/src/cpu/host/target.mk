@@ -0,0 +1 @@
+LDFLAGS_GENERAL := $(filter-out -nostdlib,$(LDFLAGS_GENERAL)) -no-pie
@@ -0,0 +1,4 @@
+# Included by the toolchain.mk of targets that are built with the native compiler of the build machine
+CROSS :=
+# Per-object assembler listings don't survive the LTO link step, don't ask the native assembler for them
+ASLIST :=
@@ -0,0 +1,26 @@
+// Generic Microcontroller Firmware Platform
+// Copyright (C) 2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "sys/util.h"
+#include <stdlib.h>
+
+// Don't spin forever if something goes wrong, make it visible to the calling shell instead.
+void hang()
+{
+    abort();
+}
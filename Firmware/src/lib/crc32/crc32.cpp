@@ -0,0 +1,76 @@
+// Generic Microcontroller Firmware Platform
+// Copyright (C) 2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+
+// Portable software implementation of crc32(), for targets without a CRC unit (such as host builds).
+// Produces the same results as the STM32 CRC unit: MSB first, polynomial 0x04c11db7, initial value
+// 0xffffffff, no final XOR, fed with little endian 32 bit words (trailing bytes are ignored).
+// Uses slicing-by-8, processing two words per step with eight lookup tables.
+
+
+#include "global.h"
+#include "lib/crc32/crc32.h"
+
+
+namespace
+{
+    struct Tables
+    {
+        uint32_t table[8][256];  // table[n][i]: CRC of byte i followed by n zero bytes
+
+        Tables()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t crc = i << 24;
+                for (int bit = 0; bit < 8; bit++) crc = (crc << 1) ^ (0x04c11db7 & -(crc >> 31));
+                table[0][i] = crc;
+            }
+            for (uint32_t n = 1; n < 8; n++)
+                for (uint32_t i = 0; i < 256; i++)
+                    table[n][i] = (table[n - 1][i] << 8) ^ table[0][table[n - 1][i] >> 24];
+        }
+    };
+
+    const Tables tables;
+
+    inline uint32_t loadWord(const uint8_t* buf)
+    {
+        return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+    }
+}
+
+
+uint32_t CRC32_OPTIMIZE crc32(const void* buf, uint32_t len)
+{
+    const uint32_t (*t)[256] = tables.table;
+    const uint8_t* data = (const uint8_t*)buf;
+    uint32_t crc = 0xffffffff;
+    for (; len >= 8; len -= 8, data += 8)
+    {
+        uint32_t a = crc ^ loadWord(data);
+        uint32_t b = loadWord(data + 4);
+        crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff] ^ t[5][(a >> 8) & 0xff] ^ t[4][a & 0xff]
+            ^ t[3][b >> 24] ^ t[2][(b >> 16) & 0xff] ^ t[1][(b >> 8) & 0xff] ^ t[0][b & 0xff];
+    }
+    if (len >= 4)
+    {
+        uint32_t a = crc ^ loadWord(data);
+        crc = t[3][a >> 24] ^ t[2][(a >> 16) & 0xff] ^ t[1][(a >> 8) & 0xff] ^ t[0][a & 0xff];
+    }
+    return crc;
+}
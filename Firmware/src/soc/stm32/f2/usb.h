@@ -50,7 +50,7 @@ namespace STM32
             uint16_t totalFifoSize;
             bool phy16bit : 1;
             bool phyUlpi : 1;
-            bool useDma : 1;
+            bool useDma : 1;  // Whether the core has an internal DMA controller
             bool sharedTxFifo : 1;
             uint32_t : 12;
         } coreParams[] =
@@ -77,10 +77,11 @@ namespace STM32
                       const ::USB::Descriptor::BOSDescriptor* bosDescriptor,
                       const ::USB::Descriptor::StringDescriptor* const* stringDescriptors,
                       uint8_t stringDescriptorCount, ::USB::Configuration* const* configurations,
-                      uint8_t configurationCount, UsbCore core, const uint16_t* fifoSizeList, unsigned int fifoCount)
+                      uint8_t configurationCount, UsbCore core, const uint16_t* fifoSizeList, unsigned int fifoCount,
+                      bool useDma = true, Speed speed = Speed_High)
             : DWOTG(deviceDescriptor, bosDescriptor, stringDescriptors, stringDescriptorCount, configurations,
                     configurationCount, coreParams[core].regs, coreParams[core].phy16bit, coreParams[core].phyUlpi,
-                    coreParams[core].useDma, coreParams[core].sharedTxFifo, false, fifoCount,
+                    coreParams[core].useDma && useDma, coreParams[core].sharedTxFifo, false, speed, fifoCount,
                     coreParams[core].totalFifoSize, fifoSizeList), core(core) {}
     };
 
@@ -25,7 +25,7 @@
 #endif
 
 
-#define TIME_AFTER(a, b) ((long)(b) - (long)(a) < 0)
+#define TIME_AFTER(a, b) ((int32_t)((uint32_t)(b) - (uint32_t)(a)) < 0)
 #define TIME_BEFORE(a, b) TIME_AFTER(b, a)
 #define TIMEOUT_SETUP(a) (read_usec_timer() + (a))
 #define TIMEOUT_EXPIRED(a) TIME_AFTER(read_usec_timer(), a)
@@ -37,14 +37,16 @@ __attribute__((noreturn,weak,alias("hang"))) void reset();
 
 __attribute__((noreturn,weak,alias("hang"))) void powerdown();
 
-extern "C" __attribute__((weak,alias("hang"))) void __cxa_pure_virtual();
+extern "C" __attribute__((noreturn,weak,alias("hang"))) void __cxa_pure_virtual();
 
+#ifdef CPU_ARM
 extern "C" __attribute__((weak)) uint64_t __aeabi_ldiv0()
 {
     return 0;
 }
 
 extern "C" __attribute__((weak,alias("__aeabi_ldiv0"))) uint32_t __aeabi_idiv0();
+#endif
 
 __attribute__((noreturn,weak)) void execfirmware(void* address)
 {
@@ -115,6 +117,8 @@ __attribute__((weak)) void* memset(void* dst_void, int val, size_t len)
         unsigned long* aligned_dst = (unsigned long*)dst;
         unsigned long longval = (val << 8) | val;
         longval |= longval << 16;
+        // Fill the upper half as well if long is 64 bits wide (host builds)
+        if (sizeof(longval) > 4) longval |= (longval << 16) << 16;
         while (len >= BIGBLOCKSIZE)
         {
             *aligned_dst++ = longval;
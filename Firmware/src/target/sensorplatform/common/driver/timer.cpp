@@ -74,6 +74,15 @@ namespace Timer
         regs->ARR = period - 1;
     }
 
+    // Change the period of a hardware timer, including the currently running one (bypasses ARR double-buffering).
+    // The counter must not have passed the new period yet, otherwise the next update will only happen after it wrapped.
+    void setCurrentPeriod(volatile STM32_TIM_REG_TYPE* regs, int period)
+    {
+        regs->CR1.b.ARPE = false;
+        regs->ARR = period - 1;
+        regs->CR1.b.ARPE = true;
+    }
+
     // Reset the counters of a hardware timer (applies PSC/ARR and clears any pending IRQs)
     void reset(volatile STM32_TIM_REG_TYPE* regs)
     {
@@ -26,6 +26,7 @@ namespace Timer
     extern void start(volatile STM32_TIM_REG_TYPE* regs, int clkgate, int prescaler, int period);
     extern void stop(volatile STM32_TIM_REG_TYPE* regs, int clkgate);
     extern void updatePeriod(volatile STM32_TIM_REG_TYPE* regs, int period);
+    extern void setCurrentPeriod(volatile STM32_TIM_REG_TYPE* regs, int period);
     extern void reset(volatile STM32_TIM_REG_TYPE* regs);
     extern uint32_t read(volatile STM32_TIM_REG_TYPE* regs);
     extern void enableIRQ(volatile STM32_TIM_REG_TYPE* regs, bool on);
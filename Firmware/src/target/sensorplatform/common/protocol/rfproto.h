@@ -39,6 +39,7 @@ namespace RF
         MinNode = 0x01,  // Beginning of radio address and node ID range for nodes
         MaxNode = 0x64,  // End (inclusive) of radio address and node ID range for nodes
         // Gap reserved for future expansion
+        FrameEnd = 0x7e,  // Node ID 0x7e in SOF slot assignments: This slot and all following ones are not part of the frame
         Notify = 0x7f,  // Radio address 0x00 (node to receiver), node ID 0x7f
         NotifyReply = 0x7f,  // Radio address 0x7f (receiver to node), node ID 0x7f
         // Addresses >=0x80 are only usable as radio addresses, not as NodeIDs in packets
@@ -58,7 +59,10 @@ namespace RF
         uint8_t guardBits;  // Bit times of turnaround time between RX slots
         uint8_t cmdSlots : 4;  // (Maximum) number of command slots after SOF
         uint8_t txPower : 2;  // Desired sensor node transmission power: (6 * x) - 18 dBm
-        uint32_t : 18;
+        uint8_t : 2;
+        uint8_t minSlots : 5;  // Minimum number of RX slots per frame (0: frames always have 28 slots)
+        bool burst : 1;  // Nodes send consecutive slots back to back, without guard bits in between (see getBurstSlots)
+        uint32_t : 10;
     };
 
     // Additional RF channel attributes only relevant to the base station
@@ -119,12 +123,15 @@ namespace RF
         CID_SaveSeriesHeader = 0x0107,  // Save series header pages (including sensors) to flash
         CID_StartMeasurement = 0x0110,  // Start measurement (as configured by series header)
         CID_StopMeasurement = 0x0111,  // Stop measurement (returns OK of none is running)
+        CID_StartReadback = 0x0112,  // Stream recorded measurement data blocks back from the SD card
+        CID_StopReadback = 0x0113,  // Abort a running readback (returns OK if none is running)
         CID_StartUpload = 0x01f0,  // Switch to firmware upload mode
         CID_StopUpload = 0x01f1,  // Leave firmware upload mode (returns OK if not in upload mode)
         CID_UploadData = 0x01f2,  // Transfer 28-byte firmware chunk to sensor node
         CID_WriteSector = 0x01f3,  // Write 512-byte firmware block to microSD card
         CID_UpgradeFirmware = 0x01f4,  // Initiate firmware upgrade using updater in sector buffer
         CID_Reboot = 0x01ff,  // Reboot the sensor node firmware
+        CID_DataAck = 0x0200,  // Measurement data acknowledgement (broadcast by the base station, not answered)
     };
 
     // Sensor node command return codes
@@ -179,7 +186,8 @@ namespace RF
         uint16_t txAttemptCount;  // Number of transmitted packets
         uint16_t txAckCount;  // Number of acknowledged packets
         uint16_t rxCmdCount;  // Number of received non-SOF packets
-        uint16_t reserved[2];  // Reserved for battery state etc.
+        uint16_t rejoinCount;  // Number of times that SOF packets were received again after an outage
+        uint16_t rejoinMsecs;  // Total duration of those outages (milliseconds)
     };
 
     // Radio packet structure
@@ -244,6 +252,17 @@ namespace RF
                 uint64_t unixTime;  // Unix timestamp to be put into the series header
             } startMeasurement;
 
+            // Reads back a range of recorded measurement data blocks (17 pages each, counted from the
+            // start of the series like the measurement data stream) from the SD card. They are sent as
+            // measurement data packets, with sequence numbers continuing from the first requested page.
+            // Blocks that aren't completely present on the card are skipped.
+            struct __attribute__((packed,aligned(4))) StartReadback
+            {
+                Header header;  // CID_StartReadback
+                uint32_t firstBlock;  // Measurement data block to start at
+                uint32_t blockCount;  // Number of blocks to be sent
+            } startReadback;
+
             // Write sector buffer contents (transferred using CID_UploadData) to SD card
             struct __attribute__((packed,aligned(4))) WriteSector
             {
@@ -262,6 +281,21 @@ namespace RF
                 uint32_t size;  // Firmware image size (in 512-byte sectors)
                 uint32_t crc;  // Firmware image CRC32 (upgrade will be aborted if incorrect)
             } upgradeFimware;
+
+            // Selective measurement data acknowledgement, covering a window of the 33 most recent
+            // data sequence numbers that the base station received from a node. This is broadcast
+            // in otherwise unused command slots and allows nodes to release transmission buffers
+            // even if they missed the SOF packet that carried the per-slot acknowledgement bits.
+            struct __attribute__((packed,aligned(4))) DataAck
+            {
+                Header header;  // CID_DataAck, arg is the number of valid entries
+                struct __attribute__((packed,aligned(1))) Entry
+                {
+                    uint8_t nodeId;  // Node that this entry applies to
+                    uint16_t seq;  // Highest measurement data sequence number received from that node
+                    uint32_t bitmap;  // Bit N set: seq - 1 - N was received as well
+                } entry[4];
+            } dataAck;
         } cmd;
 
         // Sensor node => host packets (command replies or measurement data)
@@ -293,7 +327,7 @@ namespace RF
                 uint8_t pollInFrames;  // Node requests to be polled again n frames later
                 ReplyMessageId messageId : 8;  // RID_NoData
                 uint32_t localTime;  // Current microsecond timer value of the node
-                uint32_t bitrate;  // Estimated average measurement data bitrate (not implemented)
+                uint32_t bitrate;  // Measurement data bitrate of the sensor schedule (bits/s, 0 if not measuring)
                 uint32_t dataSeq;  // Highest measurement data packet sequence number sent so far
                 TelemetryData telemetry;  // Radio link and node status telemetry data
             } noData;
@@ -363,4 +397,31 @@ namespace RF
         } notifyReply;
     };
 
+    // The nRF24L01+ must not stay in TX mode for more than 4ms, which limits the length of bursts
+    const int MAX_BURST_USECS = 3800;
+
+    // With ChannelAttributes::burst set, a slot that belongs to the same node as the one before it continues
+    // the burst of that node: It starts right after the previous one, without any guard bits. Bursts are
+    // broken up where they would exceed MAX_BURST_USECS. Nodes never transmit into a slot right after one of their
+    // own that doesn't continue a burst (which also rules out running into a broken up burst).
+    // Returns a bit mask of the slots of a frame that continue a burst (bit 0 is never set).
+    inline uint32_t getBurstSlots(const Packet::SOF* sof, int slots, int speed)
+    {
+        int packetUsecs = ((8 + 24 + 256 + 16) << speed) >> 1;
+        int maxLength = MAX_BURST_USECS / packetUsecs;
+        uint32_t mask = 0;
+        int length = 1;
+        for (int slot = 1; slot < slots; slot++)
+        {
+            int owner = sof->slot[slot].owner;
+            if (owner >= MinNode && owner <= MaxNode && owner == sof->slot[slot - 1].owner && length < maxLength)
+            {
+                mask |= 1 << slot;
+                length++;
+            }
+            else length = 1;
+        }
+        return mask;
+    }
+
 }
@@ -38,13 +38,16 @@ namespace USB
     enum MessageType
     {
         CID_GetRadioStats = 0x0100,
+        CID_SetPacketBatching = 0x0101,
         CID_StopRadio = 0x0200,
         CID_StartRadio = 0x0201,
+        CID_SetNodeWeights = 0x027d,
         CID_PollDevice = 0x027e,
         CID_AssignSlots = 0x027f,
         CID_TransmitCommand = 0x0280,
         RID_CommandResult = 0x8001,
         NID_RFPacketReceived = 0xc001,
+        NID_RFPacketBatch = 0xc002,
     };
 
     // Status codes for reply messages
@@ -66,7 +69,19 @@ namespace USB
         uint32_t rxAcked;  // Total number of RX packets acknowledged
         uint32_t rxSlotNotOwned;  // Total number of RX packets in slots where they didn't belong
         uint32_t rxOverflow;  // Total number of RX buffer overflow events (not packets)
-        uint32_t reserved[8];
+        uint32_t fwdCycles;  // Total number of CPU cycles spent forwarding received packets to USB
+        uint32_t fwdPackets;  // Total number of received packets forwarded to USB
+        uint32_t dataAckSent;  // Total number of measurement data acknowledgement broadcasts sent
+        uint32_t reserved[5];
+    };
+
+    // Reception info of a radio packet (captured by the radio when the packet arrived)
+    struct __attribute__((packed,aligned(4))) RxPacketInfo
+    {
+        uint32_t time;  // Local microsecond timer value when the packet was received (see RadioStats.localTime)
+        uint16_t sofCount;  // Low 16 bits of the number of the frame that the packet was received in
+        uint8_t slot;  // Time slot that the packet was received in (as determined from its timing)
+        uint8_t reserved;
     };
 
     // USB packet format union
@@ -77,7 +92,7 @@ namespace USB
         {
             MessageType type : 16;
             uint8_t seq;  // Sequence number of the command (will be copied into the response)
-            uint8_t : 8;
+            uint8_t radio;  // Radio that the packet refers to (for receivers with multiple radios, 0 otherwise)
         } header;
 
         // Command packets (Host => Receiver, unsolicited)
@@ -86,6 +101,15 @@ namespace USB
             // CID_* message types not explicitly listed below use just the header
             Header header;
 
+            // Configures how received radio packets are reported to the host
+            struct __attribute__((packed,aligned(4))) SetPacketBatching
+            {
+                Header header;  // CID_SetPacketBatching
+                // Maximum number of USB packets that a NID_RFPacketBatch notification may span
+                // (0 or 1: Send a NID_RFPacketReceived notification for every single radio packet)
+                uint8_t maxSize;
+            } setPacketBatching;
+
             // Configures the radio chip and starts communication
             // (according to the specified channel attributes)
             struct __attribute__((packed,aligned(4))) StartRadio
@@ -104,6 +128,19 @@ namespace USB
                 RF::TimeSlotOwner slot[ARRAYLEN(RF::Packet::SOF::slot)];
             } assignSlots;
 
+            // Sets the dynamic slot assignment weights for a list of NodeIDs. A node's share of
+            // the available slots is proportional to its weight. (Entries with NodeID 0 are ignored,
+            // weight 0 resets a node to the default weight of 16.)
+            struct __attribute__((packed,aligned(4))) SetNodeWeights
+            {
+                Header header;  // CID_SetNodeWeights
+                struct __attribute__((packed,aligned(1))) NodeWeight
+                {
+                    uint8_t nodeId;
+                    uint8_t weight;
+                } node[30];
+            } setNodeWeights;
+
             // Enqueues a packet for transmission
             struct __attribute__((packed,aligned(4))) TransmitCommand
             {
@@ -144,11 +181,39 @@ namespace USB
                 uint16_t sofCount;  // Low 16 bits of the current frame number
                 uint16_t rxCount;  // Low 16 bits of the received (acknowledged) packet counter
                 uint16_t index;  // Number of received radio packets transmitted via USB
-                uint8_t reserved[22];
+                uint16_t reserved0;
+                RxPacketInfo info;  // When and in which slot the packet was received
+                uint8_t reserved[12];
                 uint8_t packet[32];
                 // Note: sofCount/rxCount are captured at the time that the packet is processed
                 //       by the USB layer and MAY NOT reflect the time that the packet is from!
+                //       Use info.sofCount to find out which frame the packet was received in.
             } rfPacketReceived;
+
+            // Received radio packet along with its reception info (entry of a NID_RFPacketBatch notification)
+            struct __attribute__((packed,aligned(4))) RxPacket
+            {
+                RxPacketInfo info;
+                uint8_t packet[32];
+            };
+
+            // Received radio packets notification, spanning one or more consecutive USB packets
+            // within the same transfer. The radio packets are stored back to back (40 bytes each,
+            // including their reception info), starting at offset 12 of the first USB packet.
+            // The rest of the last USB packet is undefined (the receiver sends these straight
+            // out of its radio receive buffers).
+            struct __attribute__((packed,aligned(4))) RFPacketBatch
+            {
+                Header header;  // NID_RFPacketBatch
+                uint8_t size;  // Number of USB packets (64 bytes each) that this notification spans
+                uint8_t count;  // Number of radio packets in this notification
+                uint16_t sofCount;  // Low 16 bits of the current frame number
+                uint16_t rxCount;  // Low 16 bits of the received (acknowledged) packet counter
+                uint16_t index;  // Number of received radio packets transmitted via USB before the first one
+                RxPacket packet[1];  // First radio packet, continues into the following USB packets
+                // Note: sofCount/rxCount are captured at the time that the packets are processed
+                //       by the USB layer and MAY NOT reflect the time that the packets are from!
+            } rfPacketBatch;
         } notify;
     };
 
@@ -0,0 +1,300 @@
+// SensorPlatform Measurement Data Compression Host Test
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Round trip test and throughput benchmark of the sensor node's packed measurement data format.
+// Records are encoded into blocks the same way the sensor task does it, decoded again by a reference
+// decoder and compared against the input. Synthetic IMU-like data sets are seeded deterministically.
+// Optionally, a file with 3-channel IMU records as recorded (big endian 16 bit samples) can be passed in CODEC_TEST_FILE.
+
+
+#include "global.h"
+#include "app/main.h"
+#include "sys/util.h"
+#include "../multisensor/codec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+// Size of a measurement data block in 32 bit words (17 pages, see multisensor/common.h)
+#define BLOCK_WORDS (17 * 28 / 4)
+// Maximum number of sensors in a test schedule
+#define MAX_SENSORS 8
+
+
+namespace Test
+{
+    struct Sensor
+    {
+        const char* name;
+        int words;  // Words per record
+        bool packed;  // Whether this sensor uses Format_Packed
+        int32_t offset[Codec::MAX_RECORD_WORDS];  // Constant offset per channel (e.g. gravity)
+        int noise;  // Peak white noise amplitude
+        int walk;  // Peak random walk step size
+        int32_t state[Codec::MAX_RECORD_WORDS];  // Current random walk value per channel
+        Codec::Predictor predictor;  // Encoder state
+        Codec::Predictor decoderPredictor;  // Decoder state
+    };
+
+    struct DataSet
+    {
+        const char* name;
+        int sensorCount;
+        Sensor sensor[MAX_SENSORS];
+        int scheduleLength;
+        uint8_t schedule[32];  // Sensor indices in sampling order (repeated)
+    };
+
+    static uint32_t randomState;
+    static uint16_t* input;  // Words of all records in schedule order
+    static uint32_t* blocks;  // Encoded blocks
+    static uint16_t* output;  // Decoded words
+    static Codec::PackedEncoder encoder;
+
+
+    // Deterministic xorshift pseudo random number generator
+    static uint32_t random()
+    {
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        return randomState;
+    }
+
+
+    static uint64_t readNsecTimer()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ((uint64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+
+    // Uniformly distributed random number in [-amplitude, amplitude]
+    static int32_t randomAmplitude(int amplitude)
+    {
+        if (!amplitude) return 0;
+        return (int32_t)(random() % (2 * amplitude + 1)) - amplitude;
+    }
+
+
+    // Generate the words of TEST_RECORDS records following the data set's schedule
+    static uint32_t generate(DataSet* set)
+    {
+        uint32_t words = 0;
+        for (uint32_t i = 0; i < TEST_RECORDS; i++)
+        {
+            Sensor* s = set->sensor + set->schedule[i % set->scheduleLength];
+            for (int c = 0; c < s->words; c++)
+            {
+                s->state[c] += randomAmplitude(s->walk);
+                // Keep the random walk within a plausible part of the sensor range
+                if (s->state[c] > 8000 || s->state[c] < -8000) s->state[c] /= 2;
+                // Words are stored big endian (as the IMU delivers them)
+                uint16_t value = s->offset[c] + s->state[c] + randomAmplitude(s->noise);
+                input[words++] = (value >> 8) | (value << 8);
+            }
+        }
+        return words;
+    }
+
+
+    // Encode all records into blocks (mirrors SensorTask::encodeRecord), returns false if a record didn't fit
+    static bool encode(DataSet* set, uint32_t* blockCount)
+    {
+        uint32_t block = 0;
+        const uint16_t* words = input;
+        encoder.startBlock(blocks, 0);
+        for (uint32_t i = 0; i < TEST_RECORDS; i++)
+        {
+            Sensor* s = set->sensor + set->schedule[i % set->scheduleLength];
+            Codec::Predictor* pred = s->packed ? &s->predictor : NULL;
+            if (!encoder.writeRecord(words, s->words, pred))
+            {
+                encoder.finishBlock();
+                block++;
+                encoder.startBlock(blocks + block * BLOCK_WORDS, i);
+                if (!encoder.writeRecord(words, s->words, pred)) return false;
+            }
+            words += s->words;
+        }
+        encoder.finishBlock();
+        *blockCount = block + 1;
+        return true;
+    }
+
+
+    // Read a value of the specified bit width from a block
+    static uint32_t get(const uint32_t* data, int* bits, int width)
+    {
+        if (!width) return 0;
+        int word = *bits >> 5;
+        int shift = *bits & 31;
+        uint64_t value = data[word] >> shift;
+        if (shift + width > 32) value |= ((uint64_t)data[word + 1]) << (32 - shift);
+        *bits += width;
+        return value & ((1 << width) - 1);
+    }
+
+
+    // Reference decoder (same algorithm as the client software), returns the number of decoded words
+    static uint32_t decode(DataSet* set, uint32_t blockCount)
+    {
+        uint32_t words = 0;
+        uint32_t expectedRecord = 0;
+        for (uint32_t b = 0; b < blockCount; b++)
+        {
+            const uint32_t* data = blocks + b * BLOCK_WORDS;
+            int bits = 0;
+            uint32_t count = get(data, &bits, 16);
+            uint32_t first = get(data, &bits, 16);
+            first |= get(data, &bits, 16) << 16;
+            if (first != expectedRecord)
+            {
+                printf("block %u: first record %u, expected %u\n", b, first, expectedRecord);
+                return 0;
+            }
+            // Predictors start from zero in every block
+            for (int i = 0; i < set->sensorCount; i++)
+                memset(set->sensor[i].decoderPredictor.prev, 0, sizeof(set->sensor[i].decoderPredictor.prev));
+            for (uint32_t r = first; r < first + count; r++)
+            {
+                Sensor* s = set->sensor + set->schedule[r % set->scheduleLength];
+                if (!s->packed)
+                {
+                    for (int c = 0; c < s->words; c++) output[words++] = get(data, &bits, 16);
+                    continue;
+                }
+                int width = get(data, &bits, 4);
+                if (width == Codec::PackedEncoder::MAX_WIDTH_CODE) width = 16;
+                for (int c = 0; c < s->words; c++)
+                {
+                    uint16_t code = get(data, &bits, width);
+                    uint16_t delta = (code >> 1) ^ (0 - (code & 1));
+                    uint16_t value = s->decoderPredictor.prev[c] += delta;
+                    output[words++] = (value >> 8) | (value << 8);
+                }
+            }
+            if (bits > Codec::PackedEncoder::BLOCK_BITS)
+            {
+                printf("block %u: overrun (%d bits)\n", b, bits);
+                return 0;
+            }
+            expectedRecord = first + count;
+        }
+        if (expectedRecord != TEST_RECORDS) printf("decoded %u records, expected %u\n", expectedRecord, TEST_RECORDS);
+        return words;
+    }
+
+
+    // Run the round trip and benchmark for a data set, returns whether the output matched the input
+    static bool run(DataSet* set, uint32_t words)
+    {
+        uint32_t blockCount = 0;
+        uint64_t start = readNsecTimer();
+        bool fits = encode(set, &blockCount);
+        uint64_t encodeNs = readNsecTimer() - start;
+        bool pass = fits && decode(set, blockCount) == words && !memcmp(input, output, words * sizeof(*input));
+        // Raw blocks would contain the concatenated records
+        uint64_t rawBytes = words * sizeof(*input);
+        uint64_t rawBlocks = (rawBytes + BLOCK_WORDS * 4 - 1) / (BLOCK_WORDS * 4);
+        printf("%-10s %9u %9llu %9u %7.3f %9.1f %10.1f  %s\n", set->name, words, (unsigned long long)rawBlocks,
+               blockCount, (double)rawBlocks / blockCount, rawBytes * 1000. / encodeNs,
+               TEST_RECORDS * 1000. / encodeNs, pass ? "PASS" : "FAIL");
+        return pass;
+    }
+
+
+    // Load 3-channel samples from a file into a data set (only as many as TEST_RECORDS allows)
+    static bool load(const char* path, DataSet* set)
+    {
+        FILE* f = fopen(path, "rb");
+        if (!f)
+        {
+            printf("could not open %s\n", path);
+            return false;
+        }
+        uint32_t words = fread(input, sizeof(*input), TEST_RECORDS * 3, f);
+        fclose(f);
+        if (words < 3)
+        {
+            printf("%s is too short\n", path);
+            return false;
+        }
+        // Repeat the file contents if it is shorter than the test
+        for (uint32_t i = words; i < TEST_RECORDS * 3; i++) input[i] = input[i - words];
+        return true;
+    }
+}
+
+
+int main()
+{
+    // Sensors of the synthetic data sets (raw LSB values like the MPU9250 delivers them)
+    static Test::DataSet sets[] =
+    {
+        {
+            "imu", 4,
+            {
+                { "accel", 3, true, { 0, 0, 16384 }, 40, 3 },
+                { "gyro", 3, true, { 0, 0, 0 }, 20, 2 },
+                { "mag", 3, true, { 120, -80, 300 }, 5, 1 },
+                { "temp", 1, false, { 2000 }, 2, 0 },
+            },
+            12, { 0, 1, 0, 1, 0, 1, 2, 0, 1, 0, 1, 3 },
+        },
+        {
+            "imu-still", 2,
+            {
+                { "accel", 3, true, { 0, 0, 16384 }, 4, 0 },
+                { "gyro", 3, true, { 0, 0, 0 }, 2, 0 },
+            },
+            2, { 0, 1 },
+        },
+        {
+            // Worst case: Full scale noise needs 16 bits per sample plus the width codes
+            "noise", 1,
+            {
+                { "accel", 3, true, { 0, 0, 0 }, 32767, 0 },
+            },
+            1, { 0 },
+        },
+        {
+            "raw", 1,
+            {
+                { "accel", 3, false, { 0, 0, 16384 }, 40, 3 },
+            },
+            1, { 0 },
+        },
+    };
+    static Test::DataSet fileSet = { "file", 1, { { "imu", 3, true } }, 1, { 0 } };
+
+    Test::input = (uint16_t*)malloc(TEST_RECORDS * Codec::MAX_RECORD_WORDS * sizeof(*Test::input));
+    Test::output = (uint16_t*)malloc(TEST_RECORDS * Codec::MAX_RECORD_WORDS * sizeof(*Test::output));
+    // At least 16 records of up to MAX_RECORD_WORDS words fit into every block
+    Test::blocks = (uint32_t*)malloc((TEST_RECORDS / 16 + 1) * BLOCK_WORDS * sizeof(*Test::blocks));
+    if (!Test::input || !Test::output || !Test::blocks) return 1;
+
+    printf("%d records per data set, %d byte blocks\n", TEST_RECORDS, BLOCK_WORDS * 4);
+    printf("data set       words rawblocks    blocks   ratio   MB/s in  Mrecords/s\n");
+    bool pass = true;
+    Test::randomState = TEST_SEED;
+    for (uint32_t i = 0; i < ARRAYLEN(sets); i++) pass = Test::run(sets + i, Test::generate(sets + i)) && pass;
+    const char* file = getenv("CODEC_TEST_FILE");
+    if (file) pass = Test::load(file, &fileSet) && Test::run(&fileSet, TEST_RECORDS * 3) && pass;
+    return pass ? 0 : 1;
+}
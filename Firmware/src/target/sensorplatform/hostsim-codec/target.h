@@ -0,0 +1,25 @@
+#pragma once
+
+// SensorPlatform Measurement Data Compression Host Test
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Tunables (test data):
+// Number of records to generate per synthetic data set
+#define TEST_RECORDS 2000000
+// Seed of the synthetic data generator
+#define TEST_SEED 0x5eed1234
+
+#include "cpu/host/target.h"
@@ -0,0 +1,3 @@
+NAME := hostsim-codec
+$(TARGET): build/$(TARGET)/$(TYPE)/$(NAME).elf
+LISTINGS: build/$(TARGET)/$(TYPE)/$(NAME).elf.lst
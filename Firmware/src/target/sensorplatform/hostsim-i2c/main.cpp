@@ -0,0 +1,305 @@
+// SensorPlatform Asynchronous I2C Capture Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Simulates the sensor task's measurement loop on a virtual usec clock, using the sensor node's
+// TaskQueue and RecordQueue. Accelerometer and gyroscope are sampled via SPI at a fixed rate while
+// the barometer, hygrometer and light sensor are read via I2C, either blocking (the capture task
+// waits for the bus) or asynchronously (the capture task queues the transactions and the I2C IRQ
+// handler processes them in the background). Reports how late the IMU samples are taken, relative
+// to their schedule, and checks that records end up in the measurement data stream in schedule order.
+
+
+#include "global.h"
+#include "app/main.h"
+#include "sys/time.h"
+#include "sys/util.h"
+#include "../multisensor/taskqueue.h"
+#include "../multisensor/recordqueue.h"
+#include <stdio.h>
+
+
+namespace Sim
+{
+    // A simulated sensor
+    struct SimSensor
+    {
+        const char* name;
+        bool i2c;  // Whether the sensor is read via I2C (otherwise SPI)
+        int interval;  // Sampling interval in usec
+        uint8_t txnBytes[3];  // Bytes (including addresses) transferred by each I2C transaction of a capture
+        SensorTask::ScheduledTask task;
+
+        SimSensor(const char* name, bool i2c, int interval, uint8_t a, uint8_t b, uint8_t c)
+            : name(name), i2c(i2c), interval(interval), txnBytes{a, b, c}, task(NULL, this) {}
+    };
+
+    // An I2C transaction that was queued on the simulated bus
+    struct Txn
+    {
+        int start;  // usec time at which the bus starts processing it
+        int end;  // usec time at which it completes (STOP condition)
+        int bytes;  // Number of bytes (each one causes an IRQ)
+        SensorTask::Record* record;  // Record to be completed by the callback (NULL if there is no callback)
+    };
+
+    static SimSensor sensors[] =
+    {
+        // IMU accelerometer and gyroscope (SPI)
+        SimSensor("accel", false, 0, 0, 0, 0),
+        SimSensor("gyro", false, 0, 0, 0, 0),
+        // BMP280: Read 6 measurement registers
+        SimSensor("baro", true, 10000, 2 + 7, 0, 0),
+        // SI7021: Collect result, read temperature register, send next command
+        SimSensor("hygro", true, 50000, 3, 2 + 3, 2),
+        // APDS-9960: Read 6 data registers
+        SimSensor("light", true, 20000, 2 + 7, 0, 0),
+    };
+    static const int IMU_SENSORS = 2;
+
+    static SensorTask::TaskQueue taskQueue;
+    static SensorTask::RecordQueue records;
+    static Txn txns[64];  // Ring buffer of I2C transactions that haven't completed or were recently active
+    static int txnFirst;  // Oldest transaction in txns that might still cause IRQs
+    static int txnDone;  // Oldest transaction in txns whose completion hasn't been processed yet
+    static int txnCount;  // Total number of transactions queued so far
+    static int busFree;  // usec time at which the simulated bus becomes idle
+    static int cpuFree;  // usec time at which the sensor task becomes idle
+    static uint32_t runSeq;  // Number of executed ScheduledTasks
+    static uint32_t flushSeq;  // Number of records written to the simulated measurement data stream
+    static bool orderOK;  // Whether all records were written in the order in which their tasks ran
+    static int maxQueued;  // Maximum number of records in the RecordQueue
+    static int queued;  // Current number of records in the RecordQueue
+
+    // IMU sampling lateness statistics
+    static uint32_t lateHist[1024];  // Histogram of lateness (usec, last bucket collects everything above)
+    static uint64_t lateCount;
+    static uint64_t lateSum;
+    static int lateMax;
+
+
+    // Duration of an I2C transaction on the bus in usec (9 clocks per byte, plus START/STOP)
+    static int busTime(int bytes)
+    {
+        return ((bytes * 9 + 3) * 1000 + SIM_I2C_KHZ - 1) / SIM_I2C_KHZ;
+    }
+
+
+    // Number of I2C byte IRQs that fire within [from, to)
+    static int irqsIn(int from, int to)
+    {
+        int count = 0;
+        for (int i = txnFirst; i < txnCount; i++)
+        {
+            Txn* txn = txns + i % ARRAYLEN(txns);
+            for (int b = 1; b <= txn->bytes; b++)
+            {
+                int at = txn->start + (txn->end - txn->start) * b / txn->bytes;
+                if (!TIME_BEFORE(at, from) && TIME_BEFORE(at, to)) count++;
+            }
+        }
+        return count;
+    }
+
+
+    // Let the sensor task execute for the given amount of CPU time starting at cpuFree,
+    // including any time that the I2C IRQ handler steals from it meanwhile.
+    static void execute(int usec)
+    {
+        int start = cpuFree;
+        cpuFree += usec;
+        int irqs = irqsIn(start, cpuFree);
+        while (irqs)
+        {
+            int from = cpuFree;
+            cpuFree += irqs * SIM_I2C_IRQ_USEC;
+            irqs = irqsIn(from, cpuFree);
+        }
+        // Forget transactions that can't cause any IRQs anymore
+        while (txnFirst < txnDone && !TIME_AFTER(txns[txnFirst % ARRAYLEN(txns)].end, start)) txnFirst++;
+    }
+
+
+    // Write all ready records to the simulated measurement data stream
+    static void flushRecords()
+    {
+        while (SensorTask::Record* record = records.peek())
+        {
+            uint32_t seq = record->data[0] | (record->data[1] << 16);
+            if (seq != flushSeq++) orderOK = false;
+            records.drop();
+            queued--;
+        }
+    }
+
+
+    // Run the callbacks of all I2C transactions that have completed by cpuFree
+    static void processCompletions()
+    {
+        while (txnDone < txnCount && !TIME_AFTER(txns[txnDone % ARRAYLEN(txns)].end, cpuFree))
+        {
+            Txn* txn = txns + txnDone++ % ARRAYLEN(txns);
+            if (!txn->record) continue;
+            execute(SIM_CALLBACK_USEC);
+            txn->record->ready = true;
+        }
+        flushRecords();
+    }
+
+
+    // Queue an I2C transaction on the simulated bus, returns its completion time
+    static int submit(int bytes, SensorTask::Record* record)
+    {
+        execute(SIM_I2C_SUBMIT_USEC);
+        if (txnCount - txnFirst >= (int)ARRAYLEN(txns))
+        {
+            printf("transaction ring overflow\n");
+            return busFree;
+        }
+        Txn* txn = txns + txnCount++ % ARRAYLEN(txns);
+        txn->start = TIME_AFTER(busFree, cpuFree) ? busFree : cpuFree;
+        txn->end = txn->start + busTime(bytes);
+        txn->bytes = bytes;
+        txn->record = record;
+        busFree = txn->end;
+        return txn->end;
+    }
+
+
+    // Capture a sample of a simulated sensor into a record
+    static void capture(SimSensor* sensor, SensorTask::Record* record, bool async)
+    {
+        if (!sensor->i2c)
+        {
+            // Record when the sample was actually taken, relative to its schedule
+            int late = cpuFree - sensor->task.time;
+            lateHist[MIN(late, (int)ARRAYLEN(lateHist) - 1)]++;
+            lateCount++;
+            lateSum += late;
+            lateMax = MAX(lateMax, late);
+            execute(SIM_IMU_CAPTURE_USEC);
+            record->ready = true;
+            return;
+        }
+        int count = 0;
+        while (count < (int)ARRAYLEN(sensor->txnBytes) && sensor->txnBytes[count]) count++;
+        for (int i = 0; i < count; i++)
+        {
+            // The last transaction's callback completes an asynchronous capture's record
+            int end = submit(sensor->txnBytes[i], async && i == count - 1 ? record : NULL);
+            // Blocking captures wait for each transaction to complete (byte IRQs are handled meanwhile)
+            if (!async)
+            {
+                cpuFree = end;
+                txnDone = txnCount;
+            }
+        }
+        if (!async) record->ready = true;
+    }
+
+
+    // Run the measurement loop with the given sensors for SIM_DURATION usec
+    static void run(int sensorCount, int imuInterval, bool async)
+    {
+        taskQueue.clear();
+        records.clear();
+        txnFirst = txnDone = txnCount = 0;
+        busFree = cpuFree = 0;
+        runSeq = flushSeq = 0;
+        orderOK = true;
+        maxQueued = queued = 0;
+        memset(lateHist, 0, sizeof(lateHist));
+        lateCount = 0;
+        lateSum = 0;
+        lateMax = 0;
+        for (int i = 0; i < sensorCount; i++)
+        {
+            if (i < IMU_SENSORS) sensors[i].interval = imuInterval;
+            sensors[i].task.time = 0;
+            taskQueue.insert(&sensors[i].task);
+        }
+        while (TIME_BEFORE(taskQueue.peek()->time, SIM_DURATION))
+        {
+            SensorTask::ScheduledTask* task = taskQueue.pop();
+            SimSensor* sensor = (SimSensor*)task->arg;
+            // sleepUntil()
+            if (TIME_AFTER(task->time, cpuFree)) cpuFree = task->time;
+            execute(SIM_TASK_USEC);
+            // Reserve a record, wait for completions if the queue is full
+            processCompletions();
+            SensorTask::Record* record;
+            while (!(record = records.open((Sensor*)sensor)))
+            {
+                cpuFree = txns[txnDone % ARRAYLEN(txns)].end;
+                processCompletions();
+            }
+            queued++;
+            maxQueued = MAX(maxQueued, queued);
+            record->write(runSeq & 0xffff);
+            record->write(runSeq >> 16);
+            runSeq++;
+            capture(sensor, record, async);
+            flushRecords();
+            task->time += sensor->interval;
+            taskQueue.insert(task);
+        }
+        // Wait for the remaining captures to complete
+        while (!records.empty())
+        {
+            cpuFree = txns[txnDone % ARRAYLEN(txns)].end;
+            processCompletions();
+        }
+        if (flushSeq != runSeq) orderOK = false;
+    }
+
+
+    // Lateness below which the given fraction of IMU samples were taken
+    static int percentile(double fraction)
+    {
+        uint64_t limit = lateCount * fraction;
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < ARRAYLEN(lateHist); i++)
+            if ((sum += lateHist[i]) >= limit)
+                return i;
+        return ARRAYLEN(lateHist) - 1;
+    }
+
+
+    // Run a scenario and print its IMU sampling lateness statistics, returns whether the record order was correct
+    static bool scenario(const char* name, int sensorCount, int imuInterval, bool async)
+    {
+        run(sensorCount, imuInterval, async);
+        printf("%-14s %6.1f %5d %5d %5d %5d %6d  %s\n", name, (double)lateSum / lateCount, percentile(0.5),
+               percentile(0.9), percentile(0.99), lateMax, maxQueued, orderOK ? "PASS" : "FAIL");
+        return orderOK;
+    }
+}
+
+
+int main()
+{
+    printf("%d sec simulated, I2C at %d kHz, IMU sample lateness in usec\n", SIM_DURATION / 1000000, SIM_I2C_KHZ);
+    bool pass = true;
+    static const int imuIntervals[] = { 1000, 500, 250 };
+    for (uint32_t i = 0; i < ARRAYLEN(imuIntervals); i++)
+    {
+        printf("\nIMU interval %d usec\n", imuIntervals[i]);
+        printf("scenario         mean   p50   p90   p99   max  queue  order\n");
+        pass = Sim::scenario("IMU only", Sim::IMU_SENSORS, imuIntervals[i], false) && pass;
+        pass = Sim::scenario("blocking I2C", ARRAYLEN(Sim::sensors), imuIntervals[i], false) && pass;
+        pass = Sim::scenario("async I2C", ARRAYLEN(Sim::sensors), imuIntervals[i], true) && pass;
+    }
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// SensorPlatform Asynchronous I2C Capture Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Tunables (sensor node, same meaning as in multisensor/target.h):
+#define SENSOR_RECORD_QUEUE_SIZE 12
+
+// Tunables (simulation):
+// Simulated measurement length in usec
+#define SIM_DURATION 20000000
+// I2C bus clock in kHz
+#define SIM_I2C_KHZ 400
+// Sensor task CPU time per ScheduledTask execution (queue handling, rescheduling) in usec
+#define SIM_TASK_USEC 4
+// CPU time of an IMU register readout via SPI in usec
+#define SIM_IMU_CAPTURE_USEC 12
+// CPU time to set up and queue an I2C transaction in usec
+#define SIM_I2C_SUBMIT_USEC 3
+// CPU time of the I2C IRQ handler per transferred byte in usec
+#define SIM_I2C_IRQ_USEC 2
+// CPU time of an asynchronous capture completion callback in usec
+#define SIM_CALLBACK_USEC 3
+
+#include "cpu/host/target.h"
@@ -0,0 +1,3 @@
+NAME := hostsim-i2c
+$(TARGET): build/$(TARGET)/$(TYPE)/$(NAME).elf
+LISTINGS: build/$(TARGET)/$(TYPE)/$(NAME).elf.lst
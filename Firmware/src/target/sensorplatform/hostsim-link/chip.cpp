@@ -0,0 +1,508 @@
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "chip.h"
+#include "device.h"
+#include "sys/util.h"
+#include <stdint.h>
+
+
+// Register numbers and bits (see nRF24L01+ datasheet)
+#define REG_CONFIG 0x00
+#define REG_EN_RXADDR 0x02
+#define REG_SETUP_AW 0x03
+#define REG_RF_CH 0x05
+#define REG_RF_SETUP 0x06
+#define REG_STATUS 0x07
+#define REG_RX_ADDR_P0 0x0a
+#define REG_RX_ADDR_P1 0x0b
+#define REG_RX_ADDR_P2 0x0c
+#define REG_TX_ADDR 0x10
+#define REG_RX_PW_P0 0x11
+#define REG_FIFO_STATUS 0x17
+#define CONFIG_PRIM_RX 0x01
+#define CONFIG_PWR_UP 0x02
+#define STATUS_MAX_RT 0x10
+#define STATUS_TX_DS 0x20
+#define STATUS_RX_DR 0x40
+#define RF_DR_HIGH 0x08
+#define RF_DR_LOW 0x20
+
+// Timing (see nRF24L01+ datasheet)
+#define POWER_UP_NSEC 1500000
+#define SETTLE_NSEC 130000
+
+
+namespace Sim
+{
+    enum EventKind
+    {
+        Event_PowerUpDone = 0,
+        Event_TxSettleDone,
+        Event_RxSettleDone,
+        Event_AddressLatch,
+        Event_TxEnd,
+    };
+
+    int Chip::lossPermille;
+
+    // All radio chips that can hear each other
+    static Chip* chips[128];
+    static int chipCount;
+
+
+    void Chip::resetAir()
+    {
+        chipCount = 0;
+    }
+
+
+    void Chip::init(Device* device)
+    {
+        memset(this, 0, sizeof(*this));
+        this->device = device;
+        // Reset values
+        reg[REG_CONFIG] = 0x08;
+        reg[0x01] = 0x3f;
+        reg[REG_EN_RXADDR] = 0x03;
+        reg[REG_SETUP_AW] = 0x03;
+        reg[0x04] = 0x03;
+        reg[REG_RF_CH] = 0x02;
+        reg[REG_RF_SETUP] = 0x0e;
+        reg[REG_RX_ADDR_P2] = 0xc3;
+        reg[REG_RX_ADDR_P2 + 1] = 0xc4;
+        reg[REG_RX_ADDR_P2 + 2] = 0xc5;
+        reg[REG_RX_ADDR_P2 + 3] = 0xc6;
+        memset(pipeAddress[0], 0xe7, sizeof(pipeAddress[0]));
+        memset(pipeAddress[1], 0xc2, sizeof(pipeAddress[1]));
+        memset(txAddress, 0xe7, sizeof(txAddress));
+        state = State_PowerDown;
+        listen.until = prevListen.until = -1;
+        if (chipCount >= (int)ARRAYLEN(chips)) hang();
+        chips[chipCount++] = this;
+    }
+
+
+    // Duration of one bit on the air at the current data rate
+    Time Chip::getBitTime() const
+    {
+        if (reg[REG_RF_SETUP] & RF_DR_LOW) return 4000;
+        if (reg[REG_RF_SETUP] & RF_DR_HIGH) return 500;
+        return 1000;
+    }
+
+
+    void Chip::event(void* obj, uint32_t arg)
+    {
+        Chip* chip = (Chip*)obj;
+        if ((arg >> 4) != (chip->gen & 0xfffffff)) return;  // Stale, the state changed meanwhile
+        switch (arg & 0xf)
+        {
+        case Event_PowerUpDone:
+            chip->setState(State_Standby);
+            chip->evaluate(now);
+            break;
+
+        case Event_TxSettleDone:
+            chip->startTx(now);
+            break;
+
+        case Event_RxSettleDone:
+            chip->setState(State_Rx);
+            chip->startListening(now);
+            break;
+
+        case Event_AddressLatch:
+            chip->latchAddress();
+            break;
+
+        case Event_TxEnd:
+            chip->endTx(now);
+            break;
+        }
+    }
+
+
+    void Chip::scheduleEvent(Time at, int kind)
+    {
+        schedule(at < now ? now : at, event, this, ((gen & 0xfffffff) << 4) | kind);
+    }
+
+
+    void Chip::setState(State newState)
+    {
+        state = newState;
+        gen++;
+    }
+
+
+    uint8_t Chip::getStatus() const
+    {
+        return (reg[REG_STATUS] & (STATUS_RX_DR | STATUS_TX_DS | STATUS_MAX_RT))
+             | ((rxCount ? rxFifoPipe[0] : 7) << 1) | (txCount >= ARRAYLEN(txFifo));
+    }
+
+
+    // The IRQ line is active (low) if any unmasked IRQ flag is set
+    void Chip::updateIRQ()
+    {
+        bool low = reg[REG_STATUS] & ~reg[REG_CONFIG] & (STATUS_RX_DR | STATUS_TX_DS | STATUS_MAX_RT);
+        bool falling = low && !irqLow;
+        irqLow = low;
+        if (falling) device->radioIRQ();
+    }
+
+
+    uint8_t Chip::readRegister(uint8_t addr, int index) const
+    {
+        switch (addr)
+        {
+        case REG_RX_ADDR_P0:
+        case REG_RX_ADDR_P1:
+            return index < 5 ? pipeAddress[addr - REG_RX_ADDR_P0][index] : 0;
+        case REG_TX_ADDR:
+            return index < 5 ? txAddress[index] : 0;
+        case REG_STATUS:
+            return index ? 0 : getStatus();
+        case REG_FIFO_STATUS:
+            return index ? 0 : (!rxCount) | ((rxCount >= ARRAYLEN(rxFifo)) << 1)
+                             | ((!txCount) << 4) | ((txCount >= ARRAYLEN(txFifo)) << 5);
+        default:
+            return index ? 0 : reg[addr];
+        }
+    }
+
+
+    void Chip::writeRegister(uint8_t addr, int index, uint8_t data, Time t)
+    {
+        switch (addr)
+        {
+        case REG_RX_ADDR_P0:
+        case REG_RX_ADDR_P1:
+            if (index < 5) pipeAddress[addr - REG_RX_ADDR_P0][index] = data;
+            return;
+        case REG_TX_ADDR:
+            // If the packet on the air has passed the point where the address is captured,
+            // this write is too late for it, even if the latch event hasn't been processed yet.
+            if (state == State_Tx && !air.latched && t >= air.latchAt) latchAddress();
+            if (index < 5) txAddress[index] = data;
+            return;
+        }
+        if (index) return;
+        switch (addr)
+        {
+        case REG_CONFIG:
+        {
+            uint8_t old = reg[REG_CONFIG];
+            reg[REG_CONFIG] = data & 0x7f;
+            if (!(old & CONFIG_PWR_UP) && (data & CONFIG_PWR_UP))
+            {
+                setState(State_PowerUp);
+                scheduleEvent(t + POWER_UP_NSEC, Event_PowerUpDone);
+            }
+            else if ((old & CONFIG_PWR_UP) && !(data & CONFIG_PWR_UP))
+            {
+                // Power down aborts whatever the chip was doing, including a transmission
+                if (state == State_Rx) stopListening(t);
+                if (air.active) air.collided = true;
+                setState(State_PowerDown);
+            }
+            else if ((old ^ data) & CONFIG_PRIM_RX)
+            {
+                // Role changes while transmitting take effect after the packet
+                if (state == State_Rx || state == State_RxSettle)
+                {
+                    if (state == State_Rx) stopListening(t);
+                    setState(State_Standby);
+                }
+                evaluate(t);
+            }
+            updateIRQ();
+            break;
+        }
+
+        case REG_STATUS:
+            reg[REG_STATUS] &= ~(data & (STATUS_RX_DR | STATUS_TX_DS | STATUS_MAX_RT));
+            updateIRQ();
+            break;
+
+        case REG_RF_CH:
+        case REG_RF_SETUP:
+            reg[addr] = data & (addr == REG_RF_CH ? 0x7f : 0xff);
+            // Frequency or data rate changes while listening make the PLL lock again
+            if (state == State_Rx || state == State_RxSettle)
+            {
+                if (state == State_Rx) stopListening(t);
+                setState(State_RxSettle);
+                scheduleEvent(t + SETTLE_NSEC, Event_RxSettleDone);
+            }
+            break;
+
+        case REG_FIFO_STATUS:
+            break;
+
+        default:
+            reg[addr] = data;
+        }
+    }
+
+
+    // Start the transition into TX or RX mode if CE is high in standby mode
+    void Chip::evaluate(Time t)
+    {
+        if (state != State_Standby || !ce) return;
+        if (reg[REG_CONFIG] & CONFIG_PRIM_RX)
+        {
+            setState(State_RxSettle);
+            scheduleEvent(t + SETTLE_NSEC, Event_RxSettleDone);
+        }
+        else if (txCount)
+        {
+            setState(State_TxSettle);
+            scheduleEvent(t + SETTLE_NSEC, Event_TxSettleDone);
+        }
+    }
+
+
+    void Chip::startListening(Time t)
+    {
+        listen.since = t;
+        listen.until = INT64_MAX;
+        listen.channel = reg[REG_RF_CH];
+        listen.rate = getRate();
+    }
+
+
+    void Chip::stopListening(Time t)
+    {
+        listen.until = t;
+        prevListen = listen;
+        listen.until = -1;
+    }
+
+
+    // Whether the chip was in RX mode with the right settings during the whole transmission
+    bool Chip::wasListening(const Transmission* tx) const
+    {
+        const Listen* l[] = { &listen, &prevListen };
+        for (uint32_t i = 0; i < ARRAYLEN(l); i++)
+            if (l[i]->since <= tx->start && l[i]->until >= tx->end
+             && l[i]->channel == tx->channel && l[i]->rate == tx->rate)
+                return true;
+        return false;
+    }
+
+
+    // Find the enabled RX pipe that matches an address (pipes 2-5 share the upper bytes with pipe 1)
+    int Chip::matchPipe(const uint8_t* addr) const
+    {
+        int width = (reg[REG_SETUP_AW] & 3) + 2;
+        for (int pipe = 0; pipe < 6; pipe++)
+        {
+            if (!((reg[REG_EN_RXADDR] >> pipe) & 1)) continue;
+            const uint8_t* pipeAddr = pipeAddress[MIN(pipe, 1)];
+            uint8_t first = pipe < 2 ? pipeAddr[0] : reg[REG_RX_ADDR_P0 + pipe];
+            if (addr[0] == first && !memcmp(addr + 1, pipeAddr + 1, width - 1)) return pipe;
+        }
+        return -1;
+    }
+
+
+    void Chip::startTx(Time t)
+    {
+        if (!txCount)
+        {
+            // Flushed while the PLL was settling
+            setState(State_Standby);
+            evaluate(t);
+            return;
+        }
+        setState(State_Tx);
+        Time bitTime = getBitTime();
+        air.active = true;
+        air.latched = false;
+        air.collided = false;
+        air.channel = reg[REG_RF_CH];
+        air.rate = getRate();
+        air.start = t;
+        air.latchAt = t + SIM_TX_ADDRESS_LATCH_BITS * bitTime;
+        // 8 bits preamble, 24 bits address, payload, 16 bits CRC
+        air.end = t + (8 + 8 * ((reg[REG_SETUP_AW] & 3) + 2) + 8 * txFifo[0].len + 16) * bitTime;
+        air.packet = txFifo[0];
+        txHeadOnAir = true;
+        stats.txPackets++;
+        // Anything else on the same channel at the same time destroys both packets
+        for (int i = 0; i < chipCount; i++)
+        {
+            Transmission* other = &chips[i]->air;
+            if (chips[i] == this || !other->active || other->channel != air.channel || other->end <= t) continue;
+            if (outOfRange || chips[i]->outOfRange) continue;
+            other->collided = true;
+            air.collided = true;
+        }
+        scheduleEvent(air.latchAt, Event_AddressLatch);
+        scheduleEvent(air.end, Event_TxEnd);
+    }
+
+
+    void Chip::latchAddress()
+    {
+        if (air.latched) return;
+        memcpy(air.addr, txAddress, sizeof(air.addr));
+        air.latched = true;
+    }
+
+
+    void Chip::endTx(Time t)
+    {
+        latchAddress();
+        deliver(&air);
+        air.active = false;
+        if (txHeadOnAir)
+        {
+            memmove(txFifo, txFifo + 1, sizeof(*txFifo) * (ARRAYLEN(txFifo) - 1));
+            txCount--;
+            txHeadOnAir = false;
+        }
+        reg[REG_STATUS] |= STATUS_TX_DS;
+        setState(State_Standby);
+        // With CE held high, the next packet follows without PLL relocking
+        if (ce && !(reg[REG_CONFIG] & CONFIG_PRIM_RX) && txCount) startTx(t);
+        else evaluate(t);
+        updateIRQ();
+    }
+
+
+    void Chip::deliver(const Transmission* tx)
+    {
+        for (int i = 0; i < chipCount; i++)
+        {
+            Chip* chip = chips[i];
+            if (chip == this || !chip->wasListening(tx)) continue;
+            int pipe = chip->matchPipe(tx->addr);
+            if (pipe < 0 || chip->reg[REG_RX_PW_P0 + pipe] != tx->packet.len) continue;
+            if (tx->collided)
+            {
+                chip->stats.rxCollided++;
+                continue;
+            }
+            if (outOfRange || chip->outOfRange || (int)(random() % 1000) < lossPermille)
+            {
+                chip->stats.rxLost++;
+                continue;
+            }
+            if (chip->rxCount >= ARRAYLEN(chip->rxFifo))
+            {
+                chip->stats.rxOverflow++;
+                continue;
+            }
+            chip->rxFifo[chip->rxCount] = tx->packet;
+            chip->rxFifoPipe[chip->rxCount++] = pipe;
+            chip->stats.rxPackets++;
+            chip->reg[REG_STATUS] |= STATUS_RX_DR;
+            chip->updateIRQ();
+        }
+    }
+
+
+    void Chip::setCE(bool level, Time t)
+    {
+        if (level == ce) return;
+        ce = level;
+        if (level) evaluate(t);
+        else if (state == State_Rx || state == State_RxSettle)
+        {
+            if (state == State_Rx) stopListening(t);
+            setState(State_Standby);
+        }
+        // A transmission that was started already will be completed
+    }
+
+
+    void Chip::select(Time t)
+    {
+        selected = true;
+        xferIndex = 0;
+    }
+
+
+    uint8_t Chip::transfer(uint8_t mosi, Time t)
+    {
+        if (!selected) return 0xff;
+        int index = xferIndex++;
+        if (!index)
+        {
+            cmd = mosi;
+            xferPacket.len = 0;
+            return getStatus();
+        }
+        index--;
+        if ((cmd & 0xe0) == 0x00) return readRegister(cmd & 0x1f, index);
+        if ((cmd & 0xe0) == 0x20)
+        {
+            writeRegister(cmd & 0x1f, index, mosi, t);
+            return 0;
+        }
+        switch (cmd)
+        {
+        case 0x61:  // R_RX_PAYLOAD
+            return rxCount && index < (int)sizeof(rxFifo[0].data) ? rxFifo[0].data[index] : 0;
+        case 0xa0:  // W_TX_PAYLOAD
+            if (index < (int)sizeof(xferPacket.data)) xferPacket.data[xferPacket.len++] = mosi;
+            return 0;
+        }
+        return 0;
+    }
+
+
+    // Commands that operate on the FIFOs are executed when the chip is deselected
+    void Chip::deselect(Time t)
+    {
+        if (!selected) return;
+        selected = false;
+        if (!xferIndex) return;
+        switch (cmd)
+        {
+        case 0x61:  // R_RX_PAYLOAD
+            if (xferIndex > 1 && rxCount)
+            {
+                memmove(rxFifo, rxFifo + 1, sizeof(*rxFifo) * (ARRAYLEN(rxFifo) - 1));
+                memmove(rxFifoPipe, rxFifoPipe + 1, sizeof(*rxFifoPipe) * (ARRAYLEN(rxFifoPipe) - 1));
+                rxCount--;
+            }
+            break;
+
+        case 0xa0:  // W_TX_PAYLOAD
+            if (xferPacket.len && txCount < ARRAYLEN(txFifo))
+            {
+                txFifo[txCount++] = xferPacket;
+                evaluate(t);
+            }
+            break;
+
+        case 0xe1:  // FLUSH_TX (a packet that is on the air already will still be completed)
+            txCount = 0;
+            txHeadOnAir = false;
+            break;
+
+        case 0xe2:  // FLUSH_RX
+            rxCount = 0;
+            break;
+        }
+    }
+}
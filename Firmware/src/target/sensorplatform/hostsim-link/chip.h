@@ -0,0 +1,141 @@
+#pragma once
+
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "sim.h"
+
+
+namespace Sim
+{
+    class Device;
+
+    // Model of an nRF24L01+ radio chip as used by the firmware: Registers, 3-level RX/TX FIFOs, the SPI command
+    // set, CE/PWR_UP/PRIM_RX state machine with PLL settling and power up delays, and the IRQ line.
+    // Enhanced ShockBurst (auto ACK, dynamic payload length) isn't modeled, the firmware doesn't use it.
+    class Chip
+    {
+    public:
+        enum State
+        {
+            State_PowerDown = 0,
+            State_PowerUp,  // Crystal oscillator starting up, will enter standby mode
+            State_Standby,  // Standby-I (CE low) or Standby-II (CE high, PTX, TX FIFO empty)
+            State_TxSettle,  // PLL locking for transmission
+            State_Tx,  // Transmitting a packet
+            State_RxSettle,  // PLL locking for reception
+            State_Rx,  // Listening
+        };
+
+        struct Packet
+        {
+            uint8_t len;
+            uint8_t data[32];
+        };
+
+        // A packet on the air
+        struct Transmission
+        {
+            bool active;  // Whether the packet is currently being transmitted
+            bool latched;  // Whether the TX address was captured already
+            bool collided;  // Whether another packet overlapped it on the same channel
+            uint8_t channel;
+            uint8_t rate;  // Data rate bits of RF_SETUP
+            uint8_t addr[5];
+            Time start;
+            Time latchAt;  // Time at which the TX address is captured
+            Time end;
+            Packet packet;
+        };
+
+        // Reception statistics (for packets that this chip was listening for)
+        struct Stats
+        {
+            uint32_t txPackets;  // Packets transmitted
+            uint32_t rxPackets;  // Packets received and put into the RX FIFO
+            uint32_t rxLost;  // Packets lost due to simulated channel loss
+            uint32_t rxCollided;  // Packets destroyed by another transmission on the same channel
+            uint32_t rxOverflow;  // Packets dropped because the RX FIFO was full
+        } stats;
+
+        void init(Device* device);
+        void select(Time t);
+        void deselect(Time t);
+        uint8_t transfer(uint8_t mosi, Time t);
+        void setCE(bool level, Time t);
+        bool getIRQLevel() const { return !irqLow; }
+        State getState() const { return state; }
+
+        // Probability of losing a packet on its way to each receiver (in 1/1000)
+        static int lossPermille;
+        // Whether this chip can't hear any others and isn't heard by them
+        bool outOfRange;
+        // Forget about all radio chips (for starting a new scenario)
+        static void resetAir();
+
+    private:
+        Device* device;  // The MCU that this chip is connected to
+        State state;
+        uint32_t gen;  // Incremented on every state change, invalidates scheduled state machine events
+        uint8_t reg[0x20];  // Single byte registers
+        uint8_t pipeAddress[2][5];  // RX_ADDR_P0 and RX_ADDR_P1
+        uint8_t txAddress[5];
+        Packet txFifo[3];
+        uint8_t txCount;
+        bool txHeadOnAir;  // Whether txFifo[0] is being transmitted (and will be removed afterwards)
+        Packet rxFifo[3];
+        uint8_t rxFifoPipe[3];
+        uint8_t rxCount;
+        bool ce;
+        bool irqLow;
+        // SPI transaction state
+        bool selected;
+        int xferIndex;
+        uint8_t cmd;
+        Packet xferPacket;
+        // Listening periods: The current one (if in RX mode) and the one before, in case that
+        // the firmware changed settings at a time in the near future relative to the air events.
+        struct Listen
+        {
+            Time since;
+            Time until;
+            uint8_t channel;
+            uint8_t rate;
+        } listen, prevListen;
+        Transmission air;
+
+        static void event(void* obj, uint32_t arg);
+        void scheduleEvent(Time at, int kind);
+        void setState(State newState);
+        uint8_t getStatus() const;
+        uint8_t getRate() const { return reg[6] & 0x28; }
+        Time getBitTime() const;
+        uint8_t readRegister(uint8_t addr, int index) const;
+        void writeRegister(uint8_t addr, int index, uint8_t data, Time t);
+        void updateIRQ();
+        void evaluate(Time t);
+        void startListening(Time t);
+        void stopListening(Time t);
+        bool wasListening(const Transmission* tx) const;
+        int matchPipe(const uint8_t* addr) const;
+        void startTx(Time t);
+        void endTx(Time t);
+        void latchAddress();
+        void deliver(const Transmission* tx);
+    };
+}
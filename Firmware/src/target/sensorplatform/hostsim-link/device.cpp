@@ -0,0 +1,523 @@
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "device.h"
+#include "node.h"
+#include "sys/util.h"
+#include "sys/time.h"
+#include "interface/irq/irq.h"
+#include "interface/gpio/gpio.h"
+#include "../common/driver/timer.h"
+#include "../multisensor/driver/spi.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+namespace Sim
+{
+    Device* Device::current;
+
+    // Simulation side variables of Node. They can't be defined in node.cpp, its variables are swapped per node.
+    uint32_t Node::latency[LATENCY_BUCKETS];
+    Node* Node::selected;
+    uint8_t* Node::initialState;
+
+
+    void Device::init(const Config* config)
+    {
+        this->config = config;
+        clockPPB = config->clockPPB;
+        baseGlobal = now;
+        baseLocal = 0;
+        running = false;
+        serviceScheduled = false;
+        busyUntil = now;
+        cursor = now;
+        memset(irqEnabled, 0, sizeof(irqEnabled));
+        spiByteNsec = 1000;
+        spiShiftEnd = now;
+        misoRead = 0;
+        misoWrite = 0;
+        memset(dma, 0, sizeof(dma));
+        dmaGen = 0;
+        memset(pinLevel, 0, sizeof(pinLevel));
+        pinLevel[config->ncsPin] = true;
+        extiEnabled = false;
+        extiPending = false;
+        timerRunning = false;
+        timerPending = false;
+        timerGen = 0;
+        chip.init(this);
+    }
+
+
+    int64_t Device::getLocalTime(Time t) const
+    {
+        int64_t dt = t - baseGlobal;
+        return baseLocal + dt + dt * clockPPB / 1000000000;
+    }
+
+
+    // Find the first global time at which the local clock reaches the given value
+    Time Device::getGlobalTime(int64_t local) const
+    {
+        Time t = baseGlobal + (__int128)(local - baseLocal) * 1000000000 / (1000000000 + clockPPB);
+        while (getLocalTime(t) < local) t++;
+        while (getLocalTime(t - 1) >= local) t--;
+        return t;
+    }
+
+
+    void Device::setClockError(int64_t ppb)
+    {
+        Time t = at();
+        baseLocal = getLocalTime(t);
+        baseGlobal = t;
+        clockPPB = ppb;
+        // Timer periods are measured in local clock cycles, so the next tick moves
+        scheduleTimer();
+    }
+
+
+    uint32_t Device::readUsecTimer() const
+    {
+        return getLocalTime(at()) / 1000 + config->usecOffset;
+    }
+
+
+    void Device::service()
+    {
+        serviceScheduled = false;
+        if (now < busyUntil)
+        {
+            requestService();
+            return;
+        }
+        select();
+        current = this;
+        running = true;
+        cursor = now;
+        for (int guard = 0; ; guard++)
+        {
+            if (guard > 100000)
+            {
+                printf("%s: IRQ storm at %lld ns\n", config->name, (long long)now);
+                abort();
+            }
+            // Pending IRQs are taken in the order of their vector numbers (they have the same priority)
+            if (extiPending && irqEnabled[config->extiIrq])
+            {
+                cursor += config->irqNsec;
+                handleRadioIRQ();
+                continue;
+            }
+            bool dmaIRQ = false;
+            for (int i = 0; i < (int)ARRAYLEN(dma); i++)
+            {
+                int irq = i == Stream_RX ? config->dmaRxIrq : config->dmaTxIrq;
+                if (!dma[i].pending || !irqEnabled[irq]) continue;
+                cursor += config->irqNsec;
+                handleDMAIRQ((Stream)i);
+                dmaIRQ = true;
+                break;
+            }
+            if (dmaIRQ) continue;
+            if (timerRunning && timerPending && irqEnabled[config->timerIrq])
+            {
+                cursor += config->irqNsec;
+                handleTimerIRQ();
+                continue;
+            }
+            if (!runDPC()) break;
+        }
+        busyUntil = cursor;
+        running = false;
+        current = NULL;
+    }
+
+
+    void Device::serviceEvent(void* obj, uint32_t arg)
+    {
+        ((Device*)obj)->service();
+    }
+
+
+    void Device::requestService()
+    {
+        if (running || serviceScheduled) return;
+        serviceScheduled = true;
+        schedule(after(busyUntil), serviceEvent, this, 0);
+    }
+
+
+    void Device::spiSetPrescaler(uint8_t prescaler)
+    {
+        spiByteNsec = (int64_t)8 * (2 << prescaler) * 1000000000 / config->apbHz;
+    }
+
+
+    // Hand a byte to the SPI bus. It will be shifted out after the previous one, which might take a while
+    // if the transmit buffer is full. The byte that is shifted in at the same time can be pulled later.
+    void Device::spiPush(uint8_t data)
+    {
+        cursor = MAX(cursor, spiShiftEnd - spiByteNsec);
+        spiShiftEnd = MAX(cursor, spiShiftEnd) + spiByteNsec;
+        miso[misoWrite & 7] = chip.transfer(data, spiShiftEnd);
+        misoTime[misoWrite++ & 7] = spiShiftEnd;
+    }
+
+
+    uint8_t Device::spiPull()
+    {
+        if (misoRead == misoWrite)
+        {
+            printf("%s: Waiting for an SPI byte that will never arrive\n", config->name);
+            abort();
+        }
+        cursor = MAX(cursor, misoTime[misoRead & 7]);
+        return miso[misoRead++ & 7];
+    }
+
+
+    void Device::spiWaitDone()
+    {
+        cursor = MAX(cursor, spiShiftEnd);
+        misoRead = misoWrite;
+    }
+
+
+    void Device::setPin(uint8_t pin, bool level)
+    {
+        if (pinLevel[pin] == level) return;
+        pinLevel[pin] = level;
+        if (pin == config->ncsPin)
+        {
+            if (level) chip.deselect(at());
+            else chip.select(at());
+        }
+        else if (pin == config->cePin) chip.setCE(level, at());
+    }
+
+
+    bool Device::getPin(uint8_t pin) const
+    {
+        if (pin == config->nirqPin) return chip.getIRQLevel();
+        // The radio chip is only deselected by firmware code running after the DMA transfer, so waiting for that
+        // would never end. (The real firmware only does this if it has ensured that no transfer is running.)
+        if (pin == config->ncsPin && !pinLevel[pin] && running && (dma[Stream_RX].active || dma[Stream_TX].active))
+        {
+            printf("%s: Waiting for a radio DMA transfer in a loop at %lld ns\n", config->name, (long long)cursor);
+            abort();
+        }
+        return pinLevel[pin];
+    }
+
+
+    void Device::extiConfigure(uint8_t pin, bool irq)
+    {
+        if (pin == config->nirqPin) extiEnabled = irq;
+    }
+
+
+    void Device::extiEnable(uint8_t pin, bool on)
+    {
+        if (pin == config->nirqPin) extiEnabled = on;
+    }
+
+
+    bool Device::extiGetPending(uint8_t pin) const
+    {
+        return pin == config->nirqPin && extiPending;
+    }
+
+
+    void Device::extiClearPending(uint8_t pin)
+    {
+        if (pin == config->nirqPin) extiPending = false;
+    }
+
+
+    void Device::irqEnable(int irq, bool on)
+    {
+        irqEnabled[irq & (ARRAYLEN(irqEnabled) - 1)] = on;
+        if (on) requestService();
+    }
+
+
+    void Device::radioIRQ()
+    {
+        if (!extiEnabled) return;
+        extiPending = true;
+        requestService();
+    }
+
+
+    // Start a DMA stream. The transfer begins once both streams of a transfer were started, which the firmware
+    // always ends with the TX stream, and takes as long as shifting the bytes over the SPI bus.
+    void Device::dmaStart(Stream stream, void* mem, int len, bool memIncr, bool irq)
+    {
+        DMAStream* s = dma + stream;
+        s->active = true;
+        s->pending = false;
+        s->memIncr = memIncr;
+        s->irq = irq;
+        s->mem = (uint8_t*)mem;
+        s->len = len;
+        if (stream != Stream_TX) return;
+        Time end = MAX(cursor, spiShiftEnd) + len * spiByteNsec;
+        schedule(end, dmaEvent, this, ++dmaGen);
+    }
+
+
+    void Device::dmaCancel(Stream stream)
+    {
+        dma[stream].active = false;
+        if (stream == Stream_TX) dmaGen++;
+    }
+
+
+    void Device::dmaClearPending(Stream stream)
+    {
+        dma[stream].active = false;
+        dma[stream].pending = false;
+    }
+
+
+    // DMA transfer completion: Exchange the data with the radio chip (the byte timing doesn't matter,
+    // the chip is selected during the whole transfer) and signal completion to the firmware.
+    void Device::dmaEvent(void* obj, uint32_t arg)
+    {
+        Device* device = (Device*)obj;
+        if (arg != device->dmaGen) return;
+        DMAStream* tx = device->dma + Stream_TX;
+        DMAStream* rx = device->dma + Stream_RX;
+        // The buffers might be firmware variables of a node whose state isn't swapped in
+        device->select();
+        Time t = now - tx->len * device->spiByteNsec;
+        for (int i = 0; i < tx->len; i++)
+        {
+            t += device->spiByteNsec;
+            uint8_t data = device->chip.transfer(tx->mem[tx->memIncr ? i : 0], t);
+            if (rx->active && i < rx->len) rx->mem[rx->memIncr ? i : 0] = data;
+        }
+        device->spiShiftEnd = MAX(device->spiShiftEnd, now);
+        for (int i = 0; i < (int)ARRAYLEN(device->dma); i++)
+        {
+            DMAStream* s = device->dma + i;
+            if (!s->active) continue;
+            s->active = false;
+            if (s->irq) s->pending = true;
+        }
+        device->requestService();
+    }
+
+
+    void Device::timerStart(int prescaler, int period)
+    {
+        timerTickNsec = (int64_t)prescaler * 1000000000 / config->timerHz;
+        timerARR = timerARRPreload = (period - 1) & 0xffff;
+        timerZero = getLocalTime(at());
+        timerRunning = true;
+        // The update event that applies the settings also raises the IRQ
+        timerPending = true;
+        scheduleTimer();
+        requestService();
+    }
+
+
+    void Device::timerStop()
+    {
+        timerRunning = false;
+        timerPending = false;
+        timerGen++;
+    }
+
+
+    void Device::timerUpdatePeriod(int period)
+    {
+        timerARRPreload = (period - 1) & 0xffff;
+    }
+
+
+    // Change the period that is currently running. If the counter has passed it already,
+    // it will count up to 0xffff and wrap around before reaching the new value.
+    void Device::timerSetCurrentPeriod(int period)
+    {
+        timerARR = timerARRPreload = (period - 1) & 0xffff;
+        if (timerRead() > timerARR) timerZero += 0x10000 * timerTickNsec;
+        scheduleTimer();
+    }
+
+
+    void Device::timerReset()
+    {
+        timerZero = getLocalTime(at());
+        timerARR = timerARRPreload;
+        timerPending = false;
+        scheduleTimer();
+    }
+
+
+    void Device::timerAcknowledge()
+    {
+        timerPending = false;
+    }
+
+
+    uint32_t Device::timerRead() const
+    {
+        int64_t ticks = (getLocalTime(at()) - timerZero) / timerTickNsec;
+        return ticks < 0 ? 0 : ticks & 0xffff;
+    }
+
+
+    void Device::scheduleTimer()
+    {
+        if (!timerRunning) return;
+        timerUpdate = timerZero + (timerARR + 1) * timerTickNsec;
+        schedule(after(getGlobalTime(timerUpdate)), timerEvent, this, ++timerGen);
+    }
+
+
+    void Device::timerEvent(void* obj, uint32_t arg)
+    {
+        Device* device = (Device*)obj;
+        if (arg != device->timerGen || !device->timerRunning) return;
+        // Update event: Restart counting from zero with the preloaded period
+        device->timerZero = device->timerUpdate;
+        device->timerARR = device->timerARRPreload;
+        device->timerPending = true;
+        device->scheduleTimer();
+        device->requestService();
+    }
+}
+
+
+// Replacements for the peripheral drivers, operating on the device whose firmware is currently running
+
+extern "C" void time_init()
+{
+}
+
+extern "C" unsigned int read_usec_timer()
+{
+    return Sim::Device::current ? Sim::Device::current->readUsecTimer() : Sim::now / 1000;
+}
+
+void hang()
+{
+    printf("%s: hang() at %lld ns\n", Sim::Device::current ? "firmware" : "simulation", (long long)Sim::now);
+    abort();
+}
+
+extern "C" void irq_enable(int irq, bool on)
+{
+    Sim::Device::current->irqEnable(irq, on);
+}
+
+// The radio IRQs are level triggered by their peripheral's flags, so clearing the NVIC doesn't change anything
+extern "C" void irq_clear_pending(int irq)
+{
+}
+
+namespace SPI
+{
+    void init(volatile STM32_SPI_REG_TYPE* regs)
+    {
+    }
+
+    void setFrequency(volatile STM32_SPI_REG_TYPE* regs, uint8_t prescaler)
+    {
+        Sim::Device::current->spiSetPrescaler(prescaler);
+    }
+
+    void pushByte(volatile STM32_SPI_REG_TYPE* regs, uint8_t byte)
+    {
+        Sim::Device::current->spiPush(byte);
+    }
+
+    uint8_t pullByte(volatile STM32_SPI_REG_TYPE* regs)
+    {
+        return Sim::Device::current->spiPull();
+    }
+
+    uint8_t xferByte(volatile STM32_SPI_REG_TYPE* regs, uint8_t byte)
+    {
+        Sim::Device::current->spiPush(byte);
+        return Sim::Device::current->spiPull();
+    }
+
+    void waitDone(volatile STM32_SPI_REG_TYPE* regs)
+    {
+        Sim::Device::current->spiWaitDone();
+    }
+}
+
+bool GPIO::enableFast(Pin pin, bool on)
+{
+    return true;
+}
+
+bool GPIO::getLevelFast(Pin pin)
+{
+    return Sim::Device::current->getPin(pin.pin);
+}
+
+void GPIO::setLevelFast(Pin pin, bool level)
+{
+    Sim::Device::current->setPin(pin.pin, level);
+}
+
+namespace Timer
+{
+    // Timer prescalers and periods are taken as they are, the clock is the one in the device configuration.
+    void start(volatile STM32_TIM_REG_TYPE* regs, int clkgate, int prescaler, int period)
+    {
+        Sim::Device::current->timerStart(prescaler, period);
+    }
+
+    void stop(volatile STM32_TIM_REG_TYPE* regs, int clkgate)
+    {
+        Sim::Device::current->timerStop();
+    }
+
+    void updatePeriod(volatile STM32_TIM_REG_TYPE* regs, int period)
+    {
+        Sim::Device::current->timerUpdatePeriod(period);
+    }
+
+    void setCurrentPeriod(volatile STM32_TIM_REG_TYPE* regs, int period)
+    {
+        Sim::Device::current->timerSetCurrentPeriod(period);
+    }
+
+    void reset(volatile STM32_TIM_REG_TYPE* regs)
+    {
+        Sim::Device::current->timerReset();
+    }
+
+    uint32_t read(volatile STM32_TIM_REG_TYPE* regs)
+    {
+        return Sim::Device::current->timerRead();
+    }
+
+    void acknowledgeIRQ(volatile STM32_TIM_REG_TYPE* regs)
+    {
+        Sim::Device::current->timerAcknowledge();
+    }
+}
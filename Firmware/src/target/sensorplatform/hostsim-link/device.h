@@ -0,0 +1,163 @@
+#pragma once
+
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "sim.h"
+#include "chip.h"
+
+
+namespace Sim
+{
+    // The parts of a microcontroller that the radio drivers use: Its oscillator, the radio SPI bus with two
+    // DMA streams, the frame timer, the EXTI line of the radio IRQ pin, GPIOs and the NVIC, plus a CPU that
+    // executes IRQ handlers and DPCs. The firmware's peripheral drivers are replaced by functions that
+    // operate on the device whose code is currently executing (Device::current).
+    //
+    // Firmware code runs instantaneously, except for a fixed IRQ entry overhead and waiting for the SPI bus,
+    // which advance a cursor that is used for timestamps. The device is busy until the cursor time, anything
+    // that happens meanwhile is handled afterwards (like pending IRQs on a real CPU).
+    class Device
+    {
+    public:
+        struct Config
+        {
+            const char* name;
+            int64_t clockPPB;  // Oscillator frequency error in parts per billion
+            uint32_t usecOffset;  // Value of read_usec_timer() at local time 0
+            int apbHz;  // Clock of the SPI bus
+            int timerHz;  // Clock of the frame timer
+            int irqNsec;  // IRQ entry overhead
+            uint8_t ncsPin, cePin, nirqPin;  // Radio chip pins (GPIO::Pin numbers)
+            int extiIrq, timerIrq, dmaRxIrq, dmaTxIrq;  // NVIC IRQ numbers
+        };
+
+        enum Stream
+        {
+            Stream_RX = 0,
+            Stream_TX = 1,
+        };
+
+        Chip chip;  // The radio chip that is connected to the SPI bus
+        Time cursor;  // Time of the currently executing code
+
+        static Device* current;  // The device whose code is currently executing
+
+        void init(const Config* config);
+
+        // Local clock
+        int64_t getLocalTime(Time t) const;
+        Time getGlobalTime(int64_t local) const;
+        void setClockError(int64_t ppb);
+        int64_t getClockError() const { return clockPPB; }
+        uint32_t readUsecTimer() const;
+
+        // Peripherals (called by the peripheral driver replacements)
+        void spiSetPrescaler(uint8_t prescaler);
+        void spiPush(uint8_t data);
+        uint8_t spiPull();
+        void spiWaitDone();
+        void setPin(uint8_t pin, bool level);
+        bool getPin(uint8_t pin) const;
+        void extiConfigure(uint8_t pin, bool irq);
+        void extiEnable(uint8_t pin, bool on);
+        bool extiGetPending(uint8_t pin) const;
+        void extiClearPending(uint8_t pin);
+        void irqEnable(int irq, bool on);
+        void dmaStart(Stream stream, void* mem, int len, bool memIncr, bool irq);
+        void dmaCancel(Stream stream);
+        void dmaClearPending(Stream stream);
+        void timerStart(int prescaler, int period);
+        void timerStop();
+        void timerUpdatePeriod(int period);
+        void timerSetCurrentPeriod(int period);
+        void timerReset();
+        void timerAcknowledge();
+        uint32_t timerRead() const;
+
+        // Called by the radio chip when its IRQ line goes low
+        void radioIRQ();
+
+        // Make sure that the firmware code will notice whatever was changed in the device (e.g. a pending DPC)
+        void requestService();
+
+    protected:
+        const Config* config;
+
+        // Swap this device's firmware state in, if the firmware is shared with other devices
+        virtual void select() {}
+        virtual void handleRadioIRQ() = 0;
+        virtual void handleTimerIRQ() = 0;
+        virtual void handleDMAIRQ(Stream stream) = 0;
+        // Run the next pending DPC, returns false if there was none
+        virtual bool runDPC() = 0;
+
+    private:
+        struct DMAStream
+        {
+            bool active;
+            bool pending;
+            bool memIncr;
+            bool irq;
+            uint8_t* mem;
+            int len;
+        };
+
+        // Oscillator: local time = baseLocal + (t - baseGlobal) * (1 + clockPPB / 1e9)
+        int64_t clockPPB;
+        Time baseGlobal;
+        int64_t baseLocal;
+        // CPU
+        bool running;
+        bool serviceScheduled;
+        Time busyUntil;
+        // NVIC enable bits
+        bool irqEnabled[128];
+        // SPI bus
+        int spiByteNsec;
+        Time spiShiftEnd;  // When the last byte handed to the SPI bus will have been transferred
+        uint8_t miso[8];
+        Time misoTime[8];
+        uint8_t misoRead;
+        uint8_t misoWrite;
+        DMAStream dma[2];
+        uint32_t dmaGen;
+        // GPIO
+        bool pinLevel[256];
+        bool extiEnabled;
+        bool extiPending;
+        // Frame timer
+        bool timerRunning;
+        bool timerPending;
+        int64_t timerTickNsec;  // Local nanoseconds per timer tick
+        uint32_t timerARR;
+        uint32_t timerARRPreload;
+        int64_t timerZero;  // Local time at which the counter was zero
+        int64_t timerUpdate;  // Local time of the next update event
+        uint32_t timerGen;
+
+        static void serviceEvent(void* obj, uint32_t arg);
+        static void timerEvent(void* obj, uint32_t arg);
+        static void dmaEvent(void* obj, uint32_t arg);
+        void service();
+        void scheduleTimer();
+        // Time of whatever is accessing the device right now (firmware code or a simulation event)
+        Time at() const { return running ? cursor : now; }
+        Time after(Time t) const { return t < now ? now : t; }
+    };
+}
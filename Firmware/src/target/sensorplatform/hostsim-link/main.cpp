@@ -0,0 +1,233 @@
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Discrete event simulation of the whole radio link: The receiver's and the nodes' radio drivers
+// (receiver/radio.cpp and multisensor/radio.cpp) are compiled from the firmware sources, with some
+// identifiers renamed by the preprocessor so that both fit into one program. They run against a model
+// of the nRF24L01+ and the microcontroller peripherals they use, sharing a simulated air interface.
+// One receiver and up to 100 nodes with drifting oscillators boot, associate, stream measurement
+// data and drain their buffers. Reports association, throughput, page loss and latency per scenario.
+// Deterministic (fixed seeds), so that protocol changes can be compared run by run.
+
+#include "global.h"
+#include "app/main.h"
+#include "sys/util.h"
+#include "sim.h"
+#include "chip.h"
+#include "node.h"
+#include "receiver.h"
+#include "../common/protocol/rfproto.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+
+namespace Sim
+{
+    struct Scenario
+    {
+        const char* name;
+        int nodeCount;
+        int pagesPerSecond;  // Measurement data rate of each node
+        int lossPermille;  // Channel loss
+        int outageUsec;  // Time that every node spends out of range once during the measurement
+    };
+
+    struct Result
+    {
+        int associated;  // Nodes that got a NodeId before the measurement was started
+        uint32_t produced;  // Pages put into the nodes' buffers
+        uint32_t received;  // Distinct pages that arrived at the host
+        uint32_t overflow;  // Pages dropped by the nodes because their buffer was full
+        uint32_t duplicates;
+        uint32_t corrupt;
+        uint32_t collided;  // Packets destroyed by collisions at the receiver
+        uint32_t sofReceived;  // SOF packets received by the nodes
+        uint32_t sofTimingFailed;  // Of those, the ones after which the nodes didn't trust their timing enough to transmit
+        uint32_t rejoinCount;  // Times that nodes received SOF packets again after an outage
+        uint32_t rejoinMsecs;  // Total duration of those outages
+        uint64_t latencySum;
+        uint32_t latencyMax;
+        Time drained;  // Time after stopping the measurement until all nodes were done
+        uint64_t events;
+        uint64_t wallNsec;
+    };
+
+    static Node nodes[RF::MaxNode];
+    static Node* nodeList[RF::MaxNode];
+    static Receiver receiver;
+
+
+    static uint64_t readNsecTimer()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ((uint64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+
+    // Random oscillator error within +/- the given tolerance (in ppm), returned in ppb
+    static int64_t randomClockError(int ppm)
+    {
+        return (int64_t)(random() % (2 * ppm * 1000 + 1)) - ppm * 1000;
+    }
+
+
+    // Move a node out of range (arg = 1) or back into range (arg = 0)
+    static void outageEvent(void* obj, uint32_t arg)
+    {
+        ((Node*)obj)->chip.outOfRange = arg;
+    }
+
+
+    // Find the page latency that the given fraction (in 1/1000) of samples in a histogram doesn't exceed
+    static int percentile(const uint32_t* hist, int permille)
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++) total += hist[i];
+        if (!total) return -1;
+        uint64_t limit = (total * permille + 999) / 1000;
+        uint64_t sum = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++)
+            if ((sum += hist[i]) >= limit)
+                return i;
+        return LATENCY_BUCKETS - 1;
+    }
+
+
+    static void run(const Scenario* scenario, uint64_t seedValue, Result* result)
+    {
+        memset(result, 0, sizeof(*result));
+        memset(Node::latency, 0, sizeof(Node::latency));
+        reset();
+        seed(seedValue);
+        Chip::resetAir();
+        Chip::lossPermille = scenario->lossPermille;
+        uint64_t wallStart = readNsecTimer();
+
+        // Boot everything with random oscillator errors and timer offsets
+        int count = scenario->nodeCount;
+        receiver.init(randomClockError(SIM_RECEIVER_PPM), random(), nodeList, count);
+        for (int i = 0; i < count; i++)
+        {
+            nodeList[i] = nodes + i;
+            int64_t ppb = randomClockError(SIM_NODE_PPM);
+            uint32_t offset = random();
+            nodes[i].init(i, ppb, offset, (random() % SIM_BOOT_WINDOW_USEC) * USEC);
+            // Outages start at random times during the measurement
+            if (!scenario->outageUsec) continue;
+            Time start = (SIM_ASSOC_USEC + random() % (SIM_MEASURE_USEC - scenario->outageUsec)) * USEC;
+            schedule(start, outageEvent, nodes + i, 1);
+            schedule(start + scenario->outageUsec * USEC, outageEvent, nodes + i, 0);
+        }
+
+        runUntil(SIM_ASSOC_USEC * USEC);
+        for (int i = 0; i < count; i++)
+        {
+            if (nodes[i].getNodeId()) result->associated++;
+            nodes[i].startMeasurement(scenario->pagesPerSecond);
+        }
+        runUntil((SIM_ASSOC_USEC + SIM_MEASURE_USEC) * USEC);
+        for (int i = 0; i < count; i++) nodes[i].stopMeasurement();
+
+        // Let the nodes send whatever is left in their buffers
+        Time stop = now;
+        Time end = stop + SIM_DRAIN_USEC * USEC;
+        while (now < end)
+        {
+            runUntil(now + 10 * MSEC);
+            bool busy = false;
+            for (int i = 0; i < count && !busy; i++) busy = nodes[i].hasDataPending();
+            if (!busy) break;
+        }
+        result->drained = now - stop;
+
+        for (int i = 0; i < count; i++)
+        {
+            result->produced += nodes[i].stats.pagesProduced;
+            result->received += nodes[i].stats.pagesReceived;
+            result->overflow += nodes[i].getBufferOverflowLost();
+            RF::TelemetryData telemetry = nodes[i].getTelemetry();
+            result->sofReceived += telemetry.sofReceived;
+            result->sofTimingFailed += telemetry.sofTimingFailed;
+            result->rejoinCount += telemetry.rejoinCount;
+            result->rejoinMsecs += telemetry.rejoinMsecs;
+            result->duplicates += nodes[i].stats.duplicates;
+            result->corrupt += nodes[i].stats.corrupt;
+            result->latencySum += nodes[i].stats.latencySum;
+            result->latencyMax = MAX(result->latencyMax, nodes[i].stats.latencyMax);
+            nodes[i].destroy();
+        }
+        result->collided = receiver.chip.stats.rxCollided;
+        receiver.destroy();
+        result->events = eventCount;
+        result->wallNsec = readNsecTimer() - wallStart;
+    }
+
+
+    static bool report(const Scenario* scenario, const Result* result)
+    {
+        int count = scenario->nodeCount;
+        uint32_t lost = result->produced - result->received;
+        double offered = (double)result->produced * 1000000 / SIM_MEASURE_USEC;
+        double delivered = (double)result->received * 1000000 / SIM_MEASURE_USEC;
+        double simulated = (SIM_ASSOC_USEC * USEC + SIM_MEASURE_USEC * USEC + result->drained) / (double)SEC;
+        printf("%-8s %5d %5d %6d %9.1f %9.1f %6.2f%% %5u %5u %7u %6.2f%% %6u %6.1f %5d %5d %6u %8.1f %7.1fx\n", scenario->name,
+               count, result->associated, scenario->lossPermille, offered, delivered,
+               result->produced ? 100. * lost / result->produced : 0., result->duplicates, result->corrupt,
+               result->collided, result->sofReceived ? 100. * result->sofTimingFailed / result->sofReceived : 0.,
+               result->rejoinCount ? result->rejoinMsecs / result->rejoinCount : 0,
+               result->received ? (double)result->latencySum / result->received / 1000 : 0.,
+               percentile(Node::latency, 500), percentile(Node::latency, 990), result->latencyMax / 1000,
+               result->drained / (double)MSEC, simulated * 1000000000 / result->wallNsec);
+        return result->associated == count && !result->corrupt && !lost;
+    }
+}
+
+
+int main()
+{
+    // Per-node data rates are chosen to load the link with roughly the same total throughput,
+    // except for the outage scenario, which needs some headroom to catch up after the outages.
+    static const Sim::Scenario scenarios[] =
+    {
+        { "single", 1, 1000, 0, 0 },
+        { "small", 10, 150, 0, 0 },
+        { "medium", 50, 30, 0, 0 },
+        { "full", 100, 15, 0, 0 },
+        { "lossy", 50, 30, SIM_LOSS_PERMILLE, 0 },
+        { "outage", 50, 15, 0, SIM_OUTAGE_USEC },
+    };
+    printf("%ds association, %ds measurement, up to %ds drain, +/-%dppm node and +/-%dppm receiver clocks\n",
+           SIM_ASSOC_USEC / 1000000, SIM_MEASURE_USEC / 1000000, SIM_DRAIN_USEC / 1000000,
+           SIM_NODE_PPM, SIM_RECEIVER_PPM);
+    printf("rates in pages/s, latencies in ms (from block completion to arrival at the host), drain time in ms,\n"
+           "untimed: SOF packets after which nodes didn't trust their timing enough to transmit,\n"
+           "rejoin: mean duration of SOF packet outages that nodes recovered from (in ms)\n");
+    printf("scenario nodes assoc loss/k   offered delivered   lost%%  dups corr. collide untimed rejoin   mean   p50   p99    max"
+           "    drain   speed\n");
+    bool pass = true;
+    for (uint32_t i = 0; i < ARRAYLEN(scenarios); i++)
+    {
+        Sim::Result result;
+        Sim::run(scenarios + i, 0x11e0000 + i, &result);
+        bool ok = Sim::report(scenarios + i, &result);
+        printf("%s: %s\n", scenarios[i].name, ok ? "PASS" : "FAIL");
+        pass = pass && ok;
+    }
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,579 @@
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// This translation unit sees the sensor node's configuration (see target.h). Identifiers that the receiver
+// firmware uses for something else, or defines differently, are renamed, so that both firmwares can be linked
+// into one program.
+#define SIM_NODE
+#define Clock NodeClock
+#define DMA NodeDMA
+#define IRQ NodeIRQ
+#define EXTI NodeEXTI
+#define irq_number NodeIRQNumber
+#define STM32_DMA_REG_TYPE STM32F0_DMA_REG_TYPE
+#define STM32_DMA_STREAM_REG_TYPE STM32F0_DMA_STREAM_REG_TYPE
+#define STM32_RCC_REG_TYPE STM32F0_RCC_REG_TYPE
+
+#include "global.h"
+#include "device/nrf/nrf24l01p/nrf24l01p.h"
+// The sensor node's Radio namespace would collide with the receiver's Radio class.
+// NRF::Radio (the radio chip driver base class) is used by both and keeps working through this alias.
+namespace NRF
+{
+    typedef Radio NodeRadio;
+}
+#define Radio NodeRadio
+
+// Clock gates end up in a dummy register set
+#include "soc/stm32/f0/rcc_regs.h"
+#undef STM32_RCC_REGS
+#define STM32_RCC_REGS simRCC
+static STM32_RCC_REG_TYPE simRCC;
+
+#include "node.h"
+#include "cpu/arm/cortexm/irq.h"
+#include "../multisensor/common.h"
+#include "../multisensor/irq.h"
+#include "../multisensor/power.h"
+#include "../multisensor/radio.h"
+#include "../multisensor/commands.h"
+#include "../multisensor/sensortask.h"
+#include "../multisensor/storagetask.h"
+#include "../multisensor/driver/clock.h"
+#include "../multisensor/driver/dma.h"
+#include "../multisensor/driver/random.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// Every node has its own measurement data buffer, the firmware accesses the one of the selected node
+static MainBuf* simMainBuf;
+#define mainBuf (*simMainBuf)
+
+// The firmware code that is simulated
+#include "../multisensor/radio.cpp"
+#include "../multisensor/driver/random.cpp"
+
+
+// All variables of this file make up the state of a node: The simulated firmware's and those of the replacements
+// below. The linker collects them in two blocks (see link.lds), which are swapped in and out by Node::select.
+// Simulation side variables of Node must therefore be defined elsewhere (see device.cpp).
+extern "C" uint64_t _nodedata[], _nodedata_end[], _nodebss[], _nodebss_end[];
+#define NODE_DATA_WORDS ((size_t)(_nodedata_end - _nodedata))
+#define NODE_BSS_WORDS ((size_t)(_nodebss_end - _nodebss))
+#define NODE_STATE_SIZE ((NODE_DATA_WORDS + NODE_BSS_WORDS) * sizeof(uint64_t))
+
+// The blocks are padded to whole words. Copy them word by word, memcpy (sys/util.cpp) would copy single bytes.
+static void copyWords(uint64_t* dst, const uint64_t* src, size_t words)
+{
+    while (words--) *dst++ = *src++;
+}
+
+static void saveState(uint8_t* ptr)
+{
+    copyWords((uint64_t*)ptr, _nodedata, NODE_DATA_WORDS);
+    copyWords((uint64_t*)ptr + NODE_DATA_WORDS, _nodebss, NODE_BSS_WORDS);
+}
+
+static void loadState(const uint8_t* ptr)
+{
+    copyWords(_nodedata, (const uint64_t*)ptr, NODE_DATA_WORDS);
+    copyWords(_nodebss, (const uint64_t*)ptr + NODE_DATA_WORDS, NODE_BSS_WORDS);
+}
+
+
+// Replacements for the firmware parts that the radio driver depends on
+
+Config config;
+uint32_t mainBufSeq[ARRAYLEN(mainBuf.block)];
+bool mainBufValid[ARRAYLEN(mainBuf.block)];
+
+void error(ErrorCode code)
+{
+    printf("node: error(%d) at %lld ns\n", code, (long long)Sim::now);
+    abort();
+}
+
+namespace SensorTask
+{
+    State state;
+    uint32_t writeSeq;
+
+    void yield()
+    {
+        // Only used by shared SPI bus transfers, which the simulated nodes don't do
+        abort();
+    }
+}
+
+namespace StorageTask
+{
+    State state;
+}
+
+namespace Commands
+{
+    bool handlePacket(RF::Packet::Command* cmd)
+    {
+        return true;
+    }
+}
+
+namespace IRQ
+{
+    static void (* const dpcHandler[])() =
+    {
+#define DEFINE_DPC(name, vector) vector,
+#include "../multisensor/dpc_defs.h"
+#undef DEFINE_DPC
+    };
+
+    void clearRadioTimerIRQ()
+    {
+        Sim::Device::current->timerAcknowledge();
+    }
+
+    void wakeSensorTask()
+    {
+        // The measurement is over once the radio has sent everything
+        if (SensorTask::state == SensorTask::State_Measuring && !Radio::measuring)
+            SensorTask::state = SensorTask::State_Idle;
+    }
+
+    void wakeStorageTask()
+    {
+    }
+
+    void setPending(DPCNumber dpc)
+    {
+        ((Sim::Node*)Sim::Device::current)->setDPCPending(dpc);
+    }
+}
+
+namespace Power
+{
+    void dpcSleepTask()
+    {
+        // Deep sleep for 1.6s or 26s depending on the number of failed radio association attempts,
+        // Radio::startup() will be called after waking up.
+        bool turnPowerOff = Radio::failedAssocAttempts >= 128;
+        ((Sim::Node*)Sim::Device::current)->deepSleep((turnPowerOff ? 0xffff : 0xfff) * 400);
+    }
+}
+
+namespace Clock
+{
+    // Same decisions as the real one, trimming the HSI48 changes the simulated oscillator's frequency
+    bool trim(int ppm)
+    {
+        if (ppm >= -1000 && ppm <= 1000) return false;
+        Sim::Device* device = Sim::Device::current;
+        if (ppm > 0) device->setClockError(device->getClockError() - SIM_TRIM_STEP_PPM * 1000);
+        else device->setClockError(device->getClockError() + SIM_TRIM_STEP_PPM * 1000);
+        return true;
+    }
+}
+
+namespace STM32
+{
+    void EXTI::configure(::GPIO::Pin pin, Config config)
+    {
+        Sim::Device::current->extiConfigure(pin.pin, config.irq);
+    }
+
+    void EXTI::enableIRQ(::GPIO::Pin pin, bool on)
+    {
+        Sim::Device::current->extiEnable(pin.pin, on);
+    }
+
+    bool EXTI::getPending(::GPIO::Pin pin)
+    {
+        return Sim::Device::current->extiGetPending(pin.pin);
+    }
+
+    void EXTI::clearPending(::GPIO::Pin pin)
+    {
+        Sim::Device::current->extiClearPending(pin.pin);
+    }
+}
+
+namespace DMA
+{
+    void setPeripheralAddr(volatile STM32_DMA_STREAM_REG_TYPE* stream, volatile void* addr)
+    {
+    }
+
+    void startTransferFromPri0(volatile STM32_DMA_STREAM_REG_TYPE* stream, Config config, void* memAddr, size_t len)
+    {
+        Sim::Device::Stream s = stream == &RADIO_DMA_RX_REGS ? Sim::Device::Stream_RX : Sim::Device::Stream_TX;
+        Sim::Device::current->dmaStart(s, memAddr, len, config.b.MINC, config.b.TCIE);
+    }
+
+    void cancelTransfer(volatile STM32_DMA_STREAM_REG_TYPE* stream)
+    {
+        Sim::Device::current->dmaCancel(stream == &RADIO_DMA_RX_REGS ? Sim::Device::Stream_RX : Sim::Device::Stream_TX);
+    }
+
+    void clearIRQFromPri0(int controller, int stream)
+    {
+        if (stream == RADIO_DMA_RX_STREAM) Sim::Device::current->dmaClearPending(Sim::Device::Stream_RX);
+        else if (stream == RADIO_DMA_TX_STREAM) Sim::Device::current->dmaClearPending(Sim::Device::Stream_TX);
+    }
+}
+
+
+namespace Sim
+{
+    void Node::init(int index, int64_t clockPPB, uint32_t usecOffset, Time bootTime)
+    {
+        snprintf(name, sizeof(name), "node%d", index);
+        serial = 0x1000 + index;
+        deviceConfig =
+        {
+            name, clockPPB, usecOffset, 48000000, 48000000, SIM_NODE_IRQ_NSEC,
+            PIN_RADIO_NCS.pin, PIN_RADIO_CE.pin, PIN_RADIO_NIRQ.pin,
+            exti4_15_IRQn, tim7_IRQn, dma1_stream4_7_dma2_stream3_5_IRQn, dma1_stream4_7_dma2_stream3_5_IRQn,
+        };
+        Device::init(&deviceConfig);
+        memset(&stats, 0, sizeof(stats));
+
+        // Every node starts out with the firmware variables as they were at program startup
+        if (!initialState)
+        {
+            initialState = (uint8_t*)malloc(NODE_STATE_SIZE);
+            saveState(initialState);
+        }
+        state = (uint8_t*)malloc(NODE_STATE_SIZE);
+        memcpy(state, initialState, NODE_STATE_SIZE);
+        buffer = calloc(1, sizeof(MainBuf));
+
+        bootPending = false;
+        wakePending = false;
+        dpcPending = 0;
+        startPending = false;
+        stopPending = false;
+        producing = false;
+        pagesPerSecond = 0;
+        producerGen = 0;
+        blocksPending = 0;
+        writeBlock = 0;
+        blockTime = NULL;
+        blockCount = 0;
+        blockCapacity = 0;
+        pageSeen = NULL;
+        highestPage = 0;
+
+        // Set up the node's identity in its own copy of the firmware variables
+        select();
+        memset(&::config, 0, sizeof(::config));
+        ::config.nodeUniqueId.hardware.vendor = 0x4c505053;
+        ::config.nodeUniqueId.hardware.product = 1;
+        ::config.nodeUniqueId.hardware.serial = serial;
+        ::config.nodeUniqueId.firmware.version = FIRMWARE_VERSION;
+        // Data polling interval, as configured by the storage task
+        Radio::noDataResponse.pollInFrames = 16;
+
+        schedule(bootTime, bootEvent, this, 0);
+    }
+
+
+    void Node::destroy()
+    {
+        if (selected == this) selected = NULL;
+        free(state);
+        free(buffer);
+        free(blockTime);
+        free(pageSeen);
+    }
+
+
+    void Node::save()
+    {
+        saveState(state);
+    }
+
+
+    void Node::load()
+    {
+        loadState(state);
+        simMainBuf = (MainBuf*)buffer;
+    }
+
+
+    void Node::select()
+    {
+        if (selected == this) return;
+        if (selected) selected->save();
+        load();
+        selected = this;
+    }
+
+
+    uint8_t Node::getNodeId()
+    {
+        select();
+        return Radio::nodeId;
+    }
+
+
+    bool Node::hasDataPending()
+    {
+        select();
+        if (producing || Radio::measuring) return true;
+        for (uint32_t i = 0; i < ARRAYLEN(Radio::txBufInfo); i++)
+            if (Radio::txBufInfo[i].attemptsLeft)
+                return true;
+        return false;
+    }
+
+
+    uint32_t Node::getBufferOverflowLost()
+    {
+        select();
+        return Radio::bufferOverflowLost;
+    }
+
+
+    RF::TelemetryData Node::getTelemetry()
+    {
+        select();
+        return Radio::noDataResponse.telemetry;
+    }
+
+
+    void Node::handleRadioIRQ()
+    {
+        if (STM32::EXTI::getPending(PIN_RADIO_NIRQ)) Radio::handleIRQ();
+    }
+
+
+    void Node::handleTimerIRQ()
+    {
+        Radio::timerTick();
+    }
+
+
+    void Node::handleDMAIRQ(Stream stream)
+    {
+        DMA::clearIRQFromPri0(0, 3);
+        DMA::clearIRQFromPri0(0, 4);
+        Radio::handleDMACompletion();
+    }
+
+
+    // Everything that runs at DPC priority: Booting, waking up, the DPCs and the data source
+    bool Node::runDPC()
+    {
+        if (bootPending)
+        {
+            bootPending = false;
+            irq_enable(exti4_15_IRQn, true);
+            irq_enable(tim7_IRQn, true);
+            irq_enable(dma1_stream4_7_dma2_stream3_5_IRQn, true);
+            Random::init();
+            Radio::init();
+            Radio::startup();
+            return true;
+        }
+        if (wakePending)
+        {
+            wakePending = false;
+            Radio::startup();
+            return true;
+        }
+        for (uint32_t i = 0; i < ARRAYLEN(IRQ::dpcHandler); i++)
+            if (dpcPending & (1 << i))
+            {
+                dpcPending &= ~(1 << i);
+                IRQ::dpcHandler[i]();
+                return true;
+            }
+        if (startPending)
+        {
+            // Like the sensor task: The series header occupies the first 16 blocks and is sent first
+            startPending = false;
+            memset(mainBufSeq, 0, sizeof(mainBufSeq));
+            memset(mainBufValid, 0, sizeof(mainBufValid));
+            writeBlock = sizeof(mainBuf.seriesHeader) / sizeof(*mainBuf.block);
+            for (SensorTask::writeSeq = 0; SensorTask::writeSeq < writeBlock; SensorTask::writeSeq++)
+            {
+                for (uint32_t p = 0; p < ARRAYLEN(*mainBuf.block); p++)
+                    for (uint32_t w = 0; w < ARRAYLEN(mainBuf.block[0][0].u32); w++)
+                        mainBuf.block[SensorTask::writeSeq][p].u32[w]
+                            = pattern(serial, SensorTask::writeSeq * ARRAYLEN(*mainBuf.block) + p, w);
+                mainBufSeq[SensorTask::writeSeq] = SensorTask::writeSeq;
+                mainBufValid[SensorTask::writeSeq] = true;
+                addBlock(cursor);
+            }
+            if (writeBlock >= ARRAYLEN(mainBuf.block)) writeBlock = 0;
+            Radio::noDataResponse.bitrate = pagesPerSecond * sizeof(Page) * 8;
+            Radio::startMeasurementTransmission();
+            SensorTask::state = SensorTask::State_Measuring;
+            producing = true;
+            scheduleBlock();
+            return true;
+        }
+        if (blocksPending)
+        {
+            blocksPending--;
+            produceBlock();
+            return true;
+        }
+        if (stopPending)
+        {
+            stopPending = false;
+            producing = false;
+            producerGen++;
+            Radio::seriesComplete = true;
+            return true;
+        }
+        return false;
+    }
+
+
+    void Node::setDPCPending(int dpc)
+    {
+        dpcPending |= 1 << dpc;
+        requestService();
+    }
+
+
+    void Node::deepSleep(int usec)
+    {
+        schedule(getGlobalTime(getLocalTime(cursor) + (int64_t)usec * 1000), wakeEvent, this, 0);
+    }
+
+
+    void Node::bootEvent(void* obj, uint32_t arg)
+    {
+        Node* node = (Node*)obj;
+        node->bootPending = true;
+        node->requestService();
+    }
+
+
+    void Node::wakeEvent(void* obj, uint32_t arg)
+    {
+        Node* node = (Node*)obj;
+        node->wakePending = true;
+        node->requestService();
+    }
+
+
+    void Node::startMeasurement(int pagesPerSecond)
+    {
+        this->pagesPerSecond = pagesPerSecond;
+        startPending = true;
+        requestService();
+    }
+
+
+    void Node::stopMeasurement()
+    {
+        stopPending = true;
+        requestService();
+    }
+
+
+    void Node::scheduleBlock()
+    {
+        schedule(now + (Time)ARRAYLEN(*mainBuf.block) * SEC / pagesPerSecond, blockEvent, this, producerGen);
+    }
+
+
+    void Node::blockEvent(void* obj, uint32_t arg)
+    {
+        Node* node = (Node*)obj;
+        if (arg != node->producerGen || !node->producing) return;
+        node->blocksPending++;
+        node->requestService();
+        node->scheduleBlock();
+    }
+
+
+    // Complete a measurement data block, like SensorTask::completeBlock
+    void Node::produceBlock()
+    {
+        uint32_t page = SensorTask::writeSeq * ARRAYLEN(*mainBuf.block);
+        for (uint32_t p = 0; p < ARRAYLEN(*mainBuf.block); p++)
+            for (uint32_t w = 0; w < ARRAYLEN(mainBuf.block[0][0].u32); w++)
+                mainBuf.block[writeBlock][p].u32[w] = pattern(serial, page + p, w);
+        mainBufSeq[writeBlock] = SensorTask::writeSeq++;
+        mainBufValid[writeBlock] = true;
+        if (++writeBlock >= ARRAYLEN(mainBuf.block)) writeBlock = 0;
+        mainBufValid[writeBlock] = false;
+        addBlock(cursor);
+    }
+
+
+    void Node::addBlock(Time when)
+    {
+        if (blockCount >= blockCapacity)
+        {
+            uint32_t capacity = MAX(1024, blockCapacity * 2);
+            uint32_t pages = blockCapacity * ARRAYLEN(*mainBuf.block);
+            uint32_t newPages = capacity * ARRAYLEN(*mainBuf.block);
+            blockTime = (Time*)realloc(blockTime, capacity * sizeof(*blockTime));
+            pageSeen = (uint8_t*)realloc(pageSeen, (newPages + 7) / 8);
+            memset(pageSeen + (pages + 7) / 8, 0, (newPages + 7) / 8 - (pages + 7) / 8);
+            blockCapacity = capacity;
+        }
+        blockTime[blockCount++] = when;
+        stats.pagesProduced += ARRAYLEN(*mainBuf.block);
+    }
+
+
+    uint32_t Node::pattern(uint32_t serial, uint32_t page, int word)
+    {
+        uint32_t x = serial * 0x9e3779b1 ^ page * 0x85ebca6b ^ word * 0xc2b2ae35;
+        x ^= x >> 15;
+        x *= 0x2c1b3c6d;
+        return x ^ (x >> 13);
+    }
+
+
+    void Node::dataReceived(uint16_t seq, const void* data, Time when)
+    {
+        // Extend the 15 bit sequence number relative to the highest one seen so far
+        int32_t delta = (int16_t)((seq - highestPage) << 1) >> 1;
+        int64_t page = (int64_t)highestPage + delta;
+        if (page < 0 || page >= stats.pagesProduced)
+        {
+            stats.corrupt++;
+            return;
+        }
+        const uint32_t* words = (const uint32_t*)data;
+        for (int w = 0; w < (int)(sizeof(Page) / sizeof(uint32_t)); w++)
+            if (words[w] != pattern(serial, page, w))
+            {
+                stats.corrupt++;
+                return;
+            }
+        if (page > highestPage) highestPage = page;
+        if ((pageSeen[page / 8] >> (page % 8)) & 1)
+        {
+            stats.duplicates++;
+            return;
+        }
+        pageSeen[page / 8] |= 1 << (page % 8);
+        stats.pagesReceived++;
+        uint32_t usec = (when - blockTime[page / ARRAYLEN(*mainBuf.block)]) / USEC;
+        stats.latencySum += usec;
+        stats.latencyMax = MAX(stats.latencyMax, usec);
+        latency[MIN(usec / 1000, LATENCY_BUCKETS - 1)]++;
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "device.h"
+#include "../common/protocol/rfproto.h"
+
+
+// Latency histogram size in milliseconds (anything longer ends up in the last bucket)
+#define LATENCY_BUCKETS 4096
+
+
+namespace Sim
+{
+    // A sensor node running the multisensor radio driver (multisensor/radio.cpp). All nodes share one copy of
+    // the firmware's variables, which is swapped in when a node's code is about to run (see node.cpp and link.lds).
+    // The sensor task is replaced by a data source that completes measurement data buffer blocks at a fixed rate,
+    // filled with a pattern derived from the node's serial number and the page sequence number.
+    class Node final : public Device
+    {
+    public:
+        // What the host software got from this node (filled in by the receiver)
+        struct Stats
+        {
+            uint32_t pagesProduced;  // Measurement data pages that were put into the buffer
+            uint32_t pagesReceived;  // Distinct pages that arrived at the host
+            uint32_t duplicates;  // Pages that arrived more than once
+            uint32_t corrupt;  // Pages with unexpected contents or sequence numbers
+            uint64_t latencySum;  // Sum of page latencies (from block completion to arrival at the host, in usec)
+            uint32_t latencyMax;  // Worst page latency (usec)
+        } stats;
+
+        // Page latency histogram of all nodes (in milliseconds)
+        static uint32_t latency[LATENCY_BUCKETS];
+
+        void init(int index, int64_t clockPPB, uint32_t usecOffset, Time bootTime);
+        void destroy();
+        uint32_t getSerial() const { return serial; }
+
+        // Firmware state (swaps the node's state in)
+        uint8_t getNodeId();
+        bool hasDataPending();  // Measurement running, or data that wasn't acknowledged yet
+        uint32_t getBufferOverflowLost();
+        RF::TelemetryData getTelemetry();  // Radio link telemetry that the node reports in NoData packets
+
+        // Start producing measurement data at the given rate (like the sensor task after a start command)
+        void startMeasurement(int pagesPerSecond);
+        // Stop producing measurement data, the radio will send whatever is left in the buffer
+        void stopMeasurement();
+
+        // Called by the host software model for every measurement data packet that arrived from this node
+        void dataReceived(uint16_t seq, const void* data, Time when);
+        // Contents of a measurement data page word
+        static uint32_t pattern(uint32_t serial, uint32_t page, int word);
+
+        // Called by the firmware function replacements in node.cpp
+        void setDPCPending(int dpc);
+        void deepSleep(int usec);
+
+    protected:
+        void select() override;
+        void handleRadioIRQ() override;
+        void handleTimerIRQ() override;
+        void handleDMAIRQ(Stream stream) override;
+        bool runDPC() override;
+
+    private:
+        Config deviceConfig;
+        char name[16];
+        uint32_t serial;  // Hardware serial number (unique ID)
+        uint8_t* state;  // Saved copy of the firmware's variables while another node is swapped in
+        void* buffer;  // Measurement data buffer (MainBuf)
+        // Firmware execution
+        bool bootPending;
+        bool wakePending;
+        uint32_t dpcPending;  // Bit mask of pending DPCs (IRQ::DPCNumber)
+        // Data source
+        bool startPending;
+        bool stopPending;
+        bool producing;
+        int pagesPerSecond;
+        uint32_t producerGen;  // Incremented when the data source is stopped, invalidates scheduled block events
+        uint32_t blocksPending;  // Completed blocks that weren't handed to the radio yet
+        uint8_t writeBlock;
+        // Completion time of every block since the measurement was started (indexed by block sequence number)
+        Time* blockTime;
+        uint32_t blockCount;
+        uint32_t blockCapacity;
+        // Host side reception tracking
+        uint8_t* pageSeen;  // One bit per page sequence number
+        uint32_t highestPage;  // Highest page sequence number received (extended to 32 bits)
+
+        static Node* selected;  // The node whose state is currently swapped in
+        static uint8_t* initialState;  // State of the firmware variables before any node was booted
+
+        static void bootEvent(void* obj, uint32_t arg);
+        static void wakeEvent(void* obj, uint32_t arg);
+        static void blockEvent(void* obj, uint32_t arg);
+        void save();
+        void load();
+        void addBlock(Time when);
+        void produceBlock();
+        void scheduleBlock();
+    };
+}
@@ -0,0 +1,390 @@
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// This translation unit sees the receiver's configuration (see target.h)
+#define SIM_RECEIVER
+
+#include "global.h"
+
+// Clock gates end up in a dummy register set
+#include "soc/stm32/f2/rcc_regs.h"
+#undef STM32_RCC_REGS
+#define STM32_RCC_REGS simRCC
+static STM32_RCC_REG_TYPE simRCC;
+
+#include "receiver.h"
+#include "../receiver/radio.h"
+#include "../receiver/irq.h"
+#include "../receiver/driver/clock.h"
+#include "../receiver/driver/dma.h"
+#include <stdlib.h>
+
+
+// The firmware code that is simulated
+#include "../receiver/radio.cpp"
+#include "../receiver/scheduler.cpp"
+
+
+// Replacements for the firmware parts that the radio driver depends on
+
+namespace IRQ
+{
+    void setPending(DPCNumber dpc)
+    {
+        // There is only one DPC (DPC_HubHandlePackets)
+        ((Sim::Receiver*)Sim::Device::current)->setDPCPending();
+    }
+}
+
+namespace DMA
+{
+    void setPeripheralAddr(volatile STM32_DMA_STREAM_REG_TYPE* regs, volatile void* addr)
+    {
+    }
+
+    void setFIFOConfig(volatile STM32_DMA_STREAM_REG_TYPE* regs, bool direct, int threshold)
+    {
+    }
+
+    void startTransferFromPri0(volatile STM32_DMA_STREAM_REG_TYPE* regs, Config config, void* memAddr, size_t len)
+    {
+        Sim::Device::Stream s = regs == radioHardware[0].dmaRx ? Sim::Device::Stream_RX : Sim::Device::Stream_TX;
+        Sim::Device::current->dmaStart(s, memAddr, len, config.b.MINC, config.b.TCIE);
+    }
+
+    void cancelTransferFromPri0(volatile STM32_DMA_STREAM_REG_TYPE* regs, int controller, int stream)
+    {
+        Sim::Device::current->dmaCancel(regs == radioHardware[0].dmaRx ? Sim::Device::Stream_RX : Sim::Device::Stream_TX);
+    }
+
+    void clearIRQFromPri0(int controller, int stream)
+    {
+        if (stream == RADIO_DMA_RX_STREAM) Sim::Device::current->dmaClearPending(Sim::Device::Stream_RX);
+        else if (stream == RADIO_DMA_TX_STREAM) Sim::Device::current->dmaClearPending(Sim::Device::Stream_TX);
+    }
+}
+
+namespace STM32
+{
+    void EXTI::configure(::GPIO::Pin pin, Config config)
+    {
+        Sim::Device::current->extiConfigure(pin.pin, config.irq);
+    }
+
+    void EXTI::enableIRQ(::GPIO::Pin pin, bool on)
+    {
+        Sim::Device::current->extiEnable(pin.pin, on);
+    }
+
+    bool EXTI::getPending(::GPIO::Pin pin)
+    {
+        return Sim::Device::current->extiGetPending(pin.pin);
+    }
+
+    void EXTI::clearPending(::GPIO::Pin pin)
+    {
+        Sim::Device::current->extiClearPending(pin.pin);
+    }
+}
+
+
+namespace Sim
+{
+    void Receiver::init(int64_t clockPPB, uint32_t usecOffset, Node* const* nodes, int nodeCount)
+    {
+        const Radio::Hardware* hw = radioHardware;
+        deviceConfig =
+        {
+            "receiver", clockPPB, usecOffset, 30000000, 60000000, SIM_RECEIVER_IRQ_NSEC,
+            (uint8_t)hw->ncs.pin, (uint8_t)hw->ce.pin, (uint8_t)hw->nirq.pin,
+            hw->irq, hw->timerIrq, hw->dmaRxIrq, hw->dmaTxIrq,
+        };
+        Device::init(&deviceConfig);
+        memset(&stats, 0, sizeof(stats));
+        bootPending = false;
+        dpcPending = false;
+        pollDue = false;
+        repollDue = false;
+        this->nodes = nodes;
+        this->nodeCount = nodeCount;
+        memset(owner, 0, sizeof(owner));
+        memset(heard, 0, sizeof(heard));
+        assignedId = (uint8_t*)calloc(nodeCount, sizeof(*assignedId));
+        lastAssign = (Time*)malloc(nodeCount * sizeof(*lastAssign));
+        for (int i = 0; i < nodeCount; i++) lastAssign[i] = -1;
+        pollCount = 0;
+        schedule(now, bootEvent, this, 0);
+        schedule(now + SIM_REPOLL_INTERVAL_USEC * USEC, repollEvent, this, 0);
+    }
+
+
+    void Receiver::destroy()
+    {
+        free(assignedId);
+        free(lastAssign);
+    }
+
+
+    void Receiver::setDPCPending()
+    {
+        dpcPending = true;
+        requestService();
+    }
+
+
+    void Receiver::bootEvent(void* obj, uint32_t arg)
+    {
+        Receiver* receiver = (Receiver*)obj;
+        receiver->bootPending = true;
+        receiver->requestService();
+    }
+
+
+    void Receiver::pollEvent(void* obj, uint32_t arg)
+    {
+        Receiver* receiver = (Receiver*)obj;
+        receiver->pollDue = true;
+        receiver->requestService();
+    }
+
+
+    void Receiver::repollEvent(void* obj, uint32_t arg)
+    {
+        Receiver* receiver = (Receiver*)obj;
+        receiver->repollDue = true;
+        receiver->requestService();
+    }
+
+
+    // Start up the radio like the host software does (see Client/measure.py)
+    void Receiver::boot()
+    {
+        Radio* radio = Radio::instance;
+        new(radio) Radio(radioHardware);
+        radio->init();
+        RF::ExtendedChannelAttributes attrs;
+        memset(&attrs, 0, sizeof(attrs));
+        attrs.ca.channel = SIM_CHANNEL;
+        attrs.ca.netId = random();
+        attrs.ca.guardBits = SIM_GUARD_BITS;
+        attrs.ca.minSlots = SIM_MIN_SLOTS;
+        attrs.ca.burst = SIM_BURST;
+        radio->configure(&attrs);
+    }
+
+
+    uint32_t Receiver::getSOFCount()
+    {
+        return Radio::instance->stats.sofTotal;
+    }
+
+
+    uint32_t Receiver::getRxAcked()
+    {
+        return Radio::instance->stats.rxAcked;
+    }
+
+
+    uint32_t Receiver::getRxSlotNotOwned()
+    {
+        return Radio::instance->stats.rxSlotNotOwned;
+    }
+
+
+    uint32_t Receiver::getRxOverflow()
+    {
+        return Radio::instance->stats.rxOverflow;
+    }
+
+
+    void Receiver::handleRadioIRQ()
+    {
+        Radio::instance->handleIRQ();
+    }
+
+
+    void Receiver::handleTimerIRQ()
+    {
+        Radio::instance->timerTick();
+    }
+
+
+    void Receiver::handleDMAIRQ(Stream stream)
+    {
+        if (stream == Stream_RX)
+        {
+            DMA::clearIRQFromPri0(RADIO_DMA_RX_CONTROLLER, RADIO_DMA_RX_STREAM);
+            Radio::instance->handleRXDMACompletion();
+        }
+        else
+        {
+            DMA::clearIRQFromPri0(RADIO_DMA_TX_CONTROLLER, RADIO_DMA_TX_STREAM);
+            Radio::instance->handleTXDMACompletion();
+        }
+    }
+
+
+    // Hub::dpcHandlePackets, with the host software processing every packet right away
+    bool Receiver::runDPC()
+    {
+        if (bootPending)
+        {
+            bootPending = false;
+            boot();
+            return true;
+        }
+        if (pollDue)
+        {
+            pollDue = false;
+            poll();
+            return true;
+        }
+        if (repollDue)
+        {
+            repollDue = false;
+            repoll();
+            return true;
+        }
+        if (!dpcPending) return false;
+        dpcPending = false;
+        // Forward the received packets in batches, like the hub does with the host software's batch size
+        Radio* radio = Radio::instance;
+        USB::Packet* batch;
+        int size;
+        while ((batch = radio->getRxBatch(16, &size)))
+        {
+            USB::Packet::Notify::RxPacket* entry = batch->notify.rfPacketBatch.packet;
+            for (int i = 0; i < batch->notify.rfPacketBatch.count; i++) handlePacket(entry[i].packet);
+            radio->releaseRxPackets(batch->notify.rfPacketBatch.count);
+        }
+        return true;
+    }
+
+
+    // RFManager.rxThread
+    void Receiver::handlePacket(const uint8_t* data)
+    {
+        stats.packets++;
+        if (data[0] == RF::Notify)
+        {
+            // Only NodeId notifications are of interest
+            if (data[1] != RF::NID_NodeId) return;
+            const RF::HwUniqueId* hwId = (const RF::HwUniqueId*)(data + 4);
+            for (int i = 0; i < nodeCount; i++)
+            {
+                if (hwId->serial != nodes[i]->getSerial()) continue;
+                // A node confirming the NodeId that it was assigned, or announcing that it is back after an outage
+                if (data[3])
+                {
+                    if (data[3] == assignedId[i]) queuePoll(data[3]);
+                    return;
+                }
+                // Ignore requests within 200ms of the last assignment attempt (unless the node is new)
+                if (lastAssign[i] >= 0 && cursor - lastAssign[i] < SIM_ASSIGN_INTERVAL_USEC * USEC) return;
+                lastAssign[i] = cursor;
+                assignNodeId(i, hwId);
+                return;
+            }
+            return;
+        }
+        // Measurement data packets have the high bit of the sequence number clear
+        Node* node = data[0] < ARRAYLEN(owner) ? owner[data[0]] : NULL;
+        if (!node)
+        {
+            stats.unknownPackets++;
+            return;
+        }
+        heard[data[0]] = true;
+        if (!(data[3] & 0x80)) node->dataReceived(data[2] | (data[3] << 8), data + 4, cursor);
+    }
+
+
+    // ReceiverData.assignAddr
+    void Receiver::assignNodeId(int index, const void* hwId)
+    {
+        Radio* radio = Radio::instance;
+        if (!assignedId[index])
+        {
+            uint32_t id;
+            for (id = RF::MinNode; id <= RF::MaxNode; id++) if (!owner[id]) break;
+            if (id > RF::MaxNode) return;
+            assignedId[index] = id;
+            owner[id] = nodes[index];
+        }
+        uint8_t id = assignedId[index];
+
+        // Send a SetNodeId packet
+        RF::Packet* packet = radio->getCommandBuffer();
+        if (!packet) return;
+        memset(packet, 0, sizeof(*packet));
+        packet->notifyReply.setNodeId.header.channel = RF::NotifyReply;
+        packet->notifyReply.setNodeId.header.messageId = RF::NID_SetNodeId;
+        packet->notifyReply.setNodeId.nodeId = id;
+        memcpy(&packet->notifyReply.setNodeId.hwId, hwId, sizeof(packet->notifyReply.setNodeId.hwId));
+        radio->enqueueCommand(RF::NotifyReply);
+        stats.nodeIdsAssigned++;
+        heard[id] = false;
+        queuePoll(id);
+    }
+
+
+    // Queue a poll request, the host software sends those every 10ms
+    void Receiver::queuePoll(uint8_t id)
+    {
+        for (int i = 0; i < pollCount; i++) if (pollQueue[i] == id) return;
+        if (!pollCount) schedule(cursor + SIM_POLL_INTERVAL_USEC * USEC, pollEvent, this, 0);
+        pollQueue[pollCount++] = id;
+    }
+
+
+    // Receiver.pollThread: Poll the queued NodeIds during the next frame (CID_PollDevice), one frame worth at a time
+    void Receiver::poll()
+    {
+        Radio* radio = Radio::instance;
+        int done = 0;
+        while (done < pollCount)
+        {
+            uint32_t slot;
+            for (slot = 0; slot < ARRAYLEN(radio->nextPacketSlots); slot++)
+                if (radio->nextPacketSlots[slot].owner == pollQueue[done]) break;
+            if (slot == ARRAYLEN(radio->nextPacketSlots))
+            {
+                for (slot = 0; slot < ARRAYLEN(radio->nextPacketSlots); slot++)
+                    if (!radio->nextPacketSlots[slot].sticky && !radio->nextPacketSlots[slot].owner)
+                        break;
+                if (slot == ARRAYLEN(radio->nextPacketSlots)) break;
+                radio->nextPacketSlots[slot].owner = pollQueue[done];
+            }
+            done++;
+        }
+        // Whatever didn't fit will be polled 10ms later
+        pollCount -= done;
+        memmove(pollQueue, pollQueue + done, pollCount);
+        if (pollCount) schedule(cursor + SIM_POLL_INTERVAL_USEC * USEC, pollEvent, this, 0);
+    }
+
+
+    // Poll nodes that didn't answer since they were assigned a NodeId again. The first poll may arrive
+    // before the node has processed the SetNodeId packet, or its reply may get lost.
+    void Receiver::repoll()
+    {
+        for (int i = 0; i < nodeCount; i++)
+            if (assignedId[i] && !heard[assignedId[i]])
+                queuePoll(assignedId[i]);
+        schedule(cursor + SIM_REPOLL_INTERVAL_USEC * USEC, repollEvent, this, 0);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "device.h"
+#include "node.h"
+#include "../common/protocol/rfproto.h"
+
+
+namespace Sim
+{
+    // The base station, running the receiver radio driver (receiver/radio.cpp). The hub and the host software
+    // are replaced by a model of what Client/sensorplatform/rfmanager.py does: Assigning NodeIds to nodes that
+    // ask for one, polling them until they answer (the host would be waiting for a reply to its first command),
+    // and passing measurement data packets to the node that sent them (see Node::dataReceived).
+    class Receiver final : public Device
+    {
+    public:
+        // Host software statistics
+        struct Stats
+        {
+            uint32_t packets;  // Packets forwarded by the receiver
+            uint32_t nodeIdsAssigned;  // SetNodeId packets sent
+            uint32_t unknownPackets;  // Packets from NodeIds that aren't assigned
+        } stats;
+
+        void init(int64_t clockPPB, uint32_t usecOffset, Node* const* nodes, int nodeCount);
+        void destroy();
+
+        // Firmware statistics
+        uint32_t getSOFCount();
+        uint32_t getRxAcked();
+        uint32_t getRxSlotNotOwned();
+        uint32_t getRxOverflow();
+
+        // Called by the firmware function replacements in receiver.cpp
+        void setDPCPending();
+
+    protected:
+        void handleRadioIRQ() override;
+        void handleTimerIRQ() override;
+        void handleDMAIRQ(Stream stream) override;
+        bool runDPC() override;
+
+    private:
+        Config deviceConfig;
+        bool bootPending;
+        bool dpcPending;
+        bool pollDue;
+        bool repollDue;
+        // Host software state
+        Node* const* nodes;
+        int nodeCount;
+        Node* owner[128];  // Node that a NodeId is assigned to
+        bool heard[128];  // Whether a packet from a NodeId arrived since it was (last) assigned
+        uint8_t* assignedId;  // NodeId of each node (0 if there is none yet)
+        Time* lastAssign;  // Time of the last NodeId assignment attempt of each node (-1 if the node is unknown)
+        uint8_t pollQueue[RF::MaxNode];  // NodeIds to be polled by the next poll request
+        int pollCount;
+
+        static void bootEvent(void* obj, uint32_t arg);
+        static void pollEvent(void* obj, uint32_t arg);
+        static void repollEvent(void* obj, uint32_t arg);
+        void boot();
+        void handlePacket(const uint8_t* data);
+        void assignNodeId(int index, const void* hwId);
+        void queuePoll(uint8_t id);
+        void poll();
+        void repoll();
+    };
+}
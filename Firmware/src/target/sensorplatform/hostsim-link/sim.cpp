@@ -0,0 +1,131 @@
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+namespace Sim
+{
+    struct Event
+    {
+        Time at;
+        uint64_t seq;  // Tie breaker, keeps events with the same time in FIFO order
+        EventHandler handler;
+        void* obj;
+        uint32_t arg;
+    };
+
+    Time now;
+    uint64_t eventCount;
+
+    // Binary min-heap of pending events, ordered by (at, seq)
+    static Event* heap;
+    static uint32_t heapSize;
+    static uint32_t heapCapacity;
+    static uint64_t nextSeq;
+    static uint64_t rngState;
+
+
+    static bool before(const Event* a, const Event* b)
+    {
+        return a->at < b->at || (a->at == b->at && a->seq < b->seq);
+    }
+
+
+    void schedule(Time at, EventHandler handler, void* obj, uint32_t arg)
+    {
+        if (at < now)
+        {
+            printf("event scheduled in the past (%lld < %lld)\n", (long long)at, (long long)now);
+            abort();
+        }
+        if (heapSize >= heapCapacity)
+        {
+            heapCapacity = heapCapacity ? heapCapacity * 2 : 1024;
+            heap = (Event*)realloc(heap, heapCapacity * sizeof(*heap));
+            if (!heap) abort();
+        }
+        uint32_t i = heapSize++;
+        Event event = { at, nextSeq++, handler, obj, arg };
+        while (i && before(&event, heap + (i - 1) / 2))
+        {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = event;
+    }
+
+
+    static Event pop()
+    {
+        Event top = heap[0];
+        Event last = heap[--heapSize];
+        uint32_t i = 0;
+        while (true)
+        {
+            uint32_t child = i * 2 + 1;
+            if (child >= heapSize) break;
+            if (child + 1 < heapSize && before(heap + child + 1, heap + child)) child++;
+            if (!before(heap + child, &last)) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = last;
+        return top;
+    }
+
+
+    void runUntil(Time end)
+    {
+        while (heapSize && heap[0].at <= end)
+        {
+            Event event = pop();
+            now = event.at;
+            eventCount++;
+            event.handler(event.obj, event.arg);
+        }
+        now = end;
+    }
+
+
+    void reset()
+    {
+        heapSize = 0;
+        nextSeq = 0;
+        now = 0;
+        eventCount = 0;
+    }
+
+
+    void seed(uint64_t value)
+    {
+        rngState = value * 0x9e3779b97f4a7c15ull + 1;
+    }
+
+
+    // xorshift64*
+    uint32_t random()
+    {
+        rngState ^= rngState >> 12;
+        rngState ^= rngState << 25;
+        rngState ^= rngState >> 27;
+        return (rngState * 0x2545f4914f6cdd1dull) >> 32;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+
+
+// Discrete event scheduler of the simulation. Nothing in here may use identifiers of the firmware
+// (Radio, DMA, IRQ, Clock...), because node.cpp renames those to keep both firmwares apart.
+namespace Sim
+{
+    // Global (base station) time in nanoseconds
+    typedef int64_t Time;
+    static const Time USEC = 1000;
+    static const Time MSEC = 1000 * USEC;
+    static const Time SEC = 1000 * MSEC;
+
+    typedef void (*EventHandler)(void* obj, uint32_t arg);
+
+    // Time of the event that is currently being processed
+    extern Time now;
+
+    // Number of events processed since the last reset
+    extern uint64_t eventCount;
+
+    // Run handler(obj, arg) at the given time. Events with the same time run in the order they were scheduled.
+    extern void schedule(Time at, EventHandler handler, void* obj, uint32_t arg);
+
+    // Process all events up to the given time (inclusive), then advance the clock to it
+    extern void runUntil(Time end);
+
+    // Drop all pending events and reset the clock
+    extern void reset();
+
+    // Deterministic pseudo random numbers for the simulation itself (the firmware has its own)
+    extern void seed(uint64_t value);
+    extern uint32_t random();
+}
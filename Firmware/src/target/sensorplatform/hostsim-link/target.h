@@ -0,0 +1,75 @@
+#pragma once
+
+// SensorPlatform Radio Link Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Tunables (simulation):
+// Simulated time per scenario from the first node booting until the measurement starts (usec)
+#define SIM_ASSOC_USEC 4000000
+// Simulated measurement duration per scenario (usec)
+#define SIM_MEASURE_USEC 10000000
+// Maximum simulated time to wait for the nodes to transmit their remaining data after the measurement (usec)
+#define SIM_DRAIN_USEC 5000000
+// Probability of losing a packet on its way to each receiving radio (in 1/1000)
+#define SIM_LOSS_PERMILLE 10
+// Time that every node spends out of range during the measurement of the outage scenario (usec)
+#define SIM_OUTAGE_USEC 1000000
+// RF channel parameters, as set up by the host software (see Client/measure.py)
+#define SIM_CHANNEL 70
+#define SIM_GUARD_BITS 32
+#define SIM_MIN_SLOTS 0
+#define SIM_BURST 1
+// Nodes boot at random times within this window (usec)
+#define SIM_BOOT_WINDOW_USEC 50000
+// Maximum frequency error of the uncalibrated sensor node oscillators (HSI48, in ppm)
+#define SIM_NODE_PPM 2500
+// Frequency change per sensor node oscillator trim step (in ppm)
+#define SIM_TRIM_STEP_PPM 1400
+// Maximum frequency error of the base station crystal (in ppm)
+#define SIM_RECEIVER_PPM 20
+// CPU time from an IRQ being raised to the first instruction of the handler that matters (nsec)
+#define SIM_NODE_IRQ_NSEC 2000
+#define SIM_RECEIVER_IRQ_NSEC 500
+// Bit times after the start of a packet at which the radio chip has latched its TX address
+#define SIM_TX_ADDRESS_LATCH_BITS 8
+// Minimum interval between NodeId assignments by the simulated host software (usec)
+#define SIM_ASSIGN_INTERVAL_USEC 200000
+// Delay from a NodeId assignment until the host software asks the receiver to poll the node (usec)
+#define SIM_POLL_INTERVAL_USEC 10000
+// Interval at which the host software polls nodes again that didn't answer yet (usec)
+#define SIM_REPOLL_INTERVAL_USEC 50000
+
+
+// The radio drivers of both firmwares are compiled into this program unmodified, each one in its own
+// translation unit which sees the configuration of its real target (node.cpp and receiver.cpp).
+// Everything else is built for the host.
+#if defined(SIM_NODE)
+
+#define RADIO_SPI_ALWAYS_ON
+#include "target/sensorplatform/multisensor/target.h"
+
+#elif defined(SIM_RECEIVER)
+
+#define RADIO_SPI_ALWAYS_ON
+#include "target/sensorplatform/receiver/target.h"
+
+#else
+
+#define GPIO_SUPPORT_FAST_MODE
+#include "cpu/host/target.h"
+
+#endif
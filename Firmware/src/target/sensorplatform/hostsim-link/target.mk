@@ -0,0 +1,8 @@
+NAME := hostsim-link
+$(TARGET): build/$(TARGET)/$(TYPE)/$(NAME).elf
+LISTINGS: build/$(TARGET)/$(TYPE)/$(NAME).elf.lst
+
+# The simulated firmware supplies its own timing functions, so cpu/host is not linked in
+LDFLAGS_GENERAL := $(filter-out -nostdlib,$(LDFLAGS_GENERAL)) -no-pie
+# Collects the simulated node firmware's variables in one block (see link.lds)
+LDSCRIPT := src/target/sensorplatform/hostsim-link/link.lds
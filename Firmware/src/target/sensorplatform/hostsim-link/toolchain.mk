@@ -0,0 +1,7 @@
+include src/cpu/host/toolchain.mk
+# Simulation speed matters more than code size here (appended flags override -Os).
+# Keep the compiler from turning the loops in the memset/memmove replacements of sys/util.cpp into calls to themselves.
+CFLAGS_RELEASE += -O2 -fno-tree-loop-distribute-patterns
+LDFLAGS_RELEASE += -O2
+# The node state blocks in link.lds are made up of the sections of node.o, which LTO would merge with everything else
+FLTO :=
@@ -0,0 +1,405 @@
+// SensorPlatform Base Station Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Replays synthetic sensor node buffer level traces against the receiver's dynamic slot scheduler,
+// and reports link utilization, measurement data latency and scheduler run time for 1-100 nodes.
+// Nodes announce their data rate in NoData packets like the firmware does, except where noted.
+// Everything is seeded deterministically, only the run time figures depend on the build machine.
+
+
+#include "global.h"
+#include "app/main.h"
+#include "sys/time.h"
+#include "sys/util.h"
+#include "../common/protocol/rfproto.h"
+#include "../receiver/scheduler.h"
+#include <stdio.h>
+#include <time.h>
+
+
+// Measurement data buffer size of a sensor node in pages (24 blocks of 17 pages, see multisensor/common.h)
+#define NODE_BUFFER_PAGES (24 * 17)
+// Number of radio transmission buffers of a sensor node (see multisensor/target.h)
+#define NODE_TX_BUFFERS 32
+// Number of frames that a node without pending data asks to be skipped for (see multisensor/storagetask.cpp)
+#define NODE_POLL_IN_FRAMES 16
+// Re-poll a node through a fixed slot assignment (like the host software would) if it wasn't heard for N frames
+#define NODE_REPOLL_FRAMES (4 * NODE_FRAME_LOSS_DISCONNECT)
+// Measurement data bits per page
+#define PAGE_BITS (sizeof(RF::Packet::Reply::MeasurementData::data) * 8)
+// Latency histogram size in frames (anything longer ends up in the last bucket)
+#define LATENCY_BUCKETS 1024
+
+
+namespace Sim
+{
+    struct Node
+    {
+        uint32_t rate;  // Average number of pages generated per frame (16.16 fixed point)
+        uint32_t bitrate;  // Data rate announced in NoData packets (bits/s)
+        uint32_t accu;  // Fractional page generation accumulator (16.16 fixed point)
+        uint16_t interval;  // Sensor sampling burst interval in frames
+        uint16_t start;  // Frame number at which the measurement starts
+        uint16_t phase;  // Frame offset of the bursts
+        uint16_t readPtr;  // Oldest page in the buffer
+        uint16_t used;  // Number of pages in the buffer
+        uint32_t lastHeard;  // Frame number of the last reply that was received from this node
+        uint32_t delivered;  // Number of pages that were received from this node
+        uint32_t lost;  // Number of pages that were overwritten due to this node's buffer overflowing
+        uint32_t genFrame[NODE_BUFFER_PAGES];  // Frame number that each buffered page was generated in
+    };
+
+    struct Result
+    {
+        uint64_t slotsAssigned;  // Slots assigned to nodes (not left for notifications)
+        uint64_t slotsData;  // Slots that carried measurement data
+        uint32_t framesFull;  // Frames in which all slots were assigned to nodes
+        uint64_t slotsActive;  // Slots that remained part of the frame after shortening it
+        uint64_t pagesGenerated;  // Pages that were generated by the nodes
+        uint64_t pagesLost;  // Pages that were overwritten due to node buffer overflow
+        uint64_t noData;  // NoData replies received (polling overhead)
+        uint64_t schedTotalNs;  // Accumulated run time of scheduler.assignSlots()
+        uint32_t schedMaxNs;  // Maximum run time of scheduler.assignSlots()
+        uint32_t schedOverBudget;  // Number of frames where assignSlots() exceeded SIM_BUDGET_USEC
+    };
+
+    static Scheduler scheduler;  // Slot assignment state of the simulated radio channel
+    static Node nodes[RF::MaxNode];
+    static uint32_t latency[LATENCY_BUCKETS];
+    static uint32_t nodeLatency[RF::MaxNode][LATENCY_BUCKETS];
+    static uint32_t randomState;
+
+
+    // Deterministic xorshift pseudo random number generator
+    static uint32_t random()
+    {
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        return randomState;
+    }
+
+
+    static uint64_t readNsecTimer()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ((uint64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+
+    // Find the frame latency that the given fraction (in 1/1000) of samples in a histogram doesn't exceed
+    static int percentile(const uint32_t* hist, int permille)
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++) total += hist[i];
+        if (!total) return -1;
+        uint64_t limit = (total * permille + 999) / 1000;
+        uint64_t sum = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++)
+            if ((sum += hist[i]) >= limit)
+                return i;
+        return LATENCY_BUCKETS - 1;
+    }
+
+
+    // Generate the measurement data pages that a node produces during a frame
+    static void generate(Node* node, uint32_t frame, Result* result, bool count)
+    {
+        if (frame < node->start || (frame + node->phase) % node->interval) return;
+        node->accu += node->rate * node->interval;
+        while (node->accu >= 0x10000)
+        {
+            node->accu -= 0x10000;
+            // If the buffer is full, the oldest page will be overwritten
+            if (node->used == NODE_BUFFER_PAGES)
+            {
+                if (++node->readPtr == NODE_BUFFER_PAGES) node->readPtr = 0;
+                node->used--;
+                if (count)
+                {
+                    result->pagesLost++;
+                    node->lost++;
+                }
+            }
+            int writePtr = node->readPtr + node->used++;
+            if (writePtr >= NODE_BUFFER_PAGES) writePtr -= NODE_BUFFER_PAGES;
+            node->genFrame[writePtr] = frame;
+            if (count) result->pagesGenerated++;
+        }
+    }
+
+
+    // Build the reply that a node sends in a slot that was assigned to it
+    static void reply(int nodeId, RF::Packet* packet, uint32_t frame, Result* result, bool count)
+    {
+        Node* node = nodes + nodeId - 1;
+        memset(packet, 0, sizeof(*packet));
+        packet->reply.header.nodeId = nodeId;
+        if (node->used)
+        {
+            // Send the oldest page and record its latency
+            uint32_t age = MIN(frame - node->genFrame[node->readPtr], LATENCY_BUCKETS - 1);
+            if (++node->readPtr == NODE_BUFFER_PAGES) node->readPtr = 0;
+            node->used--;
+            if (count)
+            {
+                latency[age]++;
+                nodeLatency[nodeId - 1][age]++;
+                node->delivered++;
+                result->slotsData++;
+            }
+            // Only pages that were already copied to a transmission buffer count as pending
+            packet->reply.header.bufferInfo.pendingPackets = MIN(31, MIN(node->used, NODE_TX_BUFFERS));
+        }
+        else
+        {
+            packet->reply.noData.messageId = RF::RID_NoData;
+            packet->reply.noData.pollInFrames = NODE_POLL_IN_FRAMES;
+            packet->reply.noData.bitrate = node->bitrate;
+            if (count) result->noData++;
+        }
+        packet->reply.header.bufferInfo.urgency = MIN(7, 7 * node->used / NODE_BUFFER_PAGES);
+    }
+
+
+    static void reset(uint32_t seed, Result* result)
+    {
+        memset(result, 0, sizeof(*result));
+        memset(nodes, 0, sizeof(nodes));
+        memset(latency, 0, sizeof(latency));
+        memset(nodeLatency, 0, sizeof(nodeLatency));
+        randomState = seed;
+        scheduler.reset(SIM_FRAME_USEC);
+    }
+
+
+    // Simulate the link with nodes (set up by the caller) producing measurement data
+    static void simulate(int nodeCount, Result* result)
+    {
+        RF::TimeSlotOwner fixedSlots[ARRAYLEN(((RF::Packet::SOF*)0)->slot)];
+        memset(fixedSlots, 0, sizeof(fixedSlots));
+        RF::Packet::SOF sof;
+        memset(&sof, 0, sizeof(sof));
+        RF::Packet packet;
+        for (uint32_t frame = 0; frame < SIM_WARMUP_FRAMES + SIM_FRAMES; frame++)
+        {
+            bool count = frame >= SIM_WARMUP_FRAMES;
+
+            // Nodes generate measurement data
+            for (int i = 0; i < nodeCount; i++) generate(nodes + i, frame, result, count);
+
+            // Host software polls nodes that haven't been heard from for a long time (or at all yet)
+            for (int i = 0, slot = 0; i < nodeCount && slot < (int)ARRAYLEN(fixedSlots); i++)
+                if (!frame || frame - nodes[i].lastHeard > NODE_REPOLL_FRAMES)
+                    fixedSlots[slot++].owner = i + 1;
+
+            // Receiver builds the SOF packet, the same way as Radio::sendSOF() does
+            int freeSlots = 0;
+            for (uint32_t i = 0; i < ARRAYLEN(sof.slot); i++)
+            {
+                uint8_t owner = fixedSlots[i].owner;
+                if (!owner)
+                {
+                    owner = RF::Address::Notify;
+                    freeSlots++;
+                }
+                sof.slot[i].owner = owner;
+                fixedSlots[i].owner = 0;
+            }
+            // The timeout is never hit here, to keep the results deterministic. Run time is reported instead.
+            uint64_t start = readNsecTimer();
+            scheduler.assignSlots(&sof, freeSlots, read_usec_timer() + 1000000);
+            uint32_t time = readNsecTimer() - start;
+            int active = scheduler.trimFrame(&sof, SIM_MIN_SLOTS);
+            uint8_t dropped[ARRAYLEN(sof.slot)];
+            scheduler.finishFrame(&sof, dropped);
+            int assigned = 0;
+
+            // Nodes reply in their assigned slots, some of the replies get lost
+            for (uint32_t i = 0; i < ARRAYLEN(sof.slot); i++)
+            {
+                int nodeId = sof.slot[i].owner;
+                if (nodeId == RF::Address::Notify || nodeId == RF::Address::FrameEnd) continue;
+                assigned++;
+                if (nodeId > nodeCount || (int)(random() % 1000) < SIM_LOSS_PERMILLE) continue;
+                reply(nodeId, &packet, frame, result, count);
+                nodes[nodeId - 1].lastHeard = frame;
+                scheduler.handleReply(&packet.reply);
+            }
+
+            if (!count) continue;
+            result->slotsAssigned += assigned;
+            result->slotsActive += active;
+            if (assigned == ARRAYLEN(sof.slot)) result->framesFull++;
+            result->schedTotalNs += time;
+            result->schedMaxNs = MAX(result->schedMaxNs, time);
+            if (time > SIM_BUDGET_USEC * 1000) result->schedOverBudget++;
+        }
+    }
+
+
+    // Set up the data rate of a node, and whether it announces it to the receiver. Like the host software does,
+    // the measurement is scheduled to start a bit later, so the node can announce the rate before sending data.
+    static void setRate(Node* node, uint32_t rate, bool announce)
+    {
+        node->rate = rate;
+        node->start = SIM_START_FRAMES;
+        node->bitrate = announce ? ((uint64_t)rate) * PAGE_BITS * 1000000 / (((uint64_t)SIM_FRAME_USEC) << 16) : 0;
+    }
+
+
+    // Run one scenario: nodeCount nodes producing a total of loadPercent of the channel capacity
+    static void run(int nodeCount, int loadPercent, Result* result)
+    {
+        reset(0x5eed0000 + nodeCount * 100 + loadPercent, result);
+        // Distribute the offered load across the nodes with random shares (1-8),
+        // and pick random sampling burst intervals (1-8 frames).
+        uint32_t share[RF::MaxNode];
+        uint32_t shareSum = 0;
+        for (int i = 0; i < nodeCount; i++) shareSum += (share[i] = 1 + random() % 8);
+        uint64_t capacity = ((uint64_t)ARRAYLEN(((RF::Packet::SOF*)0)->slot) << 16) * loadPercent / 100;
+        for (int i = 0; i < nodeCount; i++)
+        {
+            setRate(nodes + i, capacity * share[i] / shareSum, true);
+            nodes[i].interval = 1 + random() % 8;
+            nodes[i].phase = random() % nodes[i].interval;
+        }
+        simulate(nodeCount, result);
+    }
+
+
+    // Saturate the link with 100 nodes that have weights of 1x, 2x and 4x the default,
+    // and check that every slot gets used and that each node's throughput is proportional to its weight.
+    static bool checkFairness()
+    {
+        const int nodeCount = RF::MaxNode - RF::MinNode + 1;
+        Result result;
+        reset(0xfa112e55, &result);
+        for (int i = 0; i < nodeCount; i++)
+        {
+            setRate(nodes + i, 0x10000, false);
+            nodes[i].interval = 1;
+            scheduler.setNodeWeight(i + 1, SCHEDULER_DEFAULT_WEIGHT << (i % 3));
+        }
+        simulate(nodeCount, &result);
+        // Jain's fairness index of the weight-normalized throughput (1.0: perfectly fair)
+        double sum = 0, squareSum = 0;
+        for (int i = 0; i < nodeCount; i++)
+        {
+            double share = (double)nodes[i].delivered / (1 << (i % 3));
+            sum += share;
+            squareSum += share * share;
+        }
+        double fairness = sum * sum / (nodeCount * squareSum);
+        double full = 100. * result.framesFull / SIM_FRAMES;
+        bool pass = fairness >= 0.99 && result.framesFull == SIM_FRAMES;
+        printf("fairness check (%d saturated nodes, weights 1x/2x/4x): %.2f%% of frames fully assigned, "
+               "fairness index %.4f: %s\n", nodeCount, full, fairness, pass ? "PASS" : "FAIL");
+        return pass;
+    }
+
+
+    static void report(const char* name, int nodeCount, int loadPercent, const Result* result)
+    {
+        // Per-node latency percentiles: report the median node's p50 and the worst node's p99
+        int nodeP50[RF::MaxNode];
+        int worstP99 = -1;
+        int active = 0;
+        for (int i = 0; i < nodeCount; i++)
+        {
+            int p50 = percentile(nodeLatency[i], 500);
+            if (p50 < 0) continue;
+            int j = active++;
+            while (j && nodeP50[j - 1] > p50) nodeP50[j] = nodeP50[j - 1], j--;
+            nodeP50[j] = p50;
+            worstP99 = MAX(worstP99, percentile(nodeLatency[i], 990));
+        }
+        printf("%-6s %5d %4d%% %7.2f %8.2f %6.1f%% %7.2f %7.2f %6.2f%% %5d %5d %5d %5d %6d %8llu %8u %6u\n", name,
+               nodeCount, loadPercent, (double)result->slotsAssigned / SIM_FRAMES,
+               (double)result->slotsActive / SIM_FRAMES, 100. * result->framesFull / SIM_FRAMES,
+               (double)result->slotsData / SIM_FRAMES, (double)result->noData / SIM_FRAMES,
+               result->pagesGenerated ? 100. * result->pagesLost / result->pagesGenerated : 0.,
+               percentile(latency, 500), percentile(latency, 900), percentile(latency, 990),
+               active ? nodeP50[active / 2] : -1, worstP99,
+               (unsigned long long)(result->schedTotalNs / SIM_FRAMES), result->schedMaxNs, result->schedOverBudget);
+    }
+
+
+    // 20 nodes sampling a 3 axis 16 bit accelerometer at 1kHz each, with and without announcing their data rate,
+    // first on their own and then sharing the channel with 8 nodes that always have data to send (like when reading
+    // out their flash storage). With slot reservations in place, the IMU nodes may not lose any measurement data.
+    // Without them, they only get the same share of the channel as the saturated nodes, which is not enough.
+    static bool checkImuLoad()
+    {
+        const int nodeCount = 20;
+        const int bulkCount = 8;
+        const uint32_t bitrate = 3 * 16 * 1000;
+        uint32_t rate = (((uint64_t)bitrate) * SIM_FRAME_USEC << 16) / (PAGE_BITS * 1000000);
+        int load = 100 * rate * nodeCount / (ARRAYLEN(((RF::Packet::SOF*)0)->slot) << 16);
+        static const char* const names[2][2] = { { "imu-nr", "imu" }, { "mix-nr", "mix" } };
+        Result result;
+        bool pass = true;
+        uint64_t lost[2];
+        for (int bulk = 0; bulk < 2; bulk++)
+        {
+            for (int announce = 0; announce < 2; announce++)
+            {
+                reset(0x1e0a0000 + bulk * 2 + announce, &result);
+                for (int i = 0; i < nodeCount; i++)
+                {
+                    setRate(nodes + i, rate, announce);
+                    nodes[i].interval = 1;
+                }
+                for (int i = nodeCount; i < nodeCount + bulk * bulkCount; i++)
+                {
+                    setRate(nodes + i, 0x10000, false);
+                    nodes[i].interval = 1;
+                }
+                simulate(nodeCount + bulk * bulkCount, &result);
+                report(names[bulk][announce], nodeCount + bulk * bulkCount, load, &result);
+                lost[announce] = 0;
+                for (int i = 0; i < nodeCount; i++) lost[announce] += nodes[i].lost;
+            }
+            if (lost[1] || (bulk && !lost[0])) pass = false;
+        }
+        printf("IMU load check (%d nodes, %u bits/s each, %d saturated nodes): %llu pages lost without reservations, "
+               "%llu with: %s\n", nodeCount, bitrate, bulkCount, (unsigned long long)lost[0],
+               (unsigned long long)lost[1], pass ? "PASS" : "FAIL");
+        return pass;
+    }
+}
+
+
+int main()
+{
+    static const int nodeCounts[] = { 1, 2, 5, 10, 20, 50, 100 };
+    static const int loads[] = { 25, 50, 75, 90 };
+    printf("%d frames per scenario, %d slots per frame, %d/1000 reply loss, %dus scheduler budget\n",
+           SIM_FRAMES, (int)ARRAYLEN(((RF::Packet::SOF*)0)->slot), SIM_LOSS_PERMILLE, SIM_BUDGET_USEC);
+    printf("latencies in frames, scheduler run time in ns per frame, frames shortened to >= %d slots\n", SIM_MIN_SLOTS);
+    printf("       nodes  load  slots/f active/f   full  data/f nodata/f  lost%%   p50   p90   p99 nodep50 worstp99 sched-avg sched-max >budget\n");
+    for (uint32_t i = 0; i < ARRAYLEN(nodeCounts); i++)
+        for (uint32_t j = 0; j < ARRAYLEN(loads); j++)
+        {
+            Sim::Result result;
+            Sim::run(nodeCounts[i], loads[j], &result);
+            Sim::report("random", nodeCounts[i], loads[j], &result);
+        }
+    bool pass = Sim::checkImuLoad();
+    pass = Sim::checkFairness() && pass;
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// SensorPlatform Base Station Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+// Tunables (scheduler, keep in sync with receiver/target.h):
+// Maximum number of time slots to assign to a single NodeId (for dynamic slot assignment)
+#define MAX_SLOTS_PER_NODE 24
+// Dynamic slot assignment credit that a node gets per frame at urgency level 0 (1/16 slots, can be set per node)
+#define SCHEDULER_DEFAULT_WEIGHT 16
+// Maximum amount of credit (or debt) in slots that a node can carry over to later frames
+#define SCHEDULER_CREDIT_LIMIT 24
+// Extra slots reserved for nodes on top of their announced measurement data rate (in percent)
+#define SCHEDULER_RESERVE_HEADROOM 10
+// Number of notification slots to keep at the end of shortened frames (if the channel allows for those)
+#define FRAME_SPARE_SLOTS 2
+// Only offer one slot to a node if it has missed at least N frames
+#define NODE_FRAME_LOSS_SINGLESLOT 3
+// Kick a node from the channel if it has missed at least N frames
+#define NODE_FRAME_LOSS_DISCONNECT 50
+
+// Tunables (simulation):
+// Number of frames to simulate per scenario
+#define SIM_FRAMES 20000
+// Number of frames to simulate before starting to collect statistics
+#define SIM_WARMUP_FRAMES 500
+// Probability of losing a reply packet on the radio link (in 1/1000)
+#define SIM_LOSS_PERMILLE 10
+// Frame length in usec (2Mbit/s channel with 32 guard bits, as set up by the host software)
+#define SIM_FRAME_USEC 5524
+// Minimum number of slots per frame announced by the simulated channel (frames are shortened down to that)
+#define SIM_MIN_SLOTS 4
+// Number of frames between the nodes being connected and the measurement starting
+#define SIM_START_FRAMES 20
+// Time budget for slot assignment in the SOF packet preparation path (usec)
+#define SIM_BUDGET_USEC 50
+
+#include "cpu/host/target.h"
@@ -0,0 +1,187 @@
+// SensorPlatform SD Card Recording Pipeline Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Simulates the storage task's measurement data recording loop against an SD card model, once the way
+// it used to work (copy a block, calculate its checksum, then transfer it to the card and wait for that
+// to complete) and once pipelined (copy the next block while the previous one is being transferred by
+// DMA, calculate its checksum while the card is busy programming the previous one). Reports the
+// sustained SD write bandwidth and the highest measurement data rate that can be recorded without
+// losing any blocks (bufferOverflowLost stays zero), for various card busy times and CPU loads.
+// Higher CPU load (e.g. by the sensor task at high IMU sampling rates) stretches the storage task's
+// copy and checksum times, because it runs at a lower priority. The pipelined loop is also simulated
+// with the checksum calculated by the CRC unit fed by DMA, which only costs CPU time to start it and
+// to pick up the result, and runs while the previous transfer is being completed.
+
+
+#include "global.h"
+#include "app/main.h"
+#include "sys/util.h"
+#include <stdio.h>
+
+
+namespace Sim
+{
+    static const int BLOCK_SIZE = 17 * 28;  // Measurement data bytes per sector
+    static const double DMA_USEC = 512 * 8 * 1000.0 / SIM_SPI_KHZ;  // Sector transfer time
+
+    static int busyUsec;  // Card busy time after a sector (except for spikes)
+    static double copyUsec;  // Time needed to copy a block
+    static double crcUsec;  // Time needed to calculate a checksum
+    static double crcDMACPUUsec;  // CPU time needed for a DMA fed checksum calculation
+    static bool crcDMA;  // Whether checksums are calculated by the DMA fed CRC unit (pipelined only)
+
+
+    // Busy time of the card after writing a sector
+    static double busyTime(uint32_t sector)
+    {
+        if (sector % SIM_BUSY_SPIKE_PERIOD == SIM_BUSY_SPIKE_PERIOD - 1) return SIM_BUSY_SPIKE_USEC;
+        return busyUsec;
+    }
+
+
+    // Record SIM_SECTORS blocks, which are completed by the sensor task every interval usec
+    // (or are all available immediately if interval is zero), to the simulated SD card.
+    // Returns the number of lost blocks and stores the time needed in *duration.
+    static uint32_t run(bool pipelined, int ringBlocks, double interval, double* duration)
+    {
+        double t = 0;  // Storage task time
+        double cardFree = 0;  // Time at which the card leaves busy state
+        double dmaEnd = 0;  // Time at which the transfer in progress (pipelined) completes
+        bool writing = false;  // Whether a transfer is in progress (pipelined)
+        uint32_t sector = 0;
+        uint32_t lost = 0;
+        for (uint32_t k = 0; k < SIM_SECTORS; k++)
+        {
+            // Block k is completed at avail and overwritten by block k + ringBlocks from invalid on
+            double avail = interval * (k + 1);
+            double invalid = interval ? interval * (k + ringBlocks) : 1e300;
+            if (t < avail)
+            {
+                // Waiting for data, the pipelined loop completes the transfer in progress meanwhile
+                if (writing)
+                {
+                    t = MAX(t, dmaEnd);
+                    cardFree = t + busyTime(sector++);
+                    writing = false;
+                }
+                t = avail;
+            }
+            // Skip the block if it will be overwritten before we're done copying it
+            if (t + copyUsec > invalid)
+            {
+                lost++;
+                continue;
+            }
+            t += copyUsec;
+            if (!pipelined)
+            {
+                // Calculate checksum, wait for the card to be idle and transfer the sector
+                t += crcUsec;
+                t = MAX(t, cardFree) + SIM_SECTOR_OVERHEAD_USEC + DMA_USEC;
+                cardFree = t + busyTime(sector++);
+                continue;
+            }
+            if (crcDMA)
+            {
+                // Start the checksum calculation, it runs while the previous transfer is being completed
+                t += crcDMACPUUsec;
+                double crcEnd = t + SIM_CRC_DMA_USEC;
+                if (writing)
+                {
+                    t = MAX(t, dmaEnd);
+                    cardFree = t + busyTime(sector++);
+                }
+                t = MAX(t, crcEnd);
+            }
+            else
+            {
+                // Complete the previous transfer (the card starts programming), calculate
+                // the checksum meanwhile and start the transfer once the card is idle.
+                if (writing)
+                {
+                    t = MAX(t, dmaEnd);
+                    cardFree = t + busyTime(sector++);
+                }
+                t += crcUsec;
+            }
+            t = MAX(t, cardFree) + SIM_SECTOR_OVERHEAD_USEC;
+            dmaEnd = t + DMA_USEC;
+            writing = true;
+        }
+        if (writing) t = MAX(t, dmaEnd);
+        *duration = t;
+        return lost;
+    }
+
+
+    // Sustained write bandwidth in kB/s (measurement data bytes, unlimited data available)
+    static double bandwidth(bool pipelined)
+    {
+        double duration;
+        run(pipelined, 1, 0, &duration);
+        return SIM_SECTORS * (double)BLOCK_SIZE * 1000 / duration;
+    }
+
+
+    // Highest measurement data rate in kB/s that can be recorded without losing any blocks
+    static double maxLossless(bool pipelined, int ringBlocks)
+    {
+        double lo = 1, hi = 4000;
+        for (int i = 0; i < 30; i++)
+        {
+            double rate = (lo + hi) / 2;
+            double duration;
+            if (run(pipelined, ringBlocks, BLOCK_SIZE * 1000 / rate, &duration)) hi = rate;
+            else lo = rate;
+        }
+        return lo;
+    }
+}
+
+
+int main()
+{
+    printf("SPI at %d kHz, %d usec busy spike every %d sectors, bandwidth in kB/s\n",
+           SIM_SPI_KHZ, SIM_BUSY_SPIKE_USEC, SIM_BUSY_SPIKE_PERIOD);
+    printf("                    bandwidth                         max. lossless data rate\n");
+    printf("busy  load   serial pipelined  dma crc      serial(%d) pipelined(%d) pipelined(%d)  dma crc(%d)\n",
+           MAINBUF_BLOCK_COUNT_SERIAL, MAINBUF_BLOCK_COUNT_SERIAL, MAINBUF_BLOCK_COUNT, MAINBUF_BLOCK_COUNT);
+    static const int busyTimes[] = { 20, 100, 300, 1000 };
+    static const int loads[] = { 0, 50, 80 };
+    bool pass = true;
+    for (uint32_t b = 0; b < ARRAYLEN(busyTimes); b++)
+        for (uint32_t l = 0; l < ARRAYLEN(loads); l++)
+        {
+            Sim::busyUsec = busyTimes[b];
+            Sim::copyUsec = SIM_COPY_USEC * 100.0 / (100 - loads[l]);
+            Sim::crcUsec = SIM_CRC_USEC * 100.0 / (100 - loads[l]);
+            Sim::crcDMACPUUsec = SIM_CRC_DMA_CPU_USEC * 100.0 / (100 - loads[l]);
+            Sim::crcDMA = false;
+            double serial = Sim::bandwidth(false);
+            double pipelined = Sim::bandwidth(true);
+            double losslessSerial = Sim::maxLossless(false, MAINBUF_BLOCK_COUNT_SERIAL);
+            double losslessPipelinedSerial = Sim::maxLossless(true, MAINBUF_BLOCK_COUNT_SERIAL);
+            double losslessPipelined = Sim::maxLossless(true, MAINBUF_BLOCK_COUNT);
+            Sim::crcDMA = true;
+            double dma = Sim::bandwidth(true);
+            double losslessDMA = Sim::maxLossless(true, MAINBUF_BLOCK_COUNT);
+            // The pipelined loop must never be slower, neither must the DMA fed checksum calculation
+            if (pipelined < serial || dma < pipelined) pass = false;
+            printf("%4d  %3d%%  %7.1f %9.1f %8.1f  %14.1f %13.1f %13.1f %12.1f\n", busyTimes[b], loads[l], serial, pipelined,
+                   dma, losslessSerial, losslessPipelinedSerial, losslessPipelined, losslessDMA);
+        }
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// SensorPlatform SD Card Recording Pipeline Host Simulation
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Tunables (sensor node, same meaning as in multisensor/target.h):
+// Number of measurement data buffers with the serial and the pipelined recording loop.
+// (The pipelined one needs a second 512 byte sector buffer, which costs about one block.)
+#define MAINBUF_BLOCK_COUNT_SERIAL 24
+#define MAINBUF_BLOCK_COUNT 23
+
+// Tunables (SD card model):
+// SPI bus clock in kHz
+#define SIM_SPI_KHZ 24000
+// Time between two sectors that isn't spent on the data transfer or card busy state
+// (dummy byte, data token, DMA setup, CRC bytes, data response) in usec
+#define SIM_SECTOR_OVERHEAD_USEC 6
+// The card reports a much longer busy time every N sectors (e.g. when it needs to switch to a new erase block)
+#define SIM_BUSY_SPIKE_PERIOD 512
+#define SIM_BUSY_SPIKE_USEC 20000
+
+// Tunables (storage task):
+// CPU time needed to copy a block out of the measurement data buffer in usec (without any CPU load)
+#define SIM_COPY_USEC 12
+// CPU time needed to calculate a sector checksum in usec (without any CPU load)
+#define SIM_CRC_USEC 22
+// CPU time needed to start a DMA fed checksum calculation and to pick up its result in usec (without any CPU load)
+#define SIM_CRC_DMA_CPU_USEC 3
+// Duration of a DMA fed checksum calculation in usec (not affected by CPU load)
+#define SIM_CRC_DMA_USEC 13
+
+// Tunables (simulation):
+// Number of sectors to simulate per bandwidth measurement
+#define SIM_SECTORS 100000
+
+#include "cpu/host/target.h"
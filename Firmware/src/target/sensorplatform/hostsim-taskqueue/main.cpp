@@ -0,0 +1,176 @@
+// SensorPlatform Sensor Task Schedule Queue Host Benchmark
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Runs the sensor task's measurement loop (pop the next task, reschedule it one interval later)
+// for BENCH_SENSORS capture tasks against both the TaskQueue heap and the sorted linked list that
+// the sensor task used before. Checks that both yield exactly the same task order (which is what
+// the client software's schedule reconstruction relies on) and reports the cost per reschedule.
+// Schedules are seeded deterministically, only the run time figures depend on the build machine.
+
+
+#include "global.h"
+#include "app/main.h"
+#include "sys/time.h"
+#include "sys/util.h"
+#include "../multisensor/taskqueue.h"
+#include <stdio.h>
+#include <time.h>
+
+
+namespace Bench
+{
+    // Index of a benchmark task
+    static int indexOf(const SensorTask::ScheduledTask* task)
+    {
+        return (int)(intptr_t)task->arg;
+    }
+
+
+    // Reference implementation: Sorted singly linked list with linear insertion (O(n) per task)
+    class TaskList
+    {
+    public:
+        void clear()
+        {
+            first = NULL;
+        }
+
+        void insert(SensorTask::ScheduledTask* task)
+        {
+            SensorTask::ScheduledTask* prev;
+            SensorTask::ScheduledTask* t;
+            // Walk the list to find the insertion point (behind all tasks with the same time)
+            for (prev = NULL, t = first; t; prev = t, t = next[indexOf(t)])
+                if (TIME_AFTER(t->time, task->time))
+                    break;
+            next[indexOf(task)] = t;
+            if (prev) next[indexOf(prev)] = task;
+            else first = task;
+        }
+
+        SensorTask::ScheduledTask* pop()
+        {
+            SensorTask::ScheduledTask* task = first;
+            if (task) first = next[indexOf(task)];
+            return task;
+        }
+
+    private:
+        SensorTask::ScheduledTask* first;
+        SensorTask::ScheduledTask* next[BENCH_SENSORS];
+    };
+
+    static SensorTask::TaskQueue queue;
+    static TaskList list;
+    // Benchmark tasks (the task index is stored in the argument)
+    static struct Task : SensorTask::ScheduledTask
+    {
+        Task() : ScheduledTask(NULL, NULL) {}
+    } tasks[BENCH_SENSORS];
+    static int interval[BENCH_SENSORS];
+    static int offset[BENCH_SENSORS];
+    static uint16_t order[BENCH_RUNS];  // Task order produced by the reference implementation
+    static uint32_t randomState;
+
+
+    // Deterministic xorshift pseudo random number generator
+    static uint32_t random()
+    {
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+        return randomState;
+    }
+
+
+    static uint64_t readNsecTimer()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ((uint64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+
+    // Pick typical sampling intervals (lots of identical and harmonic ones, which causes ties).
+    // If worstCase is set, all tasks are due at the same time, so every reschedule has
+    // to go behind all other tasks (the longest possible list walk).
+    static void makeSchedule(int startTime, bool worstCase)
+    {
+        static const int intervals[] = { 250, 500, 1000, 1000, 2000, 5000, 10000, 100000, 1000000 };
+        for (int i = 0; i < BENCH_SENSORS; i++)
+        {
+            interval[i] = worstCase ? 1000 : intervals[random() % ARRAYLEN(intervals)];
+            offset[i] = startTime + (worstCase ? 0 : (random() % 4) * 125);
+        }
+    }
+
+
+    // Simulate the measurement loop. Records the task order if check is false, otherwise compares against it.
+    // Returns the run time per reschedule in nanoseconds, or a negative number if the task order didn't match.
+    template<typename Queue> static double run(Queue* q, bool check)
+    {
+        q->clear();
+        for (int i = 0; i < BENCH_SENSORS; i++)
+        {
+            tasks[i].time = offset[i];
+            q->insert(tasks + i);
+        }
+        uint64_t start = readNsecTimer();
+        for (int i = 0; i < BENCH_RUNS; i++)
+        {
+            SensorTask::ScheduledTask* task = q->pop();
+            task->time += interval[indexOf(task)];
+            q->insert(task);
+            if (check)
+            {
+                if (order[i] != indexOf(task))
+                {
+                    printf("mismatch after %d tasks: task %d instead of %d\n", i, indexOf(task), order[i]);
+                    return -1;
+                }
+            }
+            else order[i] = indexOf(task);
+        }
+        return (double)(readNsecTimer() - start) / BENCH_RUNS;
+    }
+
+
+    // Run a schedule through both implementations, returns whether the task order matched
+    static bool compare(const char* name, int startTime, bool worstCase)
+    {
+        makeSchedule(startTime, worstCase);
+        double listNs = run(&list, false);
+        double heapNs = run(&queue, true);
+        bool pass = heapNs >= 0;
+        printf("%-10s %8.1f %8.1f  %s\n", name, listNs, heapNs, pass ? "PASS" : "FAIL");
+        return pass;
+    }
+}
+
+
+int main()
+{
+    printf("%d tasks, %d reschedules per run, ns per reschedule\n", BENCH_SENSORS, BENCH_RUNS);
+    printf("schedule       list     heap\n");
+    for (int i = 0; i < BENCH_SENSORS; i++) Bench::tasks[i].arg = (void*)(intptr_t)i;
+    bool pass = true;
+    Bench::randomState = BENCH_SEED;
+    for (int i = 0; i < 4; i++) pass = Bench::compare("random", 0, false) && pass;
+    // Sample times wrap around during this one
+    pass = Bench::compare("wrap", 0x7fff0000, false) && pass;
+    pass = Bench::compare("worst", 0, true) && pass;
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// SensorPlatform Sensor Task Schedule Queue Host Benchmark
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Tunables (benchmark):
+// Number of sensor capture tasks to schedule
+#define BENCH_SENSORS 64
+// Number of task executions to simulate
+#define BENCH_RUNS 2000000
+// Seed of the schedule generator
+#define BENCH_SEED 0x7a5c0001
+
+#include "cpu/host/target.h"
@@ -0,0 +1 @@
+include src/cpu/host/toolchain.mk
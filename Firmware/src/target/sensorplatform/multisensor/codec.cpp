@@ -0,0 +1,100 @@
+// Sensor node measurement data compression
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "codec.h"
+#include "sys/util.h"
+
+
+namespace Codec
+{
+    // Begin building a new block in the specified buffer
+    void PackedEncoder::startBlock(uint32_t* block, uint32_t firstRecord)
+    {
+        data = block;
+        first = firstRecord;
+        records = 0;
+        // All predictors that were used in the previous block are invalid now
+        blockSeq++;
+        // Clear the block (put() only ORs bits in) and reserve space for the header
+        memset(data, 0, BLOCK_BITS / 8);
+        bits = HEADER_BITS;
+    }
+
+    // Append a record to the current block. Pass pred = NULL for Format_Raw sensors.
+    // Returns false (without touching the block) if the record doesn't fit anymore.
+    bool PackedEncoder::writeRecord(const uint16_t* words, int count, Predictor* pred)
+    {
+        uint16_t sample[MAX_RECORD_WORDS];
+        uint16_t code[MAX_RECORD_WORDS];
+        int width = 16;
+        if (pred)
+        {
+            // If the predictor was last used in an earlier block, predict from zero
+            if (pred->block != blockSeq)
+            {
+                memset(pred->prev, 0, sizeof(pred->prev));
+                pred->block = blockSeq;
+            }
+            // Zigzag encode the differences to the previous record (small magnitudes => small codes)
+            uint16_t all = 0;
+            for (int i = 0; i < count; i++)
+            {
+                sample[i] = (words[i] >> 8) | (words[i] << 8);
+                uint16_t delta = sample[i] - pred->prev[i];
+                code[i] = (delta << 1) ^ (0 - (delta >> 15));
+                all |= code[i];
+            }
+            // Determine the number of bits needed for the largest code (no CLZ instruction on Cortex-M0)
+            for (width = 0; all >> width; width++);
+            // The largest width code is used to denote 16 bits wide samples
+            if (width == MAX_WIDTH_CODE) width = 16;
+        }
+        // Check if the record still fits into this block
+        int size = count * width + (pred ? 4 : 0);
+        if (bits + size > BLOCK_BITS) return false;
+        if (pred)
+        {
+            // Write the width code and the codes, then remember the record for the next prediction
+            put(width > MAX_WIDTH_CODE ? MAX_WIDTH_CODE : width, 4);
+            for (int i = 0; i < count; i++) put(code[i], width);
+            memcpy(pred->prev, sample, count * sizeof(*sample));
+        }
+        else for (int i = 0; i < count; i++) put(words[i], 16);
+        records++;
+        return true;
+    }
+
+    // Fill in the block header, the block is ready to be stored/transmitted after this
+    void PackedEncoder::finishBlock()
+    {
+        data[0] |= records | (first << 16);
+        data[1] |= first >> 16;
+    }
+
+    // Append a value of the specified bit width (at most 16 bits) to the bit stream
+    void PackedEncoder::put(uint32_t value, int width)
+    {
+        if (!width) return;
+        int word = bits >> 5;
+        int shift = bits & 31;
+        data[word] |= value << shift;
+        // If the value straddles a word boundary, write the high bits to the next word
+        if (shift + width > 32) data[word + 1] |= value >> (32 - shift);
+        bits += width;
+    }
+}
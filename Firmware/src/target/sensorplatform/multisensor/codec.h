@@ -0,0 +1,76 @@
+#pragma once
+
+// Sensor node measurement data compression
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+
+
+// Packed measurement data stream format:
+// If at least one active sensor requests Format_Packed in its formatVersion field, the measurement data
+// blocks (17 pages, 476 bytes) following the series header no longer contain the plain concatenation of
+// all records. Instead, every block is a little endian bit stream (LSB of the first byte comes first):
+//     16 bits: Number of records in this block
+//     32 bits: Index of the first record of this block within the measurement (for resynchronization)
+//     For each record (in schedule order, sensors that didn't write any data are skipped):
+//         Format_Raw sensors: All words of the record (16 bits each)
+//         Format_Packed sensors: 4 bits sample width W (15 means 16), followed by every word of
+//         the record as a W bit zigzag encoded difference to the previous record of the same
+//         sensor within the same block (the first record of every block is relative to zero).
+//         The differences are calculated on the big endian interpretation of the words,
+//         because that's the byte order that the IMU delivers its samples in.
+// The remainder of the block is filled with zero bits.
+namespace Codec
+{
+    const int MAX_RECORD_WORDS = 8;  // Maximum number of words per record (telemetry sensor)
+
+    enum Format
+    {
+        Format_Raw = 0,  // Words are stored as they were captured
+        Format_Packed = 1,  // Delta + zigzag + bit packing (see above)
+    };
+
+    // Per-sensor prediction state for Format_Packed
+    struct Predictor
+    {
+        uint32_t block;  // Encoder block number that prev belongs to
+        uint16_t prev[MAX_RECORD_WORDS];  // Previous record of this sensor (byte swapped)
+    };
+
+    // Builds one packed measurement data block
+    class PackedEncoder
+    {
+    public:
+        static const int HEADER_BITS = 48;  // Bits used by the block header
+        static const int BLOCK_BITS = 17 * 28 * 8;  // Total size of a block in bits
+        static const int MAX_WIDTH_CODE = 15;  // Width code that denotes 16 bit wide samples
+
+        uint16_t records;  // Number of records written to the current block so far
+
+        void startBlock(uint32_t* block, uint32_t firstRecord);
+        bool writeRecord(const uint16_t* words, int count, Predictor* pred);
+        void finishBlock();
+
+    private:
+        uint32_t* data;  // Block that is currently being built
+        uint32_t first;  // Index of the first record of the current block
+        uint32_t blockSeq = 0;  // Number of blocks started so far (invalidates predictors)
+        int bits;  // Bit write pointer within the current block
+
+        void put(uint32_t value, int width);
+    };
+}
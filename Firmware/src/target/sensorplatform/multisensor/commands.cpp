@@ -34,7 +34,7 @@ namespace Commands
     {
         // Acquire a radio packet buffer for the response. If none is available,
         // handle the command later. Once a buffer is free we will be called again.
-        RF::Packet::Reply* reply = Radio::getFreeTxBuffer(0);
+        RF::Packet::Reply* reply = Radio::getFreeTxBuffer();
         if (!reply) return false;
         
         // Initialize response buffer with message type, command sequence number and result.
@@ -77,8 +77,9 @@ namespace Commands
                 // Copy the received data into the requested series header page
                 memcpy(&mainBuf.seriesHeader.info.page[cmd->header.arg],
                        cmd->writePage.data, sizeof(cmd->writePage.data));
-                // Flag series header as modified
-                StorageTask::seriesHeaderDirty = true;
+                // Flag series header page as modified
+                StorageTask::seriesHeaderModified(&mainBuf.seriesHeader.info.page[cmd->header.arg],
+                                                  sizeof(*mainBuf.seriesHeader.info.page));
                 // Copy data back to response (we will never reject any series header change)
                 memcpy(reply->readPage.data,
                        &mainBuf.seriesHeader.sensor[cmd->header.arg >> 2].page[cmd->header.arg & 3],
@@ -169,6 +170,9 @@ namespace Commands
                 mainBuf.seriesHeader.info.localTime = time;
                 mainBuf.seriesHeader.info.globalTime = cmd->startMeasurement.atGlobalTime;
                 mainBuf.seriesHeader.info.unixTime = cmd->startMeasurement.unixTime;
+                // Tell readers of the SD card how measurement data sectors are laid out
+                mainBuf.seriesHeader.info.sdLayout = StorageTask::SD_LAYOUT;
+                StorageTask::seriesHeaderModified(&mainBuf.seriesHeader.info, sizeof(mainBuf.seriesHeader.info));
                 // Save the series header to the SD card configuration area
                 StorageTask::saveSeriesHeader();
                 // Initialize lost packet counters
@@ -207,6 +211,34 @@ namespace Commands
             reply->stopMeasurement.sdWriteLost = StorageTask::bufferOverflowLost;
             break;
 
+        case RF::CID_StartReadback:  // Stream recorded measurement data back from the SD card
+            // If a readback is already running, this is probably a retransmission due to a lost
+            // response. Just retransmit the response (which was success) and ignore the request.
+            if (StorageTask::state == StorageTask::State_Download) reply->cmd.result = RF::Result_OK;
+            // Check if the sensor and storage tasks are ready to accept the request. The series header
+            // of the recording must be in the measurement data buffer, so we can't do this while measuring.
+            else if (!measuring && SensorTask::state == SensorTask::State_Idle
+                  && StorageTask::state == StorageTask::State_Idle)
+            {
+                // We can only read back recordings that use the current measurement data sector layout
+                if (mainBuf.seriesHeader.info.sdLayout != StorageTask::SD_LAYOUT)
+                    reply->cmd.result = RF::Result_InvalidArgument;
+                else
+                {
+                    StorageTask::startReadback(cmd->startReadback.firstBlock, cmd->startReadback.blockCount);
+                    reply->cmd.result = RF::Result_OK;
+                }
+            }
+            // The sensor or storage task is busy, reject the request and tell the client to try again later.
+            else reply->cmd.result = RF::Result_Busy;
+            break;
+
+        case RF::CID_StopReadback:  // Abort a running readback
+            // Report success whether a readback was running or not, like for CID_StopMeasurement.
+            StorageTask::stopReadback();
+            reply->cmd.result = RF::Result_OK;
+            break;
+
         case RF::CID_StartUpload:  // Put storage task into upload mode
             // Check if the sensor and storage tasks are ready to accept the request.
             if (SensorTask::state == SensorTask::State_Idle && StorageTask::state == StorageTask::State_Idle)
@@ -72,6 +72,8 @@ enum ErrorCode
     Error_SensorMainLoopInvalidState,  // Unexpected state machine state in sensor task main loop
     Error_SensorDetectNotIdle,  // Sensor detection requested but sensor task is busy
     Error_SensorStartMeasurementNotIdle,  // Measurement requested but sensor task is busy
+    Error_SensorTaskQueueOverflow,  // More ScheduledTasks pending than the sensor task queue can hold
+    Error_StorageStartReadbackNotIdle,  // Data readback requested but storage task is busy
 };
 
 // Sensor IDs within the sensor node
@@ -129,6 +131,7 @@ struct __attribute__((packed,aligned(4))) SeriesHeader
             uint32_t localTime;  // Begin microsecond time on recording node (32 bits)
             uint32_t globalTime;  // Begin microsecond time on base station (28 bits)
             uint64_t unixTime;  // Begin unix timestamp on client PC (in microseconds, 64 bits)
+            uint8_t sdLayout;  // SD card recording sector layout version (see StorageTask::SD_LAYOUT)
             // The rest of this structure is ignored by the sensor node firmware
             // and written via radio commands by the client software. It is omitted here.
         };
@@ -92,26 +92,17 @@ namespace Clock
         STM32_RTC_REGS.CR.d32 = CR.d32;
     }
 
-    // Trim local HSI48 oscillator based on captured remote timestamps.
-    // Will return true if the oscillator is with an accuracy window of
-    // maxDeviation across the last remoteDelta.
-    bool trim(int remoteDelta, int localDelta, int maxDeviation)
+    // Trim local HSI48 oscillator based on its frequency error relative to a remote reference (in ppm, positive: too fast).
+    // A trim step is about 0.14%, only trim beyond 0.1% so that a measurement error won't make us go back and forth.
+    // Will return true if the oscillator was trimmed.
+    bool trim(int ppm)
     {
-        // Trim if the oscillator is out by more than 833ppm
-        int error = (localDelta - remoteDelta) * 1200 / remoteDelta;
-        // If the error is huge, assume a bad measurement and don't trim.
-        if (error > 60 || error < -60) return false;
-        if (error)
-        {
-            // Trim HSI48
-            onFromPri0(STM32_CRS_CLOCKGATE);
-            if (error > 0) STM32_CRS_REGS.CR.b.TRIM--;
-            else STM32_CRS_REGS.CR.b.TRIM++;
-            offFromPri0(STM32_CRS_CLOCKGATE);
-            return false;
-        }
-        // Check if the error is within bounds
-        return ABS(localDelta - remoteDelta) < maxDeviation;
+        if (ppm >= -1000 && ppm <= 1000) return false;
+        onFromPri0(STM32_CRS_CLOCKGATE);
+        if (ppm > 0) STM32_CRS_REGS.CR.b.TRIM--;
+        else STM32_CRS_REGS.CR.b.TRIM++;
+        offFromPri0(STM32_CRS_CLOCKGATE);
+        return true;
     }
 
 }
@@ -26,7 +26,7 @@ namespace Clock
     extern void init();
     extern void disableWakeup();
     extern void setWakeupInterval(uint16_t interval);
-    extern bool trim(int remoteDelta, int localDelta, int maxDeviation);
+    extern bool trim(int ppm);
 
     // Return the current state of a clock gate
     inline bool __attribute__((always_inline)) getState(int clkgate)
@@ -49,20 +49,20 @@ namespace Clock
     // Turn on a clock to a peripheral with preemption lockout
     inline void __attribute__((always_inline)) onWithLock(int clkgate)
     {
-        volatile uint32_t* reg = &STM32_RCC_REGS.CLKGATES.d32[clkgate >> 5];
+        int index = clkgate >> 5;
         int bit = clkgate & 0x1f;
         __asm__ volatile("cpsid if");
-        *reg |= 1 << bit;
+        STM32_RCC_REGS.CLKGATES.d32[index] |= 1 << bit;
         __asm__ volatile("cpsie if");
     }
 
     // Turn off a clock to a peripheral with preemption lockout
     inline void __attribute__((always_inline)) offWithLock(int clkgate)
     {
-        volatile uint32_t* reg = &STM32_RCC_REGS.CLKGATES.d32[clkgate >> 5];
+        int index = clkgate >> 5;
         int bit = clkgate & 0x1f;
         __asm__ volatile("cpsid if");
-        *reg &= ~(1 << bit);
+        STM32_RCC_REGS.CLKGATES.d32[index] &= ~(1 << bit);
         __asm__ volatile("cpsie if");
     }
 
@@ -0,0 +1,80 @@
+// STM32F072 CRC unit driver (fed by DMA)
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Calculates the same checksums as crc32() (see lib/crc32/crc32.h), but the CRC unit is fed by a
+// memory-to-memory DMA transfer instead of the CPU. The DMA completion IRQ is raised once it is done,
+// so the caller can do something else (or yield) in the meantime. Only one checksum calculation
+// can be in progress at a time, and crc32() must not be used while one is.
+
+
+#include "global.h"
+#include "crc.h"
+#include "dma.h"
+#include "clock.h"
+#include "soc/stm32/crc32_regs.h"
+
+
+#define CRC_DMA_REGS STM32_DMA_STREAM_REGS(CRC_DMA_CONTROLLER, CRC_DMA_STREAM)
+
+
+namespace CRC
+{
+    // Memory to CRC data register, one word at a time. The MEM2MEM bit is set by start(),
+    // as the transfer isn't triggered by peripheral requests.
+    static const DMA::Config dmaCfg(CRC_DMA_PRIORITY, DMA::DIR_M2P, false,
+                                    DMA::TS_32BIT, true, DMA::TS_32BIT, false, true);
+
+    // Whether a checksum calculation is in progress
+    static volatile bool running;
+
+    // Start calculating the checksum of len bytes (a multiple of 4) at buf (word aligned).
+    // The buffer must not be modified until busy() returns false.
+    void start(const void* buf, uint32_t len)
+    {
+        // Reset the CRC unit to its initial value
+        Clock::onWithLock(STM32_CRC_CLOCKGATE);
+        union STM32_CRC_REG_TYPE::CR CR = { 0 };
+        CR.b.RESET = true;
+        STM32_CRC_REGS.CR.d32 = CR.d32;
+        // Feed the buffer to the CRC unit
+        running = true;
+        DMA::Config config = dmaCfg;
+        config.b.MEM2MEM = true;
+        DMA::setPeripheralAddr(&CRC_DMA_REGS, &STM32_CRC_REGS.DR);
+        DMA::startTransferWithLock(&CRC_DMA_REGS, config, (void*)buf, len / 4);
+    }
+
+    // Check whether the checksum calculation started by start() is still in progress
+    bool busy()
+    {
+        return running;
+    }
+
+    // Get the result of the checksum calculation (once busy() returns false) and release the CRC unit
+    uint32_t finish()
+    {
+        uint32_t crc = STM32_CRC_REGS.DR;
+        Clock::offWithLock(STM32_CRC_CLOCKGATE);
+        return crc;
+    }
+
+    // Handle DMA completion (called from DMA IRQ handler)
+    void handleDMACompletion()
+    {
+        DMA::clearIRQWithLock(CRC_DMA_CONTROLLER, CRC_DMA_STREAM);
+        running = false;
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+// STM32F072 CRC unit driver (fed by DMA)
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+
+
+namespace CRC
+{
+    extern void start(const void* buf, uint32_t len);
+    extern bool busy();
+    extern uint32_t finish();
+    extern void handleDMACompletion();
+}
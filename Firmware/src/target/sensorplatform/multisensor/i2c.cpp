@@ -63,20 +63,107 @@ void I2CBus::setTimeout(STM32::I2C::Timeout timeout)
     Clock::offWithLock(STM32_I2C_CLOCKGATE(index));
 }
 
-// Process an I2C bus transaction
+// Process an I2C bus transaction (blocks the sensor task until it has completed)
 enum I2C::Result I2CBus::txn(const I2C::Transaction* txn)
+{
+    Request req(txn, NULL, NULL);
+    submit(&req);
+    wait(&req);
+    return req.result;
+}
+
+// Queue an I2C bus transaction for asynchronous processing (called from sensor task).
+// The request's callback will be run by poll() once the transaction has finished.
+void I2CBus::submit(Request* req)
+{
+    req->next = NULL;
+    req->done = false;
+    req->queued = true;
+    enter_critical_section();
+    // Enable I2C interface clock gate if the queue was empty
+    if (!active)
+    {
+        Clock::onFromPri0(STM32_I2C_CLOCKGATE(index));
+        active = true;
+    }
+    // Append the request to the queue
+    if (firstReq) lastReq->next = req;
+    else firstReq = req;
+    lastReq = req;
+    // If no transaction is in progress, start this one right away.
+    // Otherwise the IRQ handler will start it as soon as the ones before it have finished.
+    if (!curReq)
+    {
+        curReq = req;
+        begin();
+    }
+    leave_critical_section();
+}
+
+// Wait until a request has completed and its callback has been run (called from sensor task)
+void I2CBus::wait(Request* req)
+{
+    while (true)
+    {
+        poll();
+        if (!req->queued) break;
+        SensorTask::yield();
+    }
+}
+
+// Abort a timed out transaction and run the callbacks of completed requests (called from sensor task)
+void I2CBus::poll()
+{
+    enter_critical_section();
+    if (curReq && TIMEOUT_EXPIRED(timeout))
+    {
+        // The timeout has expired and the transaction wasn't completed.
+        // If we noticed any error so far, report that. Otherwise report a timeout error.
+        if (error == ::I2C::RESULT_OK) error = ::I2C::RESULT_TIMEOUT;
+        // Reset the I2C peripheral in case the hardware has locked up.
+        resetline_assert(i2c_resetline[index], true);
+        udelay(1);
+        resetline_assert(i2c_resetline[index], false);
+        // Move on to the next request
+        finish();
+    }
+    leave_critical_section();
+
+    // Run callbacks in submission order
+    while (true)
+    {
+        enter_critical_section();
+        Request* req = firstReq;
+        if (req && req->done) firstReq = req->next;
+        else req = NULL;
+        // Turn off I2C interface clock gate once the queue has drained
+        if (!firstReq && active)
+        {
+            Clock::offFromPri0(STM32_I2C_CLOCKGATE(index));
+            active = false;
+        }
+        leave_critical_section();
+        if (!req) break;
+        req->queued = false;
+        if (req->callback) req->callback(req);
+    }
+}
+
+// Start processing the transaction of curReq (called with IRQs locked out)
+void I2CBus::begin()
 {
     volatile STM32_I2C_REG_TYPE* regs = &STM32_I2C_REGS(index);
-    
+    const I2C::Transaction* txn = curReq->txn;
+
     // Initialize state
     error = ::I2C::RESULT_OK;
     curTxn = txn;
     xfer = 0xff;
-    busy = true;
-    
-    // Enable I2C interface clock gate
-    Clock::onWithLock(STM32_I2C_CLOCKGATE(index));
-    
+
+    // A timeout (in 100us steps) can be specified in the transaction.
+    // If that is set to zero, a generous timeout of 10 seconds is applied as a fail-safe.
+    timeout = TIMEOUT_SETUP(100 * (txn->timeout ? txn->timeout : 100000));
+
     // Configure I2C interface in master mode
     union STM32_I2C_REG_TYPE::CR1 CR1 = { 0 };
     CR1.b.TCIE = true;  // Transfer completion interrupt enable
@@ -86,31 +173,24 @@ enum I2C::Result I2CBus::txn(const I2C::Transaction* txn)
     CR1.b.ERRIE = true;  // Error interrupt enable
     CR1.b.PE = true;  // Peripheral enable
     regs->CR1.d32 = CR1.d32;
-    
+
     // Start sending the first START condition
     start();
-    
-    // A timeout (in 100us steps) can be specified in the transaction.
-    // If that is set to zero, a generous timeout of 10 seconds is applied as a fail-safe.
-    int timeout = TIMEOUT_SETUP(100 * (txn->timeout ? txn->timeout : 100000));
-    
-    // Wait until the transaction completes or the timeout expires
-    while (busy && !TIMEOUT_EXPIRED(timeout)) SensorTask::yield();
-    
-    if (busy)
-    {
-        // The timeout has expired and the transaction wasn't completed.
-        // If we noticed any error so far, report that. Otherwise report a timeout error.
-        if (error == ::I2C::RESULT_OK) error = ::I2C::RESULT_TIMEOUT;
-        // Reset the I2C peripheral in case the hardware has locked up.
-        resetline_assert(i2c_resetline[index], true);
-        udelay(1);
-        resetline_assert(i2c_resetline[index], false);
-    }
-    
-    // Turn off I2C interface clock gate and return the result of the transaction
-    Clock::offWithLock(STM32_I2C_CLOCKGATE(index));
-    return error;
+}
+
+// Report the result of curReq and start the next transaction, if any (called with IRQs locked out)
+void I2CBus::finish()
+{
+    volatile STM32_I2C_REG_TYPE* regs = &STM32_I2C_REGS(index);
+    Request* req = curReq;
+    req->result = error;
+    req->done = true;
+    curReq = req->next;
+    // Wake up the sensor task, which will run the request's callback
+    IRQ::wakeSensorTask();
+    // Keep the bus busy if there are more requests, otherwise disable the I2C peripheral.
+    if (curReq) begin();
+    else regs->CR1.d32 = 0;
 }
 
 // Figure out how to handle the current transfer after moving to a new one
@@ -240,14 +320,8 @@ void I2CBus::irqHandler()
     // Clear the IRQ
     regs->ICR.d32 = ISR.d32;
     
-    if (!regs->ISR.b.BUSY)
-    {
-        // We have finished processing the transaction.
-        // Wake up the task blocking on it and disable the I2C peripheral.
-        busy = false;
-        regs->CR1.d32 = 0;
-        IRQ::wakeSensorTask();
-    }
+    // Check if we have finished processing the transaction
+    if (curReq && !regs->ISR.b.BUSY) finish();
 }
 
 I2CBus I2CBus::I2C1(0);
@@ -24,11 +24,33 @@
 
 class __attribute__((packed,aligned(4))) I2CBus final : public I2C::Bus
 {
+public:
+    // Asynchronous transaction request. Requests are processed back to back in submission order.
+    // A request (including its transaction and buffers) must stay valid until it has completed.
+    struct Request
+    {
+        const I2C::Transaction* txn;  // Transaction to be processed
+        void (*callback)(Request* req);  // Called from sensor task context after completion (may be NULL)
+        void* arg;  // Callback argument
+        Request* volatile next = NULL;  // Next request in the queue
+        volatile bool done = false;  // Whether the transaction has finished (result is valid)
+        bool queued = false;  // Whether the request was submitted and its callback hasn't been run yet
+        volatile ::I2C::Result result = ::I2C::RESULT_OK;  // Result of the transaction
+
+        constexpr Request(const I2C::Transaction* txn, void (*callback)(Request* req), void* arg)
+            : txn(txn), callback(callback), arg(arg) {}
+    };
+
+private:
     const uint8_t index;  // Which I2C interface number is controlled by this instance
     bool initialized = false;  // Whether the I2C interface has already been configured
+    bool active = false;  // Whether the interface clock is enabled (there are requests in the queue)
+    Request* volatile firstReq = NULL;  // Oldest request whose callback hasn't been run yet
+    Request* volatile curReq = NULL;  // Request which is in progress (owned by the IRQ handler)
+    Request* volatile lastReq = NULL;  // Most recently submitted request
     const ::I2C::Transaction* volatile curTxn = NULL;  // Transaction which is in progress
-    volatile bool busy = false;  // Whether a transaction is not completed yet
     volatile ::I2C::Result error = ::I2C::RESULT_OK;  // Result of the ongoing transaction
+    int timeout = 0;  // usec time at which the ongoing transaction will be aborted
     uint8_t xfer = 0;  // Which transfer within the transaction is currently in progress
     uint8_t* buf = NULL;  // Transfer buffer pointer (incremented after every byte)
     uint32_t totallen = 0;  // How many bytes are left before the next START/STOP
@@ -37,6 +59,8 @@ class __attribute__((packed,aligned(4))) I2CBus final : public I2C::Bus
     bool last = false;  // Whether the current transfer is the last one of the transaction
 
     constexpr I2CBus(int index) : index(index) {}
+    void begin();
+    void finish();
     void start();
     void advance();
     void advanceIfNecessary();
@@ -46,6 +70,9 @@ public:
     void setTiming(STM32::I2C::Timing timing);
     void setTimeout(STM32::I2C::Timeout timing);
     enum ::I2C::Result txn(const I2C::Transaction* txn);
+    void submit(Request* req);
+    void wait(Request* req);
+    void poll();
     void irqHandler();
 
     static I2CBus I2C1;
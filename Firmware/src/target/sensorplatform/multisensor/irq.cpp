@@ -24,6 +24,7 @@
 #include "soc/stm32/f0/rtc_regs.h"
 #include "sys/util.h"
 #include "driver/dma.h"
+#include "driver/crc.h"
 #include "i2c.h"
 #include "sd.h"
 #include "radio.h"
@@ -64,6 +65,7 @@ namespace IRQ
 
         // Storage interrupt priority class:
         irq_set_priority(dma1_stream2_3_dma2_stream1_2_IRQn, 2);  // SD card RX and TX DMA, storage task
+        irq_set_priority(dma1_stream1_IRQn, 2);  // CRC unit DMA
         irq_set_priority(rtc_IRQn, 2);  // RTC IRQ
 
         // Background task priority class:
@@ -75,6 +77,7 @@ namespace IRQ
         irq_enable(tim7_IRQn, true);  // Radio timer
         irq_enable(dma1_stream4_7_dma2_stream3_5_IRQn, true);  // Radio RX and TX DMA
         irq_enable(dma1_stream2_3_dma2_stream1_2_IRQn, true);  // SD card RX and TX DMA, storage task
+        irq_enable(dma1_stream1_IRQn, true);  // CRC unit DMA
         irq_enable(tim2_IRQn, true);  // Sensor task
         irq_enable(adc_comp_IRQn, true);  // ADC
         irq_enable(i2c1_IRQn, true);  // Internal I2C bus
@@ -111,6 +114,13 @@ extern "C" void dma1_stream4_7_dma2_stream3_5_irqhandler()  // Radio RX and TX D
     Radio::handleDMACompletion();
 }
 
+extern "C" void dma1_stream1_irqhandler()  // CRC unit DMA
+{
+    CRC::handleDMACompletion();
+    // The storage task is the only user of the CRC unit
+    IRQ::wakeStorageTask();
+}
+
 extern "C" void exti4_15_irqhandler()  // Radio IRQ, SD card idle IRQ
 {
     if (STM32::EXTI::getPending(PIN_RADIO_NIRQ)) Radio::handleIRQ();
@@ -76,6 +76,12 @@ namespace Radio
 
     // Beacon packet that describes the channel that we are a member of or trying to join
     static RF::Packet::Beacon beaconPacket;
+    // The channel that we joined last. Our node ID is only valid on that channel.
+    static RF::ChannelAttributes joinedChannel;
+    // How many more times we will look for SOF packets on that channel right after waking up (see startup)
+    static uint8_t rejoinAttempts;
+    // Whether we are currently doing that. We will fall back to listening for beacons only briefly then.
+    static bool rejoining;
 
     // The last received SOF packet
     static RF::Packet::SOF sofPacket;
@@ -89,8 +95,18 @@ namespace Radio
 
     // The time at which the reception of the previous SOF packet was completed
     static int previousFrameStartTime;
-    // Whether the previous SOF packet's timestamp is likely to be accurate (no interfering IRQs).
-    static bool previousFrameStartTimeAccurate;
+
+    // Clock synchronization state (see syncClock). Whether we have a reference point and a rate estimate:
+    static bool clockReference;
+    static bool clockLocked;
+    // Number of consecutive SOF packets that didn't arrive when we expected them
+    static uint8_t clockOutliers;
+    // Base station time (28 bits) and estimated local time (in 1/65536 microseconds) of the last SOF packet
+    static uint32_t syncRemoteTime;
+    static int syncLocalTime;
+    static uint16_t syncLocalFraction;
+    // Estimated rate of our microsecond timer relative to the base station's, minus one (in 1/2^24, positive: fast)
+    static int clockSkew;
 
     // If a radio IRQ is currently pending because it collided with a DMA transfer, this stores its timestamp.
     // Otherwise it is zero. This serves as a "packet download pending" flag. A timestamp of 0 will be incremented to 1.
@@ -113,18 +129,32 @@ namespace Radio
     static bool nodeIdChanged;
     // The local timestamp when out node ID will expire if we have no communication.
     static int nodeIdTimeout;
+    // Whether we need to tell the host that we are back after an outage, so that it polls us again
+    static bool nodeIdAnnounce;
 
     // Index of the buffers transmitted during the slots of the last frame
     static int8_t lastFrameTxBuf[28];
 
-    // Transmission buffers, will be used in unpredictable order. Contents are kept for retransmission until ACked.
+    // Command response transmission buffers. Contents are kept for retransmission until ACked.
     static RF::Packet::Reply txData[RADIO_TX_BUFFERS];
+    // Measurement data packets. These are transmitted straight out of mainBuf, so only the location
+    // of the page and its sequence number are kept here until the packet is ACKed.
+    static struct __attribute__((packed,aligned(2)))
+    {
+        uint16_t seq;  // Packet sequence number (high bit clear)
+        uint16_t blockSeq;  // Lower bits of the sequence number of the block, to detect that it was overwritten
+        uint8_t block;
+        uint8_t page;
+    } txPage[RADIO_TX_PAGES];
     static uint8_t txBufBeingRead;
     static uint8_t txBufBeingWritten;
+    static uint8_t txPageBeingWritten;
+    // Transmission state of the response buffers, followed by that of the measurement data packets.
+    // Transmissions will be picked in unpredictable order.
     static struct __attribute__((packed,aligned(1)))
     {
         uint8_t attemptsLeft : 8;
-    } txBufInfo[ARRAYLEN(txData)];
+    } txBufInfo[ARRAYLEN(txData) + ARRAYLEN(txPage)];
     // (At least) how many packets could currently be transmitted.
     static uint8_t txPending;
     // A rotating counter of enqueued TX packets, and its captured value at the last txPending counting time.
@@ -152,9 +182,17 @@ namespace Radio
     // The number of microseconds that our consecutive transmissions have
     // drifted ahead of the slot schedule due to guard bits.
     static uint8_t guardDrift;
+    // The slots of the current frame that continue a burst and don't have any guard bits (see RF::getBurstSlots)
+    static uint32_t burstSlots;
+    // Base station time (relative to the frame start) at which the slot of the next timer tick begins
+    static int nextSlotUsecs;
 
-    // The expected duration of a frame on the current channel
+    // The expected duration of the current frame
     static int frameUsecs;
+    // The shortest possible duration of a frame on the current channel
+    static int minFrameUsecs;
+    // The number of TX slots in the current frame
+    static int8_t frameSlots;
     // The required RX time after an SOF packet on the current channel
     static int cmdUsecs;
     // The offset until the beginning of TX slots after an SOF packet on the current channel
@@ -165,7 +203,8 @@ namespace Radio
     static int slotUsecs;
     // The maximum amount of clock deviation that we may accumulate in a frame without destroying adjacent slots
     static int maxJitterUsecs;
-    // Whether we are confident that out oscillator is within maxJitterUsecs across one frame duration
+    // Whether we are confident that our timing is within maxJitterUsecs across one frame duration
+    // (the clock synchronization loop predicted the last SOF packet that closely, see syncClock)
     static bool oscillatorAccurate;
 
     // Current radio configuration, switches between PTX and PRX mode
@@ -210,8 +249,10 @@ namespace Radio
     // How many consecutive times we have listened for beacon packets without success.
     uint8_t failedAssocAttempts;
 
-    // Delta between radio master and local microsecond timers
+    // Delta between radio master and local microsecond timers (as of the last SOF packet)
     int globalTimeOffset;
+    // Sub-microsecond part of that delta (in 1/65536 microseconds, to be added to globalTimeOffset)
+    uint16_t globalTimeOffsetFraction;
 
     // Current urgency level for transmission. Directly written by DPC code.
     uint8_t urgencyLevel;
@@ -256,6 +297,18 @@ namespace Radio
     }
 
 
+    // Initiate DMA radio packet upload from two parts: A short header is pushed into the SPI FIFO directly,
+    // while the DMA controller takes care of the (separately stored) remainder of the packet.
+    static void startPacketUpload(const void* header, size_t headerLen, void* data, size_t len)
+    {
+        GPIO::setLevelFast(PIN_RADIO_NCS, false);
+        SPI::pushByte(&RADIO_SPI_BUS, NRF::SPI::Cmd_WritePacket & 0xff);
+        for (size_t i = 0; i < headerLen; i++) SPI::pushByte(&RADIO_SPI_BUS, ((const uint8_t*)header)[i]);
+        DMA::startTransferFromPri0(&RADIO_DMA_TX_REGS, dmaTxCfg, data, len);
+        dmaActive = true;
+    }
+
+
     // Initiate DMA download of a received radio packet
     static void startPacketDownload(void* packet, size_t len)
     {
@@ -296,8 +349,9 @@ GPIO::setLevelFast(PIN_LED, false);
         Timer::start(&RADIO_TIMER, RADIO_TIMER_CLK, 48, 1000);
         currentSlot = -3;
 
-        nodeId = 0;
+        // Keep our node ID, we might find our channel again before it expires.
         connected = false;
+        rejoining = false;
         downloadImmediately = true;
         currentState = State_WaitForRx;
         operating = true;
@@ -374,6 +428,91 @@ GPIO::setLevelFast(PIN_LED, false);
     }
 
 
+    // Convert a duration (of up to ~65ms) from base station to local microseconds
+    static int toLocalUsecs(int usecs)
+    {
+        return usecs + ((usecs * (clockSkew >> 8)) >> 16);
+    }
+
+
+    // Clock synchronization: A second order (PI) loop tracks the rate and offset of our microsecond timer relative to
+    // the base station's, based on the base station timestamps in SOF packets and the times at which we received them.
+    // It filters out timestamp jitter, keeps predicting when SOF packets arrive if their timestamps are unreliable or
+    // some of them were missed, and decides whether our timing can be trusted enough to transmit during this frame.
+    // Called for every received SOF packet, replaces frameStartTime with the loop's estimate.
+    static void syncClock()
+    {
+        uint32_t remoteDelta = (sofPacket.info.time - syncRemoteTime) & 0xfffffff;
+        // Don't extrapolate for too long, our rate estimate isn't perfect.
+        if (!remoteDelta || remoteDelta > RADIO_CLOCK_HOLDOVER) clockReference = false;
+        if (!clockReference) clockLocked = false;
+        if (!clockLocked)
+        {
+            // We need two SOF packets with accurate timestamps for an initial rate estimate,
+            // and a third one to confirm it before we trust our timing.
+            oscillatorAccurate = false;
+            if (!frameStartTimeAccurate) return;
+            if (clockReference)
+            {
+                int error = frameStartTime - syncLocalTime - remoteDelta;
+                // If the error is huge (more than 5%), assume a bad measurement.
+                if (ABS(error) < (int)(remoteDelta / 20))
+                {
+                    clockSkew = (int)(((int64_t)error << 24) / remoteDelta);
+                    clockLocked = true;
+                    clockOutliers = 0;
+                }
+            }
+            clockReference = true;
+            syncRemoteTime = sofPacket.info.time;
+            syncLocalTime = frameStartTime;
+            syncLocalFraction = 0;
+            globalTimeOffset = syncRemoteTime - syncLocalTime;
+            globalTimeOffsetFraction = 0;
+            return;
+        }
+
+        // Figure out when this SOF packet should have arrived (relative to syncLocalTime, in 1/65536 microseconds).
+        int64_t expected = ((int64_t)remoteDelta << 16) + (((int64_t)remoteDelta * clockSkew) >> 8) + syncLocalFraction;
+        if (frameStartTimeAccurate)
+        {
+            int64_t error = ((int64_t)(frameStartTime - syncLocalTime) << 16) - expected;
+            if (error > -((int64_t)maxJitterUsecs << 16) && error < ((int64_t)maxJitterUsecs << 16))
+            {
+                // Proportional gain 1/4 and integral gain 1/64 per update, which is about critically damped.
+                expected += error >> 2;
+                clockSkew += ((int)error << 2) / (int)remoteDelta;
+                clockOutliers = 0;
+                oscillatorAccurate = true;
+            }
+            else
+            {
+                // Either the timestamp is off (despite looking good), or we lost track.
+                // Don't transmit anything during this frame, and start over if this keeps happening.
+                oscillatorAccurate = false;
+                if (++clockOutliers >= RADIO_CLOCK_OUTLIERS)
+                {
+                    clockReference = false;
+                    syncClock();
+                    return;
+                }
+            }
+        }
+        // If the timestamp was unreliable, we just go with the prediction.
+        syncRemoteTime = sofPacket.info.time;
+        syncLocalTime += (int)(expected >> 16);
+        syncLocalFraction = expected & 0xffff;
+        frameStartTime = syncLocalTime + (syncLocalFraction >> 15);
+        frameStartTimeAccurate = true;
+        globalTimeOffset = syncRemoteTime - syncLocalTime - !!syncLocalFraction;
+        globalTimeOffsetFraction = -syncLocalFraction;
+
+        // Keep the oscillator (which the sensor sampling rates depend on) close to its nominal frequency. Trimming it
+        // changes our clock rate by a step that isn't known precisely, so we need to acquire a new rate estimate afterwards.
+        if (Clock::trim(((clockSkew >> 6) * 15625) >> 12)) clockLocked = false;
+    }
+
+
     // Initiate joining the channel advertized by the buffered beacon packet, if it isn't blacklisted.
     // Expects the SPI bus to be powered up.
     static void tryJoinChannel()
@@ -396,8 +535,17 @@ GPIO::setLevelFast(PIN_LED, true);
         cmdUsecs = (cmdBits << beaconPacket.channelAttrs.speed) >> 1;
         offsetUsecs = (beaconPacket.channelAttrs.offsetBits << beaconPacket.channelAttrs.speed) >> 1;
         frameUsecs = offsetUsecs + slotUsecs * 28;
+        minFrameUsecs = offsetUsecs + slotUsecs * (beaconPacket.channelAttrs.minSlots ? beaconPacket.channelAttrs.minSlots : 28);
+        frameSlots = 28;
         maxJitterUsecs = (beaconPacket.channelAttrs.guardBits << beaconPacket.channelAttrs.speed) >> 2;
         oscillatorAccurate = false;
+        clockReference = false;
+        clockLocked = false;
+
+        // If we are coming back to the channel that we were a member of, we can keep our node ID (if it didn't expire).
+        if (beaconPacket.channelAttrs.channel != joinedChannel.channel || beaconPacket.channelAttrs.netId != joinedChannel.netId)
+            nodeId = 0;
+        joinedChannel = beaconPacket.channelAttrs;
 
         // Set up the TX pipe for reply transmission
         GPIO::setLevelFast(PIN_RADIO_NCS, false);
@@ -418,13 +566,34 @@ GPIO::setLevelFast(PIN_LED, true);
         GPIO::setLevelFast(PIN_RADIO_NCS, true);
 
         // Enable the pipes that we need: SOF (1), NotifyReply (2), Broadcast (4)
-        // Pipe 5 will be enabled once we are assigned an address on this channel.
-        writeReg(NRF::NRF24L01P::Reg_RxPipeEnable, NRF::NRF24L01P::RxPipeEnable(false, true, true, false, true, false).d8);
+        // Pipe 5 will be enabled once we are assigned an address on this channel, or right away if we still have one.
+        writeReg(NRF::NRF24L01P::Reg_RxPipeEnable, NRF::NRF24L01P::RxPipeEnable(false, true, true, false, true, !!nodeId).d8);
 
         // Wait for an SOF packet for ~250ms. If we don't get one, switch back to listening for beacon packets.
         currentSlot = 1800;
         currentState = State_WaitForRx;
-        failedAssocAttempts = 0;
+    }
+
+
+    // Check if the page that a measurement data packet refers to was overwritten (due to a buffer overflow).
+    static bool isTxPageOverwritten(uint32_t entry)
+    {
+        uint8_t block = txPage[entry].block;
+        return !mainBufValid[block] || (uint16_t)mainBufSeq[block] != txPage[entry].blockSeq;
+    }
+
+
+    // Check if a transmission buffer holds a packet that can be uploaded right now. While measuring, the oldest
+    // block in the buffer (the one after the block being written) may be overwritten as soon as the sensor task
+    // moves on, that might happen during the upload. Packets from that block have to wait (or will be dropped).
+    static bool isTxBufReady(uint32_t i)
+    {
+        if (!txBufInfo[i].attemptsLeft) return false;
+        if (i < ARRAYLEN(txData)) return true;
+        uint32_t entry = i - ARRAYLEN(txData);
+        if (isTxPageOverwritten(entry)) return false;
+        if (SensorTask::state != SensorTask::State_Measuring || seriesComplete) return true;
+        return SensorTask::writeSeq - mainBufSeq[txPage[entry].block] < ARRAYLEN(mainBuf.block) - 1;
     }
 
 
@@ -435,30 +604,50 @@ GPIO::setLevelFast(PIN_LED, true);
         if (frameStartTimeAccurate && oscillatorAccurate)
         {
             // Check if we want to transmit something in a future slot of this frame
-            for (uint32_t slot = nextTxSlot + 1; slot < ARRAYLEN(sofPacket.slot); slot++)
+            for (int slot = nextTxSlot + 1; slot < frameSlots; slot++)
             {
+                // On burst channels, our transmissions must not run into slots that don't continue a burst.
+                if (beaconPacket.channelAttrs.burst && nextTxSlot >= 0 && slot == nextTxSlot + 1
+                 && !((burstSlots >> slot) & 1)) continue;
                 // Is this slot reserved for us?
                 if (nodeId && sofPacket.slot[slot].owner == nodeId)
                 {
                     // Reset node ID timeout
                     nodeIdTimeout = frameStartTime + NODE_ID_TIMEOUT;
                     noDataResponse.telemetry.txAttemptCount++;
+                    // Pick the next pending transmission buffer. Usually there is one if txPending != 0, but a DataAck
+                    // command may have released buffers since the SOF packet, or the data may have been overwritten,
+                    // so don't scan more than once around.
+                    uint32_t i = txBufBeingRead;
+                    for (uint32_t n = 0; txPending && !isTxBufReady(i); n++)
+                    {
+                        if (++i >= ARRAYLEN(txBufInfo)) i = 0;
+                        if (n >= ARRAYLEN(txBufInfo)) txPending = 0;
+                    }
                     // Do we have something to transmit?
                     if (txPending)
                     {
-                        // Pick the next pending transmission buffer. If txPending != 0, there must be at least one.
-                        uint32_t i = txBufBeingRead;
-                        while (!txBufInfo[i].attemptsLeft)
-                            if (++i >= ARRAYLEN(txData))
-                                i = 0;
                         txBufBeingRead = i;
                         // Fill in packet header
-                        txData[i].header.nodeId = nodeId;
                         int p = --txPending + ((txSubmitCount - capturedTxSubmitCount) & 0xff);
-                        txData[i].header.bufferInfo = RF::Packet::Reply::Header::BufferInfo{(uint8_t)MIN(31, p),
-                                                                                            urgencyLevel};
-                        // Upload the packet
-                        startPacketUpload(txData + i, sizeof(*txData));
+                        RF::Packet::Reply::Header header = { nodeId, { (uint8_t)MIN(31, p), urgencyLevel } };
+                        // Upload the packet. Measurement data is sent straight from the measurement data buffer.
+                        if (i < ARRAYLEN(txData))
+                        {
+                            txData[i].header = header;
+                            startPacketUpload(txData + i, sizeof(*txData));
+                        }
+                        else
+                        {
+                            uint32_t entry = i - ARRAYLEN(txData);
+                            struct __attribute__((packed,aligned(2)))
+                            {
+                                RF::Packet::Reply::Header header;
+                                uint16_t seq;
+                            } head = { header, txPage[entry].seq };
+                            startPacketUpload(&head, sizeof(head),
+                                              &mainBuf.block[txPage[entry].block][txPage[entry].page], sizeof(Page));
+                        }
                         lastFrameTxBuf[slot] = i;
                         // The DMA completion IRQ handler will take care of the rest
                         currentState = State_UploadReply;
@@ -534,15 +723,21 @@ GPIO::setLevelFast(PIN_LED, true);
         Timer::acknowledgeIRQ(&RADIO_TIMER);
         RADIO_SPI_ON();
 
-        switch (++currentSlot)
+        // If the frame was shortened, skip the slots that aren't part of it and go straight to the frame end handling.
+        if (++currentSlot >= frameSlots - 1 && currentSlot < (int)ARRAYLEN(sofPacket.slot) - 1)
+            currentSlot = ARRAYLEN(sofPacket.slot) - 1;
+        switch (currentSlot)
         {
         case -1:
             // We are at the end of the last command slot. We need to sync up for the first packet transmission.
             // Sync up the timer to tick every time we need to assert CE in order to send a packet into a slot.
-            spiDeadline = frameStartTime + offsetUsecs - 157;
+            // Slot boundaries are converted to our local time based on the clock rate estimate (see syncClock).
+            nextSlotUsecs = offsetUsecs;
+            spiDeadline = frameStartTime + toLocalUsecs(nextSlotUsecs) - 157;
             Timer::updatePeriod(&RADIO_TIMER, spiDeadline + 10 - read_usec_timer());
             Timer::reset(&RADIO_TIMER);
-            Timer::updatePeriod(&RADIO_TIMER, slotUsecs);
+            Timer::updatePeriod(&RADIO_TIMER, toLocalUsecs(nextSlotUsecs + slotUsecs - ((burstSlots >> 1) & 1) * guardUsecs)
+                                            - toLocalUsecs(nextSlotUsecs));
             IRQ::clearRadioTimerIRQ();
             // Switch to TX mode, we already have a packet to be sent in the FIFO
             if (dmaActive) error(Error_RadioPTXDMACollision);
@@ -563,22 +758,34 @@ GPIO::setLevelFast(PIN_LED, true);
                 // We are transmitting a packet right now. Prepare the next one, if there is one.
                 if (dmaActive) error(Error_RadioPrepareNextTXDMACollision);
                 prepareNextTx();
-                // If the next transmission isn't in the next slot, or we need to re-lock our PLL to let some time slip,
-                // we need to tell the radio to stop after the current packet.
-                guardDrift += guardUsecs;
-                // The following values might need tweaking if there are problems with long packet sequences.
+                // If the next transmission isn't in the next slot, the radio will stop after the current packet anyway
+                // and re-lock its PLL for the next one. Only back-to-back packets accumulate drift, unless the channel
+                // is in burst mode, where those slots don't have any guard bits.
+                if (nextTxSlot != currentSlot + 1 || beaconPacket.channelAttrs.burst) guardDrift = 0;
+                else
+                {
+                    // If we need to re-lock our PLL to let some time slip, we need to tell the radio
+                    // to stop after the current packet.
+                    guardDrift += guardUsecs;
+                    // The following values might need tweaking if there are problems with long packet sequences.
 #ifdef DEBUG
-                if (guardDrift > 140)
+                    if (guardDrift > 140)
 #else
-                if (guardDrift > 150)
+                    if (guardDrift > 150)
 #endif
-                {
-                    guardDrift = 0;
-                    GPIO::setLevelFast(PIN_RADIO_CE, false);
+                    {
+                        guardDrift = 0;
+                        GPIO::setLevelFast(PIN_RADIO_CE, false);
+                    }
                 }
             }
             nextSlotCE = nextTxSlot == currentSlot + 1;
-            spiDeadline += slotUsecs;
+            // Slots that continue a burst are shorter by the guard time.
+            nextSlotUsecs += slotUsecs - ((burstSlots >> (currentSlot + 1)) & 1) * guardUsecs;
+            spiDeadline = frameStartTime + toLocalUsecs(nextSlotUsecs) - 157;
+            Timer::updatePeriod(&RADIO_TIMER, toLocalUsecs(nextSlotUsecs + slotUsecs
+                                                           - ((burstSlots >> (currentSlot + 2)) & 1) * guardUsecs)
+                                            - toLocalUsecs(nextSlotUsecs));
             break;
 
         case ARRAYLEN(sofPacket.slot) - 1:
@@ -587,7 +794,7 @@ GPIO::setLevelFast(PIN_LED, true);
             // Sync the timer to the actual transmission times in preparation for switching to PRX mode.
             // If we aren't sure about timing, start listening a bit early.
             // Set up the next timer tick for an SOF reception timeout.
-            spiDeadline = frameStartTime + frameUsecs - (frameStartTimeAccurate && oscillatorAccurate ? 20 : 300);
+            spiDeadline = frameStartTime + toLocalUsecs(frameUsecs) - (frameStartTimeAccurate && oscillatorAccurate ? 20 : 300);
             Timer::updatePeriod(&RADIO_TIMER, spiDeadline + 10 - read_usec_timer());
             Timer::reset(&RADIO_TIMER);
             Timer::updatePeriod(&RADIO_TIMER, 1000);
@@ -622,8 +829,9 @@ GPIO::setLevelFast(PIN_LED, true);
 
         case 2048:
             // The next SOF packet is massively overdue, apparently our base station has disappeared.
-            // Try to find another one by listening for beacon packets for about a second.
-            beaconTimeout = 1000;
+            // Try to find another one by listening for beacon packets for about a second. If we were just checking
+            // whether our last one is still there after waking up, keep the short timeout that startup() has set.
+            if (!rejoining) beaconTimeout = 1000;
             if (dmaActive) currentSlot = 2047;
             else enterBeaconListenMode();
             break;
@@ -681,6 +889,7 @@ GPIO::setLevelFast(PIN_LED, true);
                 // We got a beacon packet. Try to join the channel that it advertizes.
                 // If that fails, we will just wait for another one.
                 currentState = State_WaitForRx;
+                failedAssocAttempts = 0;
                 tryJoinChannel();
                 // Capture some entropy here...
                 Random::seed(Random::random() ^ read_usec_timer());
@@ -690,7 +899,10 @@ GPIO::setLevelFast(PIN_LED, true);
             {
                 // Check if we missed an SOF packet
                 bool consecutive = sofPacket.info.seq == ((lastSOFInfo.seq + 1) & 0xf)
-                                && !TIME_AFTER(frameStartTime, previousFrameStartTime + 12 * frameUsecs);
+                                && !TIME_AFTER(frameStartTime, previousFrameStartTime + 12 * minFrameUsecs);
+                // Update our clock rate estimate and figure out if we can trust our timing. This must happen before
+                // prepareNextTx(), timerTick() skips slots if it can't, which would shift an already scheduled transmission.
+                syncClock();
                 noDataResponse.telemetry.sofReceived++;
                 if (!frameStartTimeAccurate || !oscillatorAccurate) noDataResponse.telemetry.sofTimingFailed++;
                 if (!consecutive) noDataResponse.telemetry.sofDiscontinuity++;
@@ -720,8 +932,27 @@ GPIO::setLevelFast(PIN_LED, true);
                         nodeId = 0;
                         nodeIdChanged = true;
                     }
+                    // If we lost contact for a while, the base station will have given up polling us.
+                    // Tell the host that we are back (from the frame task), and keep track of the outage.
+                    else if (TIME_AFTER(frameStartTime, previousFrameStartTime + RADIO_REJOIN_GAP))
+                    {
+                        nodeIdAnnounce = true;
+                        noDataResponse.telemetry.rejoinCount++;
+                        noDataResponse.telemetry.rejoinMsecs += (frameStartTime - previousFrameStartTime) / 1000;
+                    }
                 }
+                // We are a member of this channel, it's worth coming back to it directly after sleeping.
+                rejoining = false;
+                rejoinAttempts = RADIO_REJOIN_ATTEMPTS;
+                failedAssocAttempts = 0;
                 memset(lastFrameTxBuf, -2, sizeof(lastFrameTxBuf));
+                // Figure out how many slots this frame has (the first FrameEnd slot ends it) and how long it will take.
+                frameSlots = 1;
+                while (frameSlots < (int)ARRAYLEN(sofPacket.slot)
+                    && sofPacket.slot[frameSlots].owner != RF::Address::FrameEnd) frameSlots++;
+                burstSlots = beaconPacket.channelAttrs.burst
+                           ? RF::getBurstSlots(&sofPacket, frameSlots, beaconPacket.channelAttrs.speed) : 0;
+                frameUsecs = offsetUsecs + slotUsecs * frameSlots - __builtin_popcount(burstSlots) * guardUsecs;
                 // Count how many packets we want to transmit
                 capturedTxSubmitCount = txSubmitCount;
                 txPending = 0;
@@ -735,19 +966,13 @@ GPIO::setLevelFast(PIN_LED, true);
                 currentSlot = -2;
                 // Set up the timer to wake us up right after the end of the last command slot.
                 downloadImmediately = false;
-                spiDeadline = frameStartTime + cmdUsecs - 25;
+                spiDeadline = frameStartTime + toLocalUsecs(cmdUsecs) - 25;
                 Timer::updatePeriod(&RADIO_TIMER, spiDeadline + 10 - read_usec_timer());
                 Timer::reset(&RADIO_TIMER);
                 IRQ::clearRadioTimerIRQ();
-                // Check oscillator accuracy and trim if necessary
-                if (consecutive && frameStartTimeAccurate && previousFrameStartTimeAccurate)
-                    oscillatorAccurate = Clock::trim((sofPacket.info.time - lastSOFInfo.time) & 0xfffffff,
-                                                     frameStartTime - previousFrameStartTime, maxJitterUsecs);
                 // Keep track of SOF packet timing and sequence numbers to check for frame loss.
                 lastSOFInfo = sofPacket.info;
                 previousFrameStartTime = frameStartTime;
-                previousFrameStartTimeAccurate = frameStartTimeAccurate;
-                if (frameStartTimeAccurate) globalTimeOffset = sofPacket.info.time - frameStartTime;
                 // Trigger FrameTask DPC
                 frameTaskRunning = true;
                 IRQ::setPending(IRQ::DPC_RadioFrameTask);
@@ -768,7 +993,7 @@ GPIO::setLevelFast(PIN_LED, true);
 
             case State_UploadReply:
                 // We just uploaded a reply packet, move to the next one.
-                if (++txBufBeingRead >= ARRAYLEN(txData)) txBufBeingRead = 0;
+                if (++txBufBeingRead >= ARRAYLEN(txBufInfo)) txBufBeingRead = 0;
                 currentState = State_WaitForRx;
                 break;
 
@@ -851,6 +1076,10 @@ GPIO::setLevelFast(PIN_LED, true);
     static uint8_t currentBlock;
     // The page index within the current block that will be transmitted next.
     static uint8_t currentPage;
+    // Whether the buffer is being filled with recorded data by the storage task instead of the sensor task.
+    static bool readback;
+    // Sequence number of the first page of block 0 (nonzero during readback).
+    static uint32_t pageBase;
 
 
     void init()
@@ -969,9 +1198,12 @@ GPIO::setLevelFast(PIN_LED, true);
         for (uint32_t i = 0; i < ARRAYLEN(txBufInfo); i++) txBufInfo[i].attemptsLeft = 0;
         for (uint32_t i = 0; i < ARRAYLEN(lastFrameTxBuf); i++) lastFrameTxBuf[i] = -1;
         notifyPending = 0;
+        nodeId = 0;
+        nodeIdAnnounce = false;
         dmaActive = false;
         pendingIRQTime = 0;
-        previousFrameStartTimeAccurate = false;
+        clockReference = false;
+        clockLocked = false;
         spiDeadline = read_usec_timer();
 
         // Start listening for beacon packets
@@ -979,17 +1211,31 @@ GPIO::setLevelFast(PIN_LED, true);
         beaconTimeout = 18;
         enterBeaconListenMode();
 
+        // If we were a member of a channel before sleeping, its base station is likely still there.
+        // Look for its SOF packets first, that's quicker than waiting for one of its beacons.
+        if (rejoinAttempts)
+        {
+            rejoinAttempts--;
+            connected = true;
+            RADIO_SPI_ON();
+            tryJoinChannel();
+            RADIO_SPI_OFF();
+            currentSlot = 2048 - RADIO_REJOIN_WINDOW;
+            rejoining = true;
+        }
+
         leave_critical_section();
     }
 
 
-    // Check if there is space in a transmission buffer, and if so, return a pointer for writing to an empty buffer.
-    RF::Packet::Reply* getFreeTxBuffer(int reserveSlots)
+    // Check if there is space in a response transmission buffer, and if so, return a pointer for writing to it.
+    RF::Packet::Reply* getFreeTxBuffer()
     {
+        // Scan every buffer once, starting after the last one that was handed out
         uint32_t i = txBufBeingWritten;
-        while (++i != txBufBeingWritten)
+        for (uint32_t n = 0; n < ARRAYLEN(txData); n++)
         {
-            if (i >= ARRAYLEN(txData) - reserveSlots) i = 0;
+            if (++i >= ARRAYLEN(txData)) i = 0;
             if (txBufInfo[i].attemptsLeft) continue;
             txBufBeingWritten = i;
             return txData + i;
@@ -998,7 +1244,7 @@ GPIO::setLevelFast(PIN_LED, true);
     }
 
 
-    // Enqueue the command written to the buffer (using getCommandBuffer)
+    // Enqueue the response written to the buffer (using getFreeTxBuffer)
     void enqueuePacket(int maxAttempts)
     {
         typeof(*txBufInfo) info;
@@ -1113,15 +1359,100 @@ GPIO::setLevelFast(PIN_LED, true);
         currentBlockSeq = 0;
         currentBlock = 0;
         currentPage = 0;
+        readback = false;
+        pageBase = 0;
+        seriesComplete = false;
+        measuring = true;
+    }
+
+
+    // Initiates the transmission of recorded measurement data, which the storage task reads back from the SD card
+    // into the buffer (starting at block 0). Packet sequence numbers start at firstPage. Completion is handled
+    // like for a measurement, but the storage task is woken up whenever buffer space was freed.
+    void startReadbackTransmission(uint32_t firstPage)
+    {
+        currentBlockSeq = 0;
+        currentBlock = 0;
+        currentPage = 0;
+        readback = true;
+        pageBase = firstPage;
+        Radio::noDataResponse.dataSeq = firstPage;
         seriesComplete = false;
         measuring = true;
     }
 
 
+    // Number of blocks that the readback transmission has finished with (their buffer space may be reused).
+    // Packets are transmitted straight from the buffer, so this excludes blocks with packets that weren't ACKed yet.
+    uint32_t readbackBlocksSent()
+    {
+        uint32_t sent = currentBlockSeq;
+        int oldest = 0;
+        // Entries enqueued while we are looking at them can only refer to the same or later blocks
+        for (uint32_t i = 0; i < ARRAYLEN(txPage); i++)
+            if (txBufInfo[ARRAYLEN(txData) + i].attemptsLeft)
+                oldest = MIN(oldest, (int16_t)(txPage[i].blockSeq - sent));
+        return sent + oldest;
+    }
+
+
+    // Check if there is space for another measurement data packet, and if so, return its index within txPage.
+    static int getFreeTxPage()
+    {
+        uint32_t i = txPageBeingWritten;
+        for (uint32_t n = 0; n < ARRAYLEN(txPage); n++)
+        {
+            if (++i >= ARRAYLEN(txPage)) i = 0;
+            if (txBufInfo[ARRAYLEN(txData) + i].attemptsLeft) continue;
+            txPageBeingWritten = i;
+            return i;
+        }
+        return -1;
+    }
+
+
+    // Free a transmission buffer before it was acknowledged by the per-slot ACK bits. Must be called with the radio
+    // IRQ handlers blocked. If the buffer was sent during the current frame, the ACK bit in the next SOF packet must
+    // not release it again (or be counted as an ACK), it might have been refilled by then.
+    static void releaseTxBuffer(uint32_t buf)
+    {
+        txBufInfo[buf].attemptsLeft = 0;
+        for (uint32_t slot = 0; slot < ARRAYLEN(lastFrameTxBuf); slot++)
+            if (lastFrameTxBuf[slot] == (int)buf)
+                lastFrameTxBuf[slot] = -2;
+    }
+
+
+    // Release measurement data packets that can't be sent anymore because the buffer overflowed and their data
+    // was overwritten. Returns whether there are any other packets left that weren't ACKed yet.
+    static bool releaseOverwrittenTxPages()
+    {
+        bool pending = false;
+        for (uint32_t i = 0; i < ARRAYLEN(txPage); i++)
+        {
+            // Block the radio IRQ handlers, they might be picking this buffer for transmission
+            enter_critical_section();
+            if (txBufInfo[ARRAYLEN(txData) + i].attemptsLeft)
+            {
+                if (!isTxPageOverwritten(i)) pending = true;
+                else
+                {
+                    releaseTxBuffer(ARRAYLEN(txData) + i);
+                    bufferOverflowLost++;
+                }
+            }
+            leave_critical_section();
+        }
+        return pending;
+    }
+
+
     // Advance to the next block in the measurement transmission buffer.
     static void nextBlock()
     {
-        bufferOverflowLost += ARRAYLEN(*mainBuf.block) - currentPage;
+        // Blocks skipped during readback weren't recorded, that loss was accounted for already
+        if (readback) IRQ::wakeStorageTask();
+        else bufferOverflowLost += ARRAYLEN(*mainBuf.block) - currentPage;
         if (++currentBlock >= ARRAYLEN(mainBuf.block)) currentBlock = 0;
         currentBlockSeq++;
         currentPage = 0;
@@ -1140,25 +1471,38 @@ GPIO::setLevelFast(PIN_LED, true);
             lastIdentAttempt = now;
             sendNodeIdNotification();
         }
+        // Or to announce the one that we have, after an outage
+        else if (nodeId && nodeIdAnnounce && getNotificationBuffer())
+        {
+            nodeIdAnnounce = false;
+            sendNodeIdNotification();
+        }
 
         // Check if we have measurement data to send
         if (measuring)
         {
+            bool inFlight = releaseOverwrittenTxPages();
+            // Packets may have been ACKed, freeing up buffer space for the storage task
+            if (readback) IRQ::wakeStorageTask();
             while (true)
             {
-                urgencyLevel = MIN(7, 7 * (SensorTask::writeSeq - currentBlockSeq) / ARRAYLEN(mainBuf.block));
-                RF::Packet::Reply* reply = getFreeTxBuffer(RADIO_TX_BUFFER_RESERVE);
+                // Readback isn't bound to a schedule, use as many slots as we can get
+                if (readback) urgencyLevel = 7;
+                else urgencyLevel = MIN(7, 7 * (SensorTask::writeSeq - currentBlockSeq) / ARRAYLEN(mainBuf.block));
+                int entry = getFreeTxPage();
                 // No transmission buffer space available
-                if (!reply) break;
+                if (entry < 0) break;
                 // No untransmitted data available
                 if (mainBufSeq[currentBlock] < currentBlockSeq)
                 {
-                    if (seriesComplete)
+                    // Once all data was sent and ACKed, the buffer may be reused
+                    if (seriesComplete && !inFlight)
                     {
                         measuring = false;
                         Radio::noDataResponse.bitrate = 0;
                         Radio::noDataResponse.dataSeq = 0;
-                        IRQ::wakeSensorTask();
+                        if (readback) IRQ::wakeStorageTask();
+                        else IRQ::wakeSensorTask();
                     }
                     break;
                 }
@@ -1168,18 +1512,16 @@ GPIO::setLevelFast(PIN_LED, true);
                     nextBlock();
                     continue;
                 }
-                // Grab a copy of the data to be sent
-                memcpy(reply->measurementData.data, &mainBuf.block[currentBlock][currentPage], sizeof(Page));
-                // Check if the buffer overflowed while we were copying the packet
-                if (!mainBufValid[currentBlock] || mainBufSeq[currentBlock] != currentBlockSeq)
-                {
-                    nextBlock();
-                    continue;
-                }
-                reply->measurementData.seq = (currentBlockSeq * ARRAYLEN(*mainBuf.block) + currentPage) & 0x7fff;
-                enqueuePacket(TX_ATTEMPTS_DATA);
+                // Enqueue the page, it will be sent from where it is (and dropped if it gets overwritten)
+                txPage[entry].seq = (pageBase + currentBlockSeq * ARRAYLEN(*mainBuf.block) + currentPage) & 0x7fff;
+                txPage[entry].blockSeq = currentBlockSeq;
+                txPage[entry].block = currentBlock;
+                txPage[entry].page = currentPage;
+                txBufInfo[ARRAYLEN(txData) + entry].attemptsLeft = TX_ATTEMPTS_DATA;
+                txSubmitCount++;
+                inFlight = true;
                 if (++currentPage >= ARRAYLEN(*mainBuf.block)) nextBlock();
-                Radio::noDataResponse.dataSeq = currentBlockSeq * ARRAYLEN(*mainBuf.block);
+                Radio::noDataResponse.dataSeq = pageBase + currentBlockSeq * ARRAYLEN(*mainBuf.block);
             }
         }
 
@@ -1187,6 +1529,33 @@ GPIO::setLevelFast(PIN_LED, true);
     }
 
 
+    // Release the transmission buffers of measurement data packets acknowledged by a data acknowledgement broadcast.
+    // This allows us to free them even if we missed the SOF packet with the corresponding per-slot ACK bits.
+    static void handleDataAck(const RF::Packet::Command::DataAck* ack)
+    {
+        if (!nodeId) return;
+        for (int e = 0; e < MIN(ack->header.arg, (int)ARRAYLEN(ack->entry)); e++)
+        {
+            if (ack->entry[e].nodeId != nodeId) continue;
+            for (uint32_t i = ARRAYLEN(txData); i < ARRAYLEN(txBufInfo); i++)
+            {
+                // Block the radio IRQ handlers, they might be picking buffers for transmission or processing ACK bits.
+                // This is done for each buffer separately to avoid disturbing slot timing.
+                enter_critical_section();
+                // Only measurement data packets are covered.
+                uint32_t behind = (ack->entry[e].seq - txPage[i - ARRAYLEN(txData)].seq) & 0x7fff;
+                if (txBufInfo[i].attemptsLeft
+                 && (!behind || (behind <= 32 && ((ack->entry[e].bitmap >> (behind - 1)) & 1))))
+                {
+                    releaseTxBuffer(i);
+                    noDataResponse.telemetry.txAckCount++;
+                }
+                leave_critical_section();
+            }
+        }
+    }
+
+
     // This function is called after receiving one or more command, notifyReply or broadcast packets.
     // If further packets arrive while it executes, it will be re-run after it returns.
     void dpcCommandHandler()
@@ -1222,6 +1591,12 @@ GPIO::setLevelFast(PIN_LED, true);
                 break;
 
             case 4:  // Broadcast
+                if (packet->cmd.header.cmd == RF::CID_DataAck)
+                {
+                    handleDataAck(&packet->cmd.dataAck);
+                    break;
+                }
+                // Fall through
             case 5:  // Command
                 release = Commands::handlePacket(&packet->cmd);
                 break;
@@ -28,6 +28,7 @@ namespace Radio
     extern bool connected;
     extern uint8_t failedAssocAttempts;
     extern int globalTimeOffset;
+    extern uint16_t globalTimeOffsetFraction;
     extern RF::Packet::Reply::NoData noDataResponse;
     extern bool measuring;
     extern bool seriesComplete;
@@ -39,10 +40,12 @@ namespace Radio
     extern void handleDMACompletion();
     extern void handleIRQ();
     extern void timerTick();
-    extern RF::Packet::Reply* getFreeTxBuffer(int reserveSlots);
+    extern RF::Packet::Reply* getFreeTxBuffer();
     extern void enqueuePacket(int maxAttempts);
     extern void sharedSPITransfer(GPIO::Pin pin, uint8_t prescaler, const void* txBuf, void* rxBuf, uint8_t len);
     extern void startMeasurementTransmission();
+    extern void startReadbackTransmission(uint32_t firstPage);
+    extern uint32_t readbackBlocksSent();
     extern void dpcFrameTask();
     extern void dpcCommandHandler();
 }
@@ -0,0 +1,51 @@
+// Sensor node measurement record queue
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "recordqueue.h"
+
+
+namespace SensorTask
+{
+    // Remove all records from the queue
+    void RecordQueue::clear()
+    {
+        first = 0;
+        count = 0;
+    }
+
+    // Append an empty, not yet ready record to the queue, returns NULL if the queue is full
+    Record* RecordQueue::open(Sensor* sensor)
+    {
+        if (count >= CAPACITY) return NULL;
+        int index = first + count++;
+        if (index >= CAPACITY) index -= CAPACITY;
+        Record* record = ring + index;
+        record->sensor = sensor;
+        record->words = 0;
+        record->ready = false;
+        return record;
+    }
+
+    // Remove the oldest record from the queue (after it was returned by peek())
+    void RecordQueue::drop()
+    {
+        if (!count) return;
+        count--;
+        if (++first >= CAPACITY) first = 0;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// Sensor node measurement record queue
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "sys/util.h"
+#include "codec.h"
+
+
+class Sensor;
+
+namespace SensorTask
+{
+    // A measurement record (the words captured by one execution of a ScheduledTask)
+    struct Record
+    {
+        Sensor* sensor;  // Sensor that the capturing ScheduledTask belongs to
+        uint8_t words;  // Number of words captured so far
+        bool ready;  // Whether capturing is complete (asynchronous captures complete later)
+        uint16_t data[Codec::MAX_RECORD_WORDS];  // Captured words
+
+        void write(uint16_t word)
+        {
+            if (words < (int)ARRAYLEN(data)) data[words++] = word;
+        }
+    };
+
+    // Ring buffer of records in schedule order. A record can only leave the queue once it and
+    // all records before it are ready, so that asynchronous captures (see I2CBus::submit) which
+    // complete late still end up at their scheduled position in the measurement data stream.
+    // (The client software relies on the schedule order to figure out which record belongs to which sensor.)
+    class RecordQueue
+    {
+    public:
+        static const int CAPACITY = SENSOR_RECORD_QUEUE_SIZE;
+
+        void clear();
+        Record* open(Sensor* sensor);
+        Record* peek() { return count && ring[first].ready ? ring + first : NULL; }
+        void drop();
+        bool empty() const { return !count; }
+
+    private:
+        Record ring[CAPACITY];
+        uint8_t first = 0;  // Index of the oldest record
+        uint8_t count = 0;  // Number of records in the queue
+    };
+}
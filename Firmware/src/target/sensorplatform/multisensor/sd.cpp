@@ -163,8 +163,8 @@ namespace SD
         return true;
     }
 
-    // Send data block to card (run from storage task)
-    static bool writeBlock(void* buf, int len, uint8_t token)
+    // Start sending a data block to the card, finishBlock() must be called afterwards (run from storage task)
+    static bool startBlock(void* buf, int len, uint8_t token)
     {
         // Dummy byte required by standard
         SPI::pushByte(&SD_SPI_BUS, 0xff);
@@ -172,10 +172,16 @@ namespace SD
         if (!waitIdle()) return false;
         // Transmit data token
         SPI::pushByte(&SD_SPI_BUS, token);
+        // Initiate DMA transfer
+        if (len) DMA::startTransferWithLock(&SD_DMA_TX_REGS, dmaTxCfg, buf, len);
+        return true;
+    }
+
+    // Complete sending a data block to the card (run from storage task)
+    static bool finishBlock(int len)
+    {
         if (len)
         {
-            // Initiate DMA transfer
-            DMA::startTransferWithLock(&SD_DMA_TX_REGS, dmaTxCfg, buf, len);
             // Wait for DMA transfer to complete
             while (!DMA::checkIRQ(SD_DMA_TX_CONTROLLER, SD_DMA_TX_STREAM)) StorageTask::yield();
             DMA::clearIRQWithLock(SD_DMA_TX_CONTROLLER, SD_DMA_TX_STREAM);
@@ -191,6 +197,12 @@ namespace SD
         return true;
     }
 
+    // Send data block to card (run from storage task)
+    static bool writeBlock(void* buf, int len, uint8_t token)
+    {
+        return startBlock(buf, len, token) && finishBlock(len);
+    }
+
     // Deselect the SD card
     static void finishCommand()
     {
@@ -382,10 +394,19 @@ namespace SD
         if (sendCmd(25, page) != 0) error(Error_SDWriteMultipleCmd);
     }
 
-    // Write a block in streaming write mode (run from storage task, for measurement recording)
-    void writeSector(void* buf)
+    // Start writing a block in streaming write mode (run from storage task, for measurement recording).
+    // Waits for the card to finish programming the previous block, then starts a DMA transfer of buf and
+    // returns. The buffer must not be modified until finishSector() has been called.
+    void startSector(void* buf)
+    {
+        if (!startBlock(buf, 512, 0xfc)) error(Error_SDWriteMultipleXfer);
+    }
+
+    // Complete writing the block passed to startSector() (run from storage task, for measurement recording).
+    // The card will be busy programming it afterwards, but that doesn't block the storage task.
+    void finishSector()
     {
-        if (!writeBlock(buf, 512, 0xfc)) error(Error_SDWriteMultipleXfer);
+        if (!finishBlock(512)) error(Error_SDWriteMultipleXfer);
     }
 
     // Finish streaming write (run from storage task, for measurement recording)
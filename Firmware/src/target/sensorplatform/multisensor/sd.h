@@ -29,7 +29,8 @@ namespace SD
     extern void read(uint32_t page, uint32_t len, void* buf);
     extern void write(uint32_t page, uint32_t len, void* buf);
     extern void startWrite(uint32_t page, uint32_t len);
-    extern void writeSector(void* buf);
+    extern void startSector(void* buf);
+    extern void finishSector();
     extern void endWrite();
     extern void erase(uint32_t page, uint32_t len);
     extern uint32_t prepareUpgrade(uint32_t page);
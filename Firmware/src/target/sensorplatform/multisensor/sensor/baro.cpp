@@ -20,6 +20,7 @@
 #include "sys/util.h"
 #include "../common.h"
 #include "../i2c.h"
+#include "../recordqueue.h"
 
 
 namespace Baro
@@ -39,6 +40,30 @@ namespace Baro
     PressureSensor pressureSensor(SensorId_BaroPressure);
     bool highres;  // Whether or not to record 24-bit samples (instead of 16-bit)
 
+    // Asynchronous sample readout (see PressureSensor::capture)
+    static const uint8_t sampleReg = 0xf7;  // First measurement value register
+    static struct __attribute__((packed,aligned(2)))
+    {
+        uint16_t pressHigh;
+        uint8_t pressLow;
+        uint16_t tempHigh;
+        uint8_t tempLow;
+    } sample;
+    static struct __attribute__((packed,aligned(4)))
+    {
+        I2C::Transaction info;
+        I2C::Transaction::Transfer transfers[2];
+    } sampleTxn =
+    {
+        I2C::Transaction(0x76, ARRAYLEN(sampleTxn.transfers)),
+        {
+            I2C::Transaction::Transfer(I2C::Transaction::Transfer::TYPE_TX, sizeof(sampleReg), &sampleReg),
+            I2C::Transaction::Transfer(I2C::Transaction::Transfer::TYPE_RX, sizeof(sample), &sample),
+        }
+    };
+    static void sampleDone(I2CBus::Request* req);
+    static I2CBus::Request sampleReq(&sampleTxn.info, sampleDone, NULL);
+
 
     void PressureSensor::init(Sensor* sensor, bool first)
     {
@@ -82,22 +107,27 @@ namespace Baro
     }
 
 
-    void PressureSensor::capture(Sensor* sensor)
+    // Measurement value readout has completed (called from sensor task)
+    static void sampleDone(I2CBus::Request* req)
     {
-        struct __attribute__((packed,aligned(2)))
-        {
-            uint16_t pressHigh;
-            uint8_t pressLow;
-            uint16_t tempHigh;
-            uint8_t tempLow;
-        } buf;
-        // Read measurement value from sensor
-        BARO_I2C_BUS.readRegs(0x76, 0xf7, &buf, sizeof(buf));
+        SensorTask::Record* record = (SensorTask::Record*)req->arg;
         // Record most significant 16 bits of pressure and temperature
-        SensorTask::writeMeasurement(buf.pressHigh);
-        SensorTask::writeMeasurement(buf.tempHigh);
+        record->write(sample.pressHigh);
+        record->write(sample.tempHigh);
         // Record least significant 8 bits of pressure and temperature if enabled
-        if (highres) SensorTask::writeMeasurement((buf.tempLow << 8) | buf.pressLow);
+        if (highres) record->write((sample.tempLow << 8) | sample.pressLow);
+        SensorTask::completeRecord(record);
+    }
+
+
+    void PressureSensor::capture(Sensor* sensor)
+    {
+        // If the previous readout is still in progress, wait for it (we only have one sample buffer)
+        if (sampleReq.queued) BARO_I2C_BUS.wait(&sampleReq);
+        // Start reading the measurement value from the sensor. The sensor task carries on with other
+        // sensors meanwhile, sampleDone() will fill in our record once the transaction has completed.
+        sampleReq.arg = SensorTask::deferRecord();
+        BARO_I2C_BUS.submit(&sampleReq);
         // Schedule capturing of next sample
         sensor->reschedule(&sensor->captureTask);
     }
@@ -20,6 +20,7 @@
 #include "sys/util.h"
 #include "../common.h"
 #include "../i2c.h"
+#include "../recordqueue.h"
 
 
 namespace Hygro
@@ -40,6 +41,49 @@ namespace Hygro
     bool enableHum;  // Whether or not to sample humidity values
     bool enableTemp;  // Whether or not to sample temperature values
 
+    // Asynchronous sample readout (see HumiditySensor::capture)
+    static uint16_t sample[2];  // Result of the previously initiated split transaction, temperature register
+    static uint8_t sampleCmd;  // Command that initiates the next split transaction
+    static const uint8_t tempReg = 0xe0;  // Temperature register (value captured during humidity measurement)
+    static struct __attribute__((packed,aligned(4)))
+    {
+        I2C::Transaction info;
+        I2C::Transaction::Transfer transfers[1];
+    } collectTxn =
+    {
+        I2C::Transaction(0x40, ARRAYLEN(collectTxn.transfers)),
+        {
+            I2C::Transaction::Transfer(I2C::Transaction::Transfer::TYPE_RX, sizeof(sample[0]), sample),
+        }
+    };
+    static struct __attribute__((packed,aligned(4)))
+    {
+        I2C::Transaction info;
+        I2C::Transaction::Transfer transfers[2];
+    } tempTxn =
+    {
+        I2C::Transaction(0x40, ARRAYLEN(tempTxn.transfers)),
+        {
+            I2C::Transaction::Transfer(I2C::Transaction::Transfer::TYPE_TX, sizeof(tempReg), &tempReg),
+            I2C::Transaction::Transfer(I2C::Transaction::Transfer::TYPE_RX, sizeof(sample[1]), sample + 1),
+        }
+    };
+    static struct __attribute__((packed,aligned(4)))
+    {
+        I2C::Transaction info;
+        I2C::Transaction::Transfer transfers[1];
+    } cmdTxn =
+    {
+        I2C::Transaction(0x40, ARRAYLEN(cmdTxn.transfers)),
+        {
+            I2C::Transaction::Transfer(I2C::Transaction::Transfer::TYPE_TX, sizeof(sampleCmd), &sampleCmd),
+        }
+    };
+    static void sampleDone(I2CBus::Request* req);
+    static I2CBus::Request collectReq(&collectTxn.info, NULL, NULL);
+    static I2CBus::Request tempReq(&tempTxn.info, NULL, NULL);
+    static I2CBus::Request cmdReq(&cmdTxn.info, sampleDone, NULL);
+
 
     // Send a command byte to the chip
     static void sendCmd(uint8_t cmd)
@@ -138,20 +182,31 @@ namespace Hygro
     }
 
 
+    // Sample readout and initiation of the next split transaction have completed (called from sensor task)
+    static void sampleDone(I2CBus::Request* req)
+    {
+        SensorTask::Record* record = (SensorTask::Record*)req->arg;
+        record->write(sample[0]);
+        if (enableTemp && enableHum) record->write(sample[1]);
+        SensorTask::completeRecord(record);
+    }
+
+
     void HumiditySensor::capture(Sensor* sensor)
     {
+        // If the previous readout is still in progress, wait for it (we only have one sample buffer)
+        if (cmdReq.queued) HYGRO_I2C_BUS.wait(&cmdReq);
+        // Queue all transactions at once, so that the bus processes them back to back.
         // Collect first measurement from previously initiated split transaction.
         // This is humidity if that is enabled, otherwise temperature.
-        uint16_t result = collectResult();
-        SensorTask::writeMeasurement(result);
-        if (enableTemp && enableHum)
-        {
-            // If both temperature and humidity recording is requested,
-            // read out the temperature value (captured during humidity measurement) as well
-            HYGRO_I2C_BUS.readRegs(0x40, 0xe0, &result, sizeof(result));
-            SensorTask::writeMeasurement(result);
-        }
-        sendCmd(enableHum ? 0xf5 : 0xf3);  // Start capturing of next sample (split transaction)
+        HYGRO_I2C_BUS.submit(&collectReq);
+        // If both temperature and humidity recording is requested,
+        // read out the temperature value (captured during humidity measurement) as well
+        if (enableTemp && enableHum) HYGRO_I2C_BUS.submit(&tempReq);
+        // Start capturing of next sample (split transaction), sampleDone() will record the results afterwards
+        sampleCmd = enableHum ? 0xf5 : 0xf3;
+        cmdReq.arg = SensorTask::deferRecord();
+        HYGRO_I2C_BUS.submit(&cmdReq);
         // Schedule collection of next sample
         sensor->reschedule(&sensor->captureTask);
     }
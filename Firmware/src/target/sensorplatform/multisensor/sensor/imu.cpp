@@ -31,7 +31,7 @@ namespace IMU
     const SensorType accelSensorType
     {
         {
-            0b0000000000000000000011111111,
+            0b0000000000000000001011111111,
             0b0000000000000000000000000000,
             0b1100000000000000000000000001,
             0b0000000000000000000000000000,
@@ -43,9 +43,9 @@ namespace IMU
     const SensorType gyroSensorType
     {
         {
-            0b0000000000000000000011111111,
+            0b0000000000000000001011111111,
             0b0000000000000000000000000000,
-            0b1111111110000000000000000001,
+            0b1111111110000000000000000011,
             0b0000000000000000000000000000,
         },
         0x53414149, 0x59475092,
@@ -55,7 +55,7 @@ namespace IMU
     const SensorType magSensorType
     {
         {
-            0b0000000000000000000011111111,
+            0b0000000000000000001011111111,
             0b0000000000000000000000000000,
             0b0000000000000000000000000001,
             0b0000000000000000000000000000,
@@ -85,6 +85,17 @@ namespace IMU
     int bootedAt;  // Time when the IMU chip is expected to accept for communication after powerup
     uint8_t reg108;  // Power control register value, affects both gyroscope and accelerometer
     uint8_t i2cEnable;  // I2C slave 4 configuration (for magnetometer access)
+    uint8_t userCtrl;  // User control register value (FIFO and I2C master enable)
+    // Gyroscope sample buffer for FIFO mode (filled from the IMU FIFO in a single SPI transfer)
+    struct __attribute__((packed,aligned(4)))
+    {
+        uint8_t padding;  // Align frame to a 16-bit boundary
+        uint8_t cmd;  // Read register 116 (FIFO data)
+        int16_t frame[IMU_FIFO_MAX_BURST][3];  // Gyroscope X, Y, Z samples (in FIFO order)
+    } fifoBuf;
+    uint8_t fifoRead;  // Index of the next frame to be recorded from fifoBuf
+    uint8_t fifoLevel;  // Number of valid frames in fifoBuf
+    bool fifoHold;  // Whether a previous sample is available to be repeated if the FIFO runs dry
 
 
     // Read measurement data at high SPI bus clock speed (not allowed for other registers)
@@ -149,6 +160,40 @@ namespace IMU
         return msg[4];
     }
 
+    // Read a number of gyroscope samples from the IMU FIFO into fifoBuf
+    static void readFifoFrames(int frames)
+    {
+        fifoBuf.cmd = 0x80 | 116;
+        readFast(&fifoBuf.cmd, sizeof(fifoBuf.cmd) + frames * sizeof(*fifoBuf.frame));
+    }
+
+    // Refill fifoBuf from the IMU FIFO. The records lag burst samples behind the IMU's FIFO input.
+    // The IMU's sample clock isn't synchronized to ours, so samples will be repeated (IMU too slow)
+    // or dropped (IMU too fast) as necessary to keep that lag from drifting.
+    static void refillFifo(int burst)
+    {
+        fifoRead = 0;
+        fifoLevel = 0;
+        // Read FIFO fill level (registers 114-115)
+        uint8_t msg[] = {0x80 | 114, 0xff, 0xff};
+        Radio::sharedSPITransfer(PIN_IMU_NCS, IMU_SPI_PRESCALER, msg, msg, sizeof(msg));
+        int bytes = ((msg[1] & 0x1f) << 8) | msg[2];
+        int frames = bytes / sizeof(*fifoBuf.frame);
+        // If the FIFO contents are no longer frame aligned (it must have overflowed), start over
+        if (bytes % sizeof(*fifoBuf.frame))
+        {
+            writeReg(106, userCtrl | 0x04);  // Reset FIFO
+            return;
+        }
+        // If the FIFO doesn't contain a full burst yet, try again during the next capture
+        if (frames < burst) return;
+        // If the lag has grown too much, drop the oldest samples
+        if (frames > burst + burst / 2) readFifoFrames(MIN(frames - burst, burst));
+        // Read a burst of samples
+        readFifoFrames(burst);
+        fifoLevel = burst;
+    }
+
     // Put the IMU into sleep mode. Called after sensor powerup as soon as it is ready for commands.
     void powerDown()
     {
@@ -174,7 +219,6 @@ namespace IMU
         // Initialize data format information
         info->info.formatVendor = 0x53414149;
         info->info.formatType = 0x5092;
-        info->info.formatVersion = 0;
         // Read calibration data from the sensor
         for (int i = 0; i < 3; i++) info->data[0].u8[i] = readReg(13 + i);
     }
@@ -190,6 +234,8 @@ namespace IMU
         s->enableY = (channels >> 1) & 1;
         s->enableZ = channels & 1;
         info->info.recordSize = (s->enableX + s->enableY + s->enableZ) * 16;
+        // Recording data format version selects raw or packed (compressed) records
+        if (info->info.formatVersion > Codec::Format_Packed) info->info.formatVersion = Codec::Format_Raw;
     }
 
 
@@ -200,6 +246,8 @@ namespace IMU
         writeReg(107, 0x01);
         // Initialize power control register value to "all channels disabled"
         reg108 = 0x3f;
+        // Initialize user control register value to "FIFO and I2C master disabled"
+        userCtrl = 0;
         if (sensor->interval)
         {
             // The accelerometer is planned to be sampled
@@ -251,7 +299,6 @@ namespace IMU
         // Initialize data format information
         info->info.formatVendor = 0x53414149;
         info->info.formatType = 0x5192;
-        info->info.formatVersion = 0;
         // Read calibration data from the sensor
         for (int i = 0; i < 3; i++) info->data[0].u8[i] = readReg(i);
     }
@@ -267,25 +314,54 @@ namespace IMU
         s->enableY = (channels >> 1) & 1;
         s->enableZ = channels & 1;
         info->info.recordSize = (s->enableX + s->enableY + s->enableZ) * 16;
+        // Recording data format version selects raw or packed (compressed) records
+        if (info->info.formatVersion > Codec::Format_Packed) info->info.formatVersion = Codec::Format_Raw;
+        // FIFO mode burst size (in samples, 0 disables FIFO mode)
+        if (info->data[1].u8[26] > IMU_FIFO_MAX_BURST) info->data[1].u8[26] = IMU_FIFO_MAX_BURST;
+        s->fifoBurst = info->data[1].u8[26];
     }
 
 
     void GyroSensor::start(Sensor* sensor, int time)
     {
+        GyroSensor* s = (GyroSensor*)sensor;
         SeriesHeader::SensorInfo* info = sensor->getInfoPtr();
         // Write requested gyroscope configuration to the sensor
         for (int i = 0; i < 9; i++) writeReg(19 + i, info->data[1].u8[i]);
         // If the gyroscope is planned to be sampled,
         // enable the requested channels in the power control register value
-        if (sensor->interval) reg108 &= ~info->data[1].u8[27];
+        if (sensor->interval) reg108 &= ~(info->data[1].u8[27] & 7);
         // Write the power control register value to the IMU chip (also for accelerometers!)
         writeReg(108, reg108);
+        // Don't write anything to the FIFO until startFifo() is called
+        writeReg(35, 0);
+        fifoRead = 0;
+        fifoLevel = 0;
+        fifoHold = false;
+        // In FIFO mode, start filling the FIFO one burst before the first sample is due,
+        // so that a full burst is available by then.
+        if (sensor->interval && s->fifoBurst)
+        {
+            s->fifoTask.time = time - s->fifoBurst * sensor->interval;
+            SensorTask::scheduleTask(&s->fifoTask);
+        }
     }
 
 
     void GyroSensor::stop(Sensor* sensor)
     {
-        // Everything is taken care of by AccelSensor::stop
+        // Stop writing to the FIFO, everything else is taken care of by AccelSensor::stop
+        writeReg(35, 0);
+    }
+
+
+    void GyroSensor::startFifo(Sensor* sensor)
+    {
+        // Write gyroscope X, Y and Z samples to the FIFO
+        writeReg(35, 0x70);
+        // Enable and reset the FIFO
+        userCtrl |= 0x40;
+        writeReg(106, userCtrl | 0x04);
     }
 
 
@@ -301,7 +377,28 @@ namespace IMU
             int16_t gyroY;
             int16_t gyroZ;
         } buf = {0, 0x80 | 67, -1, -1, -1};
-        readFast(&buf.cmd, sizeof(buf) - sizeof(buf.padding));
+        if (!s->fifoBurst) readFast(&buf.cmd, sizeof(buf) - sizeof(buf.padding));
+        else
+        {
+            // FIFO mode: Take the next sample from fifoBuf, refill that if it is empty
+            if (fifoRead >= fifoLevel) refillFifo(s->fifoBurst);
+            if (fifoRead < fifoLevel) fifoRead++;
+            // If the FIFO didn't have enough samples, repeat the previous one (if there is none, read
+            // the current one from the registers instead, this can only happen during the first burst)
+            else if (!fifoHold)
+            {
+                readFast(&buf.cmd, sizeof(buf) - sizeof(buf.padding));
+                fifoBuf.frame[0][0] = buf.gyroX;
+                fifoBuf.frame[0][1] = buf.gyroY;
+                fifoBuf.frame[0][2] = buf.gyroZ;
+                fifoRead = 1;
+                fifoLevel = 1;
+            }
+            fifoHold = true;
+            buf.gyroX = fifoBuf.frame[fifoRead - 1][0];
+            buf.gyroY = fifoBuf.frame[fifoRead - 1][1];
+            buf.gyroZ = fifoBuf.frame[fifoRead - 1][2];
+        }
         // Record the requested channels
         if (s->enableX) SensorTask::writeMeasurement(buf.gyroX);
         if (s->enableY) SensorTask::writeMeasurement(buf.gyroY);
@@ -319,7 +416,6 @@ namespace IMU
         // Initialize data format information
         info->info.formatVendor = 0x53414149;
         info->info.formatType = 0x5292;
-        info->info.formatVersion = 0;
         writeReg(107, 0x19);  // Wake up IMU chip from sleep and set clock source to auto-select
         writeReg(106, 0x20);  // Enable internal I2C master
         i2cWrite(0x0c, 0x40);  // Enter magnetometer self-test mode
@@ -347,6 +443,8 @@ namespace IMU
         s->enableY = (channels >> 1) & 1;
         s->enableZ = channels & 1;
         info->info.recordSize = (s->enableX + s->enableY + s->enableZ) * 16;
+        // Recording data format version selects raw or packed (compressed) records
+        if (info->info.formatVersion > Codec::Format_Packed) info->info.formatVersion = Codec::Format_Raw;
     }
 
 
@@ -354,7 +452,8 @@ namespace IMU
     {
         // No need to do anything if no magnetometer sampling is requested
         if (!sensor->interval) return;
-        writeReg(106, 0x20);  // Enable internal I2C master
+        userCtrl |= 0x20;
+        writeReg(106, userCtrl);  // Enable internal I2C master
         // Figure out gyro sampling rate (in kHz)
         SeriesHeader::SensorInfo* gyroInfo = gyroSensor.getInfoPtr();
         uint8_t dlpfCfg = gyroInfo->data[1].u8[7] & 0x07;
@@ -48,12 +48,16 @@ namespace IMU
         bool enableX;
         bool enableY;
         bool enableZ;
+        uint8_t fifoBurst;  // Number of samples to read from the IMU FIFO at once (0: FIFO mode disabled)
+        SensorTask::ScheduledTask fifoTask;  // Starts filling the FIFO ahead of the first sample (FIFO mode)
         static void init(Sensor* sensor, bool first);
         static void verify(Sensor* sensor, SeriesHeader::SensorInfo* info);
         static void start(Sensor* sensor, int time);
         static void stop(Sensor* sensor);
         static void capture(Sensor* sensor);
-        constexpr GyroSensor(uint8_t id) : Sensor(&gyroSensorType, id, capture), enableX(0), enableY(0), enableZ(0) {}
+        static void startFifo(Sensor* sensor);
+        constexpr GyroSensor(uint8_t id) : Sensor(&gyroSensorType, id, capture), enableX(0), enableY(0), enableZ(0),
+            fifoBurst(0), fifoTask((void(*)(void*))startFifo, this) {}
     };
 
     class MagSensor : public Sensor
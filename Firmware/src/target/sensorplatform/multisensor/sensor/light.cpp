@@ -20,6 +20,7 @@
 #include "sys/util.h"
 #include "../common.h"
 #include "../i2c.h"
+#include "../recordqueue.h"
 
 
 namespace Light
@@ -41,6 +42,29 @@ namespace Light
     bool enableInfrared;  // Whether or not to sample infrared light intensity
     bool enableReflected;  // Whether or not to sample reflected light intensity
 
+    // Asynchronous sample readout (see IntensitySensor::capture)
+    static const uint8_t sampleReg = 0xb4;  // First measurement value register
+    static struct __attribute__((packed,aligned(2)))
+    {
+        uint16_t visible;
+        uint16_t infrared;
+        uint16_t reflected;
+    } sample;
+    static struct __attribute__((packed,aligned(4)))
+    {
+        I2C::Transaction info;
+        I2C::Transaction::Transfer transfers[2];
+    } sampleTxn =
+    {
+        I2C::Transaction(0x39, ARRAYLEN(sampleTxn.transfers)),
+        {
+            I2C::Transaction::Transfer(I2C::Transaction::Transfer::TYPE_TX, sizeof(sampleReg), &sampleReg),
+            I2C::Transaction::Transfer(I2C::Transaction::Transfer::TYPE_RX, sizeof(sample), &sample),
+        }
+    };
+    static void sampleDone(I2CBus::Request* req);
+    static I2CBus::Request sampleReq(&sampleTxn.info, sampleDone, NULL);
+
 
     void IntensitySensor::init(Sensor* sensor, bool first)
     {
@@ -87,20 +111,25 @@ namespace Light
     }
 
 
-    void IntensitySensor::capture(Sensor* sensor)
+    // Measurement value readout has completed (called from sensor task)
+    static void sampleDone(I2CBus::Request* req)
     {
-        struct __attribute__((packed,aligned(2)))
-        {
-            uint16_t visible;
-            uint16_t infrared;
-            uint16_t reflected;
-        } buf;
-        // Read measurement value from sensor
-        LIGHT_I2C_BUS.readRegs(0x39, 0xb4, &buf, sizeof(buf));
+        SensorTask::Record* record = (SensorTask::Record*)req->arg;
         // Record the requested channels
-        if (enableVisible) SensorTask::writeMeasurement(buf.visible);
-        if (enableInfrared) SensorTask::writeMeasurement(buf.infrared);
-        if (enableReflected) SensorTask::writeMeasurement(buf.reflected);
+        if (enableVisible) record->write(sample.visible);
+        if (enableInfrared) record->write(sample.infrared);
+        if (enableReflected) record->write(sample.reflected);
+        SensorTask::completeRecord(record);
+    }
+
+
+    void IntensitySensor::capture(Sensor* sensor)
+    {
+        // If the previous readout is still in progress, wait for it (we only have one sample buffer)
+        if (sampleReq.queued) LIGHT_I2C_BUS.wait(&sampleReq);
+        // Start reading the measurement value from the sensor, sampleDone() will record it later
+        sampleReq.arg = SensorTask::deferRecord();
+        LIGHT_I2C_BUS.submit(&sampleReq);
         // Schedule capturing of next sample
         sensor->reschedule(&sensor->captureTask);
     }
@@ -76,19 +76,23 @@ bool Sensor::writePage(int page, Page* data)
     return true;
 }
 
-// Prepare the sensor for start of measurement
-void Sensor::start(int time)
+// Prepare the sensor for start of measurement, returns the resulting measurement data rate in bits/s
+uint32_t Sensor::start(int time)
 {
     // If this sensor isn't present, we don't need to do anything.
-    if (!present) return;
+    if (!present) return 0;
     SeriesHeader::SensorInfo* info = getInfoPtr();
-    // If the sensor is supposed to be samples, schedule captureTask for the first sample
-    // and cache the interval (before the sensor configuration gets flushed from the buffer).
+    // If the sensor is supposed to be samples, schedule captureTask for the first sample and cache
+    // the interval and data format (before the sensor configuration gets flushed from the buffer).
     interval = info->info.scheduleInterval;
+    format = info->info.formatVersion;
     captureTask.time = time + info->info.scheduleOffset;
     if (interval) SensorTask::scheduleTask(&captureTask);
     // Run the sensor driver's measurement start function if it has one.
     if (type->start) type->start(this, captureTask.time);
+    // Calculate the data rate from the sampling interval and record size.
+    if (!interval) return 0;
+    return info->info.recordSize * 1000000 / interval;
 }
 
 // Shut down the sensor after measurement
@@ -21,6 +21,7 @@
 #include "global.h"
 #include "../common.h"
 #include "../sensortask.h"
+#include "../codec.h"
 
 
 class Sensor;
@@ -47,17 +48,20 @@ public:
     const SensorType* const type;  // Pointer to constant data (attributes, vtable) in flash
     SensorTask::ScheduledTask captureTask;  // Primary sampling task
     uint32_t interval;  // captureTask rescheduling interval (copied from series header)
+    Codec::Predictor predictor;  // Compression state (if the recording data format is Codec::Format_Packed)
+    uint8_t format;  // Recording data format version (copied from series header)
     const uint8_t id;  // Sensor ID of this instance
     bool present;  // Whether the sensor is physically present on this node
 
     constexpr Sensor(const SensorType* type, uint8_t id, void (*captureTask)(Sensor*))
-        : type(type), captureTask((void(*)(void*))captureTask, this), interval(0), id(id), present(false) {}
+        : type(type), captureTask((void(*)(void*))captureTask, this), interval(0), predictor(), format(0),
+          id(id), present(false) {}
 
     void init(bool first);  // needs to set present flag
     constexpr SeriesHeader::SensorInfo* getInfoPtr() { return mainBuf.seriesHeader.sensor + id; }
     bool writePage(int page, Page* data);
     void verifyConfig();
-    void start(int time);
+    uint32_t start(int time);
     void stop();
     void schedule(SensorTask::ScheduledTask* task, int time);
     void reschedule(SensorTask::ScheduledTask* task);
@@ -17,6 +17,8 @@
 
 #include "global.h"
 #include "sensortask.h"
+#include "taskqueue.h"
+#include "recordqueue.h"
 #include "cpu/arm/cortexm/cortexutil.h"
 #include "sys/time.h"
 #include "sys/util.h"
@@ -25,6 +27,7 @@
 #include "radio.h"
 #include "i2c.h"
 #include "storagetask.h"
+#include "codec.h"
 #include "sensor/sensor.h"
 #include "sensor/timing.h"
 #include "sensor/telemetry.h"
@@ -48,9 +51,14 @@ namespace SensorTask
     static bool stop;  // Whether the running measurement was requested to be stopped
     static uint32_t cmdArg;  // Argument of a pending command (usually an index or timestamp)
     static void* cmdPtr;  // Argument of a pending command (usually a pointer)
-    static ScheduledTask* nextTask;  // First entry in ScheduledTask queue
+    static TaskQueue taskQueue;  // Pending ScheduledTasks
     static uint8_t writeBlock;  // Measurement data recording buffer block pointer
     static uint8_t writeWord;  // Word (16 bit) pointer within writeBlock
+    static bool packed;  // Whether the measurement data stream uses the packed format (see codec.h)
+    static Codec::PackedEncoder encoder;  // Packed measurement data block builder
+    static RecordQueue records;  // Captured records that haven't been written to the measurement data buffer yet
+    static Record* curRecord;  // Record that the running ScheduledTask captures into (NULL if it was deferred)
+    static uint32_t recordIndex;  // Number of records encoded so far (packed format)
 
     State state = State_Idle;  // Requested or running operation
     uint32_t writeSeq;  // Sequence number of the current measurement data block
@@ -80,38 +88,98 @@ namespace SensorTask
     // Insert a ScheduledTask into the queue (called from sensor task in Measuring state)
     void scheduleTask(ScheduledTask* task)
     {
-        ScheduledTask* prev;
-        ScheduledTask* t;
-        // Walk ScheduledTask list to find correct insertion point (ordered by target time)
-        for (prev = NULL, t = nextTask; t; prev = t, t = t->next)
-            if (TIME_AFTER(t->time, task->time))
-                break;
-        // Insert the new task
-        task->next = t;
-        if (prev) prev->next = task;
-        else nextTask = task;
+        if (!taskQueue.insert(task)) error(Error_SensorTaskQueueOverflow);
     }
 
-    // Write a word into the measurement data buffer (called from sensor task in Measuring state)
-    void writeMeasurement(uint16_t data)
+    // Mark the current measurement data block as complete and move on to the next one
+    static void completeBlock()
+    {
+        mainBufSeq[writeBlock] = writeSeq++;
+        mainBufValid[writeBlock] = true;
+        // Increment block pointer, wrap around if necessary
+        if (++writeBlock >= ARRAYLEN(mainBuf.block)) writeBlock = 0;
+        mainBufValid[writeBlock] = false;
+        // Wake storage task (it may need to write the just completed block to the SD card)
+        IRQ::wakeStorageTask();
+    }
+
+    // Write a word into the measurement data buffer (raw format)
+    static void storeWord(uint16_t data)
     {
-        // Write the word
         Page* block = mainBuf.block[writeBlock];
         block->u16[writeWord++] = data;
         if (writeWord >= sizeof(*mainBuf.block) / sizeof(*block->u16))
         {
             // We have just filled up a block, so move on to the next one.
             writeWord = 0;
-            mainBufSeq[writeBlock] = writeSeq++;
-            mainBufValid[writeBlock] = true;
-            // Increment block pointer, wrap around if necessary
-            if (++writeBlock >= ARRAYLEN(mainBuf.block)) writeBlock = 0;
-            mainBufValid[writeBlock] = false;
-            // Wake storage task (it may need to write the just completed block to the SD card)
-            IRQ::wakeStorageTask();
+            completeBlock();
         }
     }
 
+    // Encode a record into the measurement data buffer (packed format)
+    static void encodeRecord(Record* record)
+    {
+        Sensor* sensor = record->sensor;
+        Codec::Predictor* pred = sensor->format == Codec::Format_Packed ? &sensor->predictor : NULL;
+        // If the record doesn't fit into the current block anymore, complete that and start a new one.
+        // (A single record always fits into an empty block.)
+        if (!encoder.writeRecord(record->data, record->words, pred))
+        {
+            encoder.finishBlock();
+            completeBlock();
+            encoder.startBlock(mainBuf.block[writeBlock]->u32, recordIndex);
+            encoder.writeRecord(record->data, record->words, pred);
+        }
+        recordIndex++;
+    }
+
+    // Write all records that are ready (and have no incomplete records before them)
+    // to the measurement data buffer, in schedule order
+    static void flushRecords()
+    {
+        while (Record* record = records.peek())
+        {
+            // Sensors that didn't capture anything don't get a record
+            if (record->words)
+            {
+                if (packed) encodeRecord(record);
+                else for (int i = 0; i < record->words; i++) storeWord(record->data[i]);
+            }
+            records.drop();
+        }
+    }
+
+    // Process completed asynchronous captures and write out the records that are ready
+    static void processCompletions()
+    {
+        I2CBus::I2C1.poll();
+        flushRecords();
+    }
+
+    // Write a word into the current record (called from sensor task in Measuring state)
+    void writeMeasurement(uint16_t data)
+    {
+        if (curRecord) curRecord->write(data);
+    }
+
+    // Take over the current record, to be filled in after the running ScheduledTask has returned.
+    // Its position in the measurement data stream is preserved, but the records of all subsequent
+    // tasks will be held back until it was passed to completeRecord().
+    Record* deferRecord()
+    {
+        Record* record = curRecord;
+        curRecord = NULL;
+        return record;
+    }
+
+    // Mark a record obtained from deferRecord() as ready (called from sensor task in Measuring state)
+    void completeRecord(Record* record)
+    {
+        if (!record) return;
+        record->ready = true;
+        flushRecords();
+    }
+
     // Detect present sensors and validate configuration in series header (called externally)
     void detectSensors()
     {
@@ -167,6 +235,9 @@ namespace SensorTask
         // Configure I2C bus
         I2CBus::I2C1.init();
 
+        // Measurement data rate of the current series (bits/s)
+        uint32_t bitrate;
+
         // Sensor task main loop
         while (true)
         {
@@ -191,7 +262,7 @@ namespace SensorTask
                     else memset(mainBuf.seriesHeader.sensor + i, 0, sizeof(*mainBuf.seriesHeader.sensor));
                 }
                 // Series header might potentially have been modified during sensor detection
-                StorageTask::seriesHeaderDirty = true;
+                StorageTask::seriesHeaderModified(&mainBuf.seriesHeader, sizeof(mainBuf.seriesHeader));
                 initialized = true;
                 // Signal completion
                 state = State_Idle;
@@ -199,10 +270,11 @@ namespace SensorTask
                 break;
 
             case State_WriteSensorPage:
+                // Series header might potentially have been modified
+                StorageTask::seriesHeaderModified(mainBuf.seriesHeader.sensor + (cmdArg >> 2),
+                                                  sizeof(*mainBuf.seriesHeader.sensor));
                 // Pass request to sensor driver
                 cmdArg = sensors[cmdArg >> 2]->writePage(cmdArg & 3, (Page*)cmdPtr);
-                // Series header might potentially have been modified
-                StorageTask::seriesHeaderDirty = true;
                 // Signal completion
                 state = State_Idle;
                 SEV();
@@ -225,39 +297,79 @@ namespace SensorTask
                 // If the series header fills the measurement data buffer, wrap around
                 if (writeBlock >= ARRAYLEN(mainBuf.block)) writeBlock = 0;
                 writeWord = 0;
-                nextTask = NULL;
-                // Start up sensors (cmdArg is usec time to start measuring at)
+                taskQueue.clear();
+                records.clear();
+                // Start up sensors (cmdArg is usec time to start measuring at) and announce the
+                // resulting data rate to the receiver, so that it can reserve time slots for us.
+                // The announced data rate is the uncompressed one, even if the packed format is used.
+                bitrate = 0;
+                packed = false;
                 for (uint32_t i = 0; i < ARRAYLEN(sensors); i++)
                     if (sensors[i])
-                        sensors[i]->start(cmdArg);
+                    {
+                        bitrate += sensors[i]->start(cmdArg);
+                        // Use the packed format if any active sensor requests it
+                        if (sensors[i]->present && sensors[i]->interval && sensors[i]->format == Codec::Format_Packed)
+                            packed = true;
+                    }
+                Radio::noDataResponse.bitrate = bitrate;
+                // Set up the first packed block (this must happen after the sensors have read their configuration)
+                recordIndex = 0;
+                if (packed) encoder.startBlock(mainBuf.block[writeBlock]->u32, recordIndex);
                 // Measurement main loop
                 while (!stop)
                 {
                     // Determine the ScheduledTask that needs to be executed next
-                    ScheduledTask* task = nextTask;
+                    ScheduledTask* task = taskQueue.pop();
                     if (!task)
                     {
-                        // The ScheduledTask list is empty (no sensors active?)
+                        // The ScheduledTask queue is empty (no sensors active?)
                         yield();
                         continue;
                     }
-                    nextTask = task->next;
                     // Sleep until the target execution time of the next ScheduledTask
                     sleepUntil(task->time);
+                    // All scheduled tasks belong to a sensor, reserve the next record in the measurement
+                    // data stream for it. If too many records are waiting for asynchronous captures to
+                    // complete, wait for that to happen first.
+                    processCompletions();
+                    while (!(curRecord = records.open((Sensor*)task->arg)))
+                    {
+                        yield();
+                        processCompletions();
+                    }
                     // Run the task (it will re-schedule itself if it needs to)
                     task->call(task->arg);
+                    // Unless the task has deferred its record, it is complete now
+                    if (curRecord) completeRecord(curRecord);
+                    curRecord = NULL;
+                }
+                // Wait for asynchronous captures which are still in progress, their records belong to the measurement.
+                processCompletions();
+                while (!records.empty())
+                {
+                    yield();
+                    processCompletions();
                 }
                 // Measurement has ended, figure out the usec time (within measurement schedule)
                 // that the next sensor would have been sampled at and report this as end time.
-                if (nextTask) endTime = nextTask->time - cmdArg;
+                if (taskQueue.peek()) endTime = taskQueue.peek()->time - cmdArg;
                 else endTime = 0;
                 // Figure out how many bytes of measurement data we have captured.
-                endOffset = ((uint64_t)writeSeq) * sizeof(*mainBuf.block) + writeWord * sizeof(*(*mainBuf.block)->u16);
+                // Packed blocks can't be truncated, so the last one (if it isn't empty) is counted as a whole.
+                if (packed) endOffset = ((uint64_t)writeSeq + !!encoder.records) * sizeof(*mainBuf.block);
+                else endOffset = ((uint64_t)writeSeq) * sizeof(*mainBuf.block) + writeWord * sizeof(*(*mainBuf.block)->u16);
                 // Acknowledge stop request
                 stop = false;
                 SEV();
                 // Fill up current measurement data block with zeros, to allow for it to be written
-                while (writeWord) writeMeasurement(0);
+                // (packed blocks are zero filled already and just need their header)
+                if (!packed) while (writeWord) storeWord(0);
+                else if (encoder.records)
+                {
+                    encoder.finishBlock();
+                    completeBlock();
+                }
                 // Shut down sensors
                 for (uint32_t i = ARRAYLEN(sensors); i--; )
                     if (sensors[i])
@@ -23,6 +23,8 @@
 
 namespace SensorTask
 {
+    struct Record;
+
     enum State
     {
         State_Idle = 0,  // Sleeping, initial state
@@ -36,12 +38,12 @@ namespace SensorTask
     // Sensor task schedule entries
     struct __attribute__((packed,aligned(4))) ScheduledTask
     {
-        ScheduledTask* next;  // Pointer to next ScheduledTask in list
+        uint32_t seq;  // Insertion sequence number (tie breaker for tasks with the same time, see TaskQueue)
         int time;  // usec time that this ScheduledTask should be run at
         void (*call)(void* arg);  // Function to be called
         void* arg;  // Function argument
 
-        constexpr ScheduledTask(void (*call)(void* arg), void* arg): next(NULL), time(0), call(call), arg(arg) {}
+        constexpr ScheduledTask(void (*call)(void* arg), void* arg): seq(0), time(0), call(call), arg(arg) {}
     };
 
     extern State state;
@@ -57,5 +59,7 @@ namespace SensorTask
     extern void sleepUntil(int time);
     extern void scheduleTask(ScheduledTask* task);
     extern void writeMeasurement(uint16_t data);
+    extern Record* deferRecord();
+    extern void completeRecord(Record* record);
     extern void yield();
 }
@@ -19,10 +19,10 @@
 #include "storagetask.h"
 #include "cpu/arm/cortexm/cortexutil.h"
 #include "sys/util.h"
-#include "lib/crc32/crc32.h"
 #include "common.h"
 #include "irq.h"
 #include "sd.h"
+#include "driver/crc.h"
 #include "radio.h"
 #include "sensortask.h"
 #include "sys/time.h"
@@ -30,42 +30,45 @@
 
 namespace StorageTask
 {
-    // Length of series header (including sensor configuration) in SD card sectors
-    static const uint32_t seriesHeaderSectors = sizeof(mainBuf.seriesHeader) / sizeof(*mainBuf.block);
-    
-    // First data sector number on the SD card
-    static const uint32_t firstDataSector = 2 + 2 * seriesHeaderSectors;
-
-    // Various interpretations of the SD card sector buffer
-    static union __attribute__((packed,aligned(4)))
-    {
-        uint8_t u8[512];
-        uint32_t u32[128];
-        struct __attribute__((packed,aligned(4)))
-        {
-            uint32_t blockSeq;
-            uint32_t reserved[7];
-            Page data[17];
-            uint32_t crc;
-        } recording;
-    } xferBuf;
+    static SectorBuf xferBuf;  // SD card sector buffer
+    static SectorBuf pipeBuf;  // Second sector buffer for recording (filled while xferBuf is being written and vice versa)
+    static SectorBuf* fillSector;  // Recording sector buffer which is being filled
+    static SectorBuf* writingSector;  // Recording sector buffer which is being transferred to the card (if any)
     
     static uint8_t currentConfigIndex;  // Which copy of the node config is currently active
     static uint8_t currentConfigUSN;  // Node config update sequence number (may wrap around)
-    static uint8_t seriesHeaderIndex;  // Which copy of the series header is currently active
-    static uint8_t seriesHeaderUSN;  // Series header update sequence number (may wrap around)
+    static uint32_t seriesHeaderUSN;  // Newest series header update sequence number on the SD card
+    static uint32_t seriesHeaderSlot;  // Which copy of each series header sector is currently active (bitmask)
+    static uint32_t seriesHeaderCRC[seriesHeaderSectors];  // Data block checksum of each active series header
+                                                           // sector (0 if unknown, forces rewriting it)
     static uint32_t cmdArg;  // Argument of a pending command (usually an index)
     static uint32_t cmdSize;  // Argument of a pending command (usually a count)
 
     State state = State_Init;  // Requested or running operation
     bool configDirty;  // Node config in RAM has been modified since last save
-    bool seriesHeaderDirty;  // Series header / sensor config in RAM has been modified since last save
+    uint32_t seriesHeaderDirty;  // Series header / sensor config sectors in RAM which have been modified
+                                 // since last save (bitmask)
     uint32_t bufferOverflowLost;  // How many measurement data pages (28 bytes) have been lost
                                   // due to the SD card not being able to keep up with writing
     static uint32_t currentBlockSeq;  // Block sequence number within measurement data
                                       // being currently written to the SD card
     static uint8_t currentBlock;  // Read pointer within measurement data buffer (in blocks)
+    static uint8_t currentPage;  // Read pointer within the current block (in pages)
+    static uint32_t recordingKey;  // Recording sector checksums are XORed with this (see SectorBuf)
+    static bool readbackStop;  // Abort the running readback
+    static uint32_t readSector;  // Recording sector currently held by xferBuf during readback
+    static uint32_t readPageSeq;  // Stream sequence number of the first page in xferBuf
+    static uint32_t readPages;  // Number of valid pages in xferBuf (0 if it isn't a valid recording sector)
+
 
+    // Calculate the checksum of a buffer using the CRC unit, yielding until the DMA transfer feeding it
+    // completes (run from storage task). The CPU is free for lower priority code meanwhile.
+    static uint32_t crc32(const void* buf, uint32_t len)
+    {
+        CRC::start(buf, len);
+        while (CRC::busy()) yield();
+        return CRC::finish();
+    }
 
     // Load node configuration from SD card (run from storage task)
     static void loadConfig()
@@ -144,53 +147,74 @@ namespace StorageTask
         while (state != State_Idle) WFE();
     }
 
-    // Load and validate a copy of the series header (run from storage task)
-    static bool loadSeriesHeader(int sector)
+    // Check whether a series header sector copy is newer than another one. Sectors written by older
+    // firmware versions have no data block checksum and only an 8 bit USN, they are older than any other.
+    static bool seriesHeaderNewer(uint32_t usn, bool legacy, uint32_t otherUSN, bool otherLegacy)
     {
-        // Read and check every sector, bail out of checksum or USN is bad.
-        for (uint32_t i = 0; i < seriesHeaderSectors; i++)
-        {
-            SD::read(sector + i, 1, &xferBuf);
-            if (crc32(xferBuf.u8 + 4, sizeof(xferBuf) - 4) != *xferBuf.u32) return false;
-            if (i && xferBuf.u8[4] != seriesHeaderUSN) return false;
-            // This sector is good, copy it to the global data buffer.
-            seriesHeaderUSN = xferBuf.u8[4];
-            memcpy(mainBuf.block[i], xferBuf.u8 + sizeof(xferBuf) - sizeof(*mainBuf.block), sizeof(*mainBuf.block));
-        }
-        // All sectors were good, return success.
-        return true;
+        if (legacy != otherLegacy) return otherLegacy;
+        if (legacy) return (int8_t)(usn - otherUSN) > 0;
+        return (int32_t)(usn - otherUSN) > 0;
     }
 
     // Load the series header (including sensor configuration) from SD card (run from storage task)
     static void doLoadSeriesHeader()
     {
-        uint8_t usn[2];
-        bool valid[2];
-        // Attempt to read first copy, check if it's valid and what its USN is.
-        valid[0] = loadSeriesHeader(2);
-        usn[0] = seriesHeaderUSN;
-        // Attempt to read second copy, check if it's valid and what its USN is.
-        valid[1] = loadSeriesHeader(2 + seriesHeaderSectors);
-        usn[1] = seriesHeaderUSN;
-        // If the second copy is valid and newer than the first, ignore the first one
-        if (valid[1] && usn[1] - usn[0] > 0) valid[0] = false;
-        
-        if (valid[0])
-        {
-            // The second copy is bad or the first one is newer. Re-read the first one.
-            seriesHeaderIndex = 0;
-            loadSeriesHeader(2);
-        }
-        else if (valid[1])
-        {
-            // The first copy is bad or the second one is older.
-            seriesHeaderIndex = 1;
-        }
-        else
+        uint32_t committedUSN = 0;
+        bool committedLegacy = false;
+        seriesHeaderUSN = 0;
+        seriesHeaderSlot = 0;
+        seriesHeaderDirty = 0;
+        for (uint32_t i = 0; i < seriesHeaderSectors; i++)
         {
-            // There is no valid series header copy, so initialize it with zeros.
-            // We don't have vital information such as our node ID, so bail out.
-            memset(&mainBuf.seriesHeader, 0, sizeof(mainBuf.seriesHeader));
+            bool found = false;
+            bool foundLegacy = false;
+            uint32_t foundUSN = 0;
+            bool torn = false;
+            // Read and check both copies of the sector, pick the newest valid one
+            for (uint32_t slot = 0; slot < 2; slot++)
+            {
+                SD::read(2 + slot * seriesHeaderSectors + i, 1, &xferBuf);
+                if (crc32(xferBuf.u8 + 4, sizeof(xferBuf) - 4) != *xferBuf.u32) continue;
+                bool legacy = !xferBuf.u32[2];
+                uint32_t usn = xferBuf.u32[1];
+                if (!legacy && (int32_t)(usn - seriesHeaderUSN) > 0) seriesHeaderUSN = usn;
+                // Copies that are newer than the first sector belong to a save that didn't complete
+                if (i && seriesHeaderNewer(usn, legacy, committedUSN, committedLegacy))
+                {
+                    torn = true;
+                    continue;
+                }
+                if (found && !seriesHeaderNewer(usn, legacy, foundUSN, foundLegacy)) continue;
+                // This copy is the best one so far, copy it to the global data buffer.
+                found = true;
+                foundLegacy = legacy;
+                foundUSN = usn;
+                seriesHeaderSlot = (seriesHeaderSlot & ~(1 << i)) | (slot << i);
+                seriesHeaderCRC[i] = xferBuf.u32[2];
+                memcpy(mainBuf.block[i], xferBuf.u8 + sizeof(xferBuf) - sizeof(*mainBuf.block), sizeof(*mainBuf.block));
+            }
+            if (!i)
+            {
+                // Without a valid first sector we can't tell which data is current, so initialize
+                // the whole series header with zeros and write all of it with the next save.
+                if (!found)
+                {
+                    memset(&mainBuf.seriesHeader, 0, sizeof(mainBuf.seriesHeader));
+                    memset(seriesHeaderCRC, 0, sizeof(seriesHeaderCRC));
+                    seriesHeaderDirty = ~0u >> (32 - seriesHeaderSectors);
+                    break;
+                }
+                committedUSN = foundUSN;
+                committedLegacy = foundLegacy;
+            }
+            // If there is no usable copy of this sector, initialize it with zeros.
+            if (!found) memset(mainBuf.block[i], 0, sizeof(*mainBuf.block));
+            // Make sure that the next save overwrites copies from incomplete saves and bad sectors.
+            if (!found || torn)
+            {
+                seriesHeaderCRC[i] = 0;
+                seriesHeaderDirty |= 1 << i;
+            }
         }
 
         // Detect present sensors and validate/update their information/configuration.
@@ -202,25 +226,45 @@ namespace StorageTask
     // Save series header (including sensor configuration) to SD card (run from storage task)
     static void doSaveSeriesHeader()
     {
-        // Reset dirty flag. Any changes past this point might not end up on the SD card.
-        seriesHeaderDirty = false;
-        // Switch to the sector that contains the older copy of the series header
-        seriesHeaderIndex ^= 1;
-        // Increment update sequence number
-        memset(&xferBuf, 0, sizeof(xferBuf));
-        xferBuf.u8[4] = ++seriesHeaderUSN;
-        // Calculate checksums and write all series header sectors to the selected copy
-        for (uint32_t i = 0; i < seriesHeaderSectors; i++)
+        // Reset dirty flags. Any changes past this point might not end up on the SD card.
+        uint32_t dirty = seriesHeaderDirty;
+        seriesHeaderDirty = 0;
+        uint32_t usn = seriesHeaderUSN + 1;
+        bool changed = false;
+        // Write every modified sector to its older copy. The first sector is written last (and always
+        // if anything else changed), completing the save by committing to the new update sequence number.
+        for (int i = seriesHeaderSectors - 1; i >= 0; i--)
         {
-            memcpy(xferBuf.u8 + sizeof(xferBuf) - sizeof(*mainBuf.block), mainBuf.block[i], sizeof(*mainBuf.block));
+            if (!(dirty & (1 << i)) && (i || !changed)) continue;
+            // Copy the sector data into the sector buffer and check if it actually differs from the SD card
+            memset(&xferBuf, 0, sizeof(xferBuf));
+            uint8_t* data = xferBuf.u8 + sizeof(xferBuf) - sizeof(*mainBuf.block);
+            memcpy(data, mainBuf.block[i], sizeof(*mainBuf.block));
+            xferBuf.u32[2] = crc32(data, sizeof(*mainBuf.block));
+            if (xferBuf.u32[2] == seriesHeaderCRC[i] && (i || !changed)) continue;
+            // Calculate the checksum and write the sector to the copy that isn't active
+            xferBuf.u32[1] = usn;
             *xferBuf.u32 = crc32(xferBuf.u8 + 4, sizeof(xferBuf) - 4);
-            SD::write(2 + seriesHeaderIndex * seriesHeaderSectors + i, 1, &xferBuf);
+            seriesHeaderSlot ^= 1 << i;
+            SD::write(2 + ((seriesHeaderSlot >> i) & 1) * seriesHeaderSectors + i, 1, &xferBuf);
+            seriesHeaderCRC[i] = xferBuf.u32[2];
+            changed = true;
         }
+        if (changed) seriesHeaderUSN = usn;
         // Signal completion
         state = State_Idle;
         SEV();
     }
 
+    // Flag the series header sectors containing the given data as modified (called externally)
+    void seriesHeaderModified(const void* data, uint32_t len)
+    {
+        uint32_t offset = (const uint8_t*)data - (const uint8_t*)&mainBuf.seriesHeader;
+        uint32_t first = offset / sizeof(*mainBuf.block);
+        uint32_t last = (offset + len - 1) / sizeof(*mainBuf.block);
+        seriesHeaderDirty |= (~0u >> (31 - last)) & ~((1u << first) - 1);
+    }
+
     // Save series header (including sensor configuration) to SD card (called externally)
     void saveSeriesHeader()
     {
@@ -242,6 +286,9 @@ namespace StorageTask
         // Signal request and wake up storage task
         state = State_Recording;
         currentBlockSeq = 0;
+        // The series header is still intact at this point (the sensor task has just started
+        // filling the blocks behind it), grab this series' checksum key from it.
+        recordingKey = mainBuf.seriesHeader.info.localTime;
         IRQ::wakeStorageTask();
     }
 
@@ -324,13 +371,39 @@ namespace StorageTask
     static void nextBlock(bool success)
     {
         // Account for data loss (if any)
-        if (!success) bufferOverflowLost += ARRAYLEN(*mainBuf.block);
+        if (!success) bufferOverflowLost += ARRAYLEN(*mainBuf.block) - currentPage;
+        currentPage = 0;
         // Increment data buffer pointer, wrapping around if necessary
         if (++currentBlock >= ARRAYLEN(mainBuf.block)) currentBlock = 0;
         // Increment sequence number to be written to the SD card
         currentBlockSeq++;
     }
 
+    // Write the recording sector buffer that is being filled to the SD card, containing the given number
+    // of pages (run from storage task in Recording state). The previous sector's transfer is completed
+    // first, the new one will be completed by the next call or by the recording loop.
+    static void writeRecordingSector(uint32_t pages)
+    {
+        SectorBuf* sector = fillSector;
+        if (pages < ARRAYLEN(sector->recording.data))
+        {
+            // Mark the sector as partially filled and zero the unused pages
+            sector->recording.pageSeq |= 0x80000000;
+            memset(sector->recording.data + pages, 0, sizeof(sector->recording.data) - pages * sizeof(Page));
+            sector->recording.data[ARRAYLEN(sector->recording.data) - 1].u32[6] = pages;
+        }
+        // Start calculating the checksum, the CRC unit is fed by DMA in the background.
+        CRC::start(sector->u8, sizeof(*sector) - 4);
+        // Complete the previous sector's transfer meanwhile, the card will start programming it.
+        if (writingSector) SD::finishSector();
+        // Store the checksum and write the sector to the SD card (once it's done with the previous one).
+        while (CRC::busy()) yield();
+        sector->recording.crc = CRC::finish() ^ recordingKey;
+        SD::startSector(sector->u8);
+        writingSector = sector;
+        fillSector = sector == &xferBuf ? &pipeBuf : &xferBuf;
+    }
+
     // Measurement data recording loop (run from storage task in Recording state)
     static void doRecording()
     {
@@ -338,46 +411,177 @@ namespace StorageTask
         uint32_t space = SD::pageCount - firstDataSector;
         // Prepare SD card for write operation (card firmware may perform pre-erase)
         SD::startWrite(firstDataSector, space);
-        // Zero unused sector header space
-        memset(xferBuf.recording.reserved, 0, sizeof(xferBuf.recording.reserved));
+        // Sectors are prepared and written alternating between two buffers. Pages are copied into one
+        // of them while the previous sector is being transferred to the card by DMA, and its checksum is
+        // calculated by the (DMA fed) CRC unit while that transfer completes.
+        fillSector = &xferBuf;
+        writingSector = NULL;
+        uint32_t fill = 0;  // Number of pages in fillSector
+        currentPage = 0;
         while (true)
         {
             if (mainBufSeq[currentBlock] < currentBlockSeq)
             {
-                // No untransmitted data available. If measurement has been stopped, return.
+                // No untransmitted data available. Complete the transfer in progress,
+                // so that the card can start programming it while we're waiting for more data.
+                if (writingSector)
+                {
+                    SD::finishSector();
+                    writingSector = NULL;
+                }
+                // If measurement has been stopped, return.
                 if (state != State_Recording) break;
                 // Otherwise yield control to lower-priority code until we're woken up again.
-                else yield();
+                yield();
+                continue;
             }
             if (!space || !mainBufValid[currentBlock] || mainBufSeq[currentBlock] != currentBlockSeq)
             {
-                // A measurement data buffer overflow occurred and we lost the block
-                // that we currently want to write to the SD card. Skip it.
+                // The buffer overflowed or the SD card is full, this block is lost.
+                // Write what we have so far, the next sector will start after the gap.
+                if (fill)
+                {
+                    writeRecordingSector(fill);
+                    space--;
+                    fill = 0;
+                }
                 nextBlock(false);
                 continue;
             }
-            // Grab a copy of the data to be sent
-            memcpy(xferBuf.recording.data, mainBuf.block[currentBlock], sizeof(*mainBuf.block));
+            // Grab a copy of as many pages of the block as fit into the sector
+            uint32_t pages = MIN(ARRAYLEN(*mainBuf.block) - currentPage, ARRAYLEN(fillSector->recording.data) - fill);
+            if (!fill) fillSector->recording.pageSeq = currentBlockSeq * ARRAYLEN(*mainBuf.block) + currentPage;
+            memcpy(fillSector->recording.data + fill, mainBuf.block[currentBlock] + currentPage, pages * sizeof(Page));
             if (!mainBufValid[currentBlock] || mainBufSeq[currentBlock] != currentBlockSeq)
             {
                 // The buffer overflowed while we were copying the block.
-                // It was probably partially overwritten. Skip it.
+                // The rest of the block is lost, write what we have so far.
+                if (fill)
+                {
+                    writeRecordingSector(fill);
+                    space--;
+                    fill = 0;
+                }
                 nextBlock(false);
                 continue;
             }
-            // Set header fields and write the block to the SD card.
-            xferBuf.recording.blockSeq = currentBlockSeq;
-            xferBuf.recording.crc = crc32(xferBuf.u8, sizeof(xferBuf) - 4);
-            SD::writeSector(xferBuf.u8);
-            // This block was written successfully, move on to the next one.
-            space--;
-            nextBlock(true);
+            // Move on to the next block once all of its pages were grabbed
+            fill += pages;
+            currentPage += pages;
+            if (currentPage >= ARRAYLEN(*mainBuf.block)) nextBlock(true);
+            // Write the sector to the SD card once it is full
+            if (fill >= ARRAYLEN(fillSector->recording.data))
+            {
+                writeRecordingSector(fill);
+                space--;
+                fill = 0;
+            }
         }
+        // Write the last (partially filled) sector and wait for the transfer to complete
+        if (fill && space) writeRecordingSector(fill);
+        if (writingSector) SD::finishSector();
         // Leave SD card write mode.
         // Any data sectors that were not actually written may contain garbage (usually zero) data.
         SD::endWrite();
     }
 
+    // Put storage task into measurement data readback mode (called externally)
+    void startReadback(uint32_t firstBlock, uint32_t blockCount)
+    {
+        // Check if the storage task is able to accept the request
+        if (state != State_Idle) error(Error_StorageStartReadbackNotIdle);
+        // Signal request and wake up storage task
+        state = State_Download;
+        readbackStop = false;
+        cmdArg = firstBlock;
+        cmdSize = blockCount;
+        IRQ::wakeStorageTask();
+    }
+
+    // Abort measurement data readback (called externally)
+    void stopReadback()
+    {
+        if (state != State_Download) return;
+        readbackStop = true;
+        IRQ::wakeStorageTask();
+    }
+
+    // Read a recording sector into xferBuf and check whether it belongs to the current series
+    // (run from storage task in Download state)
+    static void loadReadbackSector(uint32_t sector)
+    {
+        readSector = sector;
+        readPages = 0;
+        if (sector >= SD::pageCount) return;
+        SD::read(sector, 1, &xferBuf);
+        if ((crc32(xferBuf.u8, sizeof(xferBuf) - 4) ^ recordingKey) != xferBuf.recording.crc) return;
+        readPageSeq = xferBuf.recording.pageSeq & 0x7fffffff;
+        readPages = ARRAYLEN(xferBuf.recording.data);
+        if (xferBuf.recording.pageSeq & 0x80000000)
+            readPages = MIN(readPages, xferBuf.recording.data[ARRAYLEN(xferBuf.recording.data) - 1].u32[6]);
+    }
+
+    // Recorded measurement data readback loop (run from storage task in Download state)
+    static void doReadback()
+    {
+        uint32_t blockPages = ARRAYLEN(*mainBuf.block);
+        uint32_t firstPage = cmdArg * blockPages;
+        // The series header is in the measurement data buffer while we're idle, grab its checksum key
+        // before overwriting it. Sectors of any other recording will fail the checksum test.
+        recordingKey = mainBuf.seriesHeader.info.localTime;
+        // Pages are recorded in order, each sector holds at least one of them, and all valid sectors
+        // of the recording precede any invalid ones. Binary search for the last valid sector that
+        // starts at or before the first requested page.
+        uint32_t low = firstDataSector;
+        uint32_t high = MIN(firstDataSector + firstPage, SD::pageCount - 1);
+        while (low < high)
+        {
+            uint32_t mid = high - (high - low) / 2;
+            loadReadbackSector(mid);
+            if (readPages && readPageSeq <= firstPage) low = mid;
+            else high = mid - 1;
+        }
+        loadReadbackSector(low);
+        // Fill the measurement data buffer with the requested blocks (numbered from zero, like during a
+        // measurement), for the radio to transmit them. Blocks which aren't completely present on the card
+        // are marked invalid, the radio will skip them.
+        memset(mainBufSeq, 0, sizeof(mainBufSeq));
+        memset(mainBufValid, 0, sizeof(mainBufValid));
+        uint32_t block;
+        for (block = 0; block < cmdSize && !readbackStop; block++)
+        {
+            // Wait for the radio to finish transmitting the block that we're going to overwrite
+            while (block >= ARRAYLEN(mainBuf.block) && block - Radio::readbackBlocksSent() >= ARRAYLEN(mainBuf.block)
+                && !readbackStop) yield();
+            if (readbackStop) break;
+            uint32_t index = block % ARRAYLEN(mainBuf.block);
+            bool complete = true;
+            for (uint32_t page = 0; page < blockPages; page++)
+            {
+                uint32_t pageSeq = firstPage + block * blockPages + page;
+                // Advance to the sector containing the page (if there is one)
+                while (readPages && pageSeq >= readPageSeq + readPages) loadReadbackSector(readSector + 1);
+                if (!readPages || pageSeq < readPageSeq) complete = false;
+                else memcpy(mainBuf.block[index] + page, xferBuf.recording.data + pageSeq - readPageSeq, sizeof(Page));
+            }
+            // Publish the block (the radio checks the sequence number first, so it must be updated last)
+            mainBufValid[index] = complete;
+            mainBufSeq[index] = block;
+            // Start transmission once the first block is ready
+            if (!block) Radio::startReadbackTransmission(firstPage);
+        }
+        if (block)
+        {
+            // If the readback was aborted, drop any blocks that weren't transmitted yet
+            if (readbackStop) memset(mainBufValid, 0, sizeof(mainBufValid));
+            // Wait for radio transmission to complete
+            Radio::seriesComplete = true;
+            while (Radio::measuring) yield();
+        }
+        // Re-load the series header to the measurement data buffer
+        state = State_LoadSeriesHeader;
+    }
+
     // Storage task entry point (initially in Init state)
     static void run()
     {
@@ -412,6 +616,10 @@ namespace StorageTask
                 doRecording();
                 break;
 
+            case State_Download:
+                doReadback();
+                break;
+
             case State_Writing:
                 SD::write(firstDataSector + cmdArg, 1, &xferBuf);
                 // Signal completion
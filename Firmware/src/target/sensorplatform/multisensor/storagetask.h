@@ -18,6 +18,7 @@
 
 
 #include "global.h"
+#include "common.h"
 
 
 namespace StorageTask
@@ -31,21 +32,67 @@ namespace StorageTask
         State_LoadSeriesHeader,  // Loading series header (including sensor config) from SD card
         State_SaveSeriesHeader,  // Writing series header (including sensor config) to SD card
         State_Recording,  // Measurement recording in progress
-        State_Download,  // Recorded data download (via radio) in progress (not implemented yet)
+        State_Download,  // Recorded data readback (via radio) in progress
         State_Uploading,  // Sector buffer locked for SD card access via radio commands
         State_Writing,  // Sector buffer is being written to SD card (from Uploading state)
         State_Upgrading,  // Firmware upgrade triggered, will reboot into the updater
     };
 
+    // Measurement data sector layout on the SD card (stored in the series header, see SectorBuf)
+    static const uint8_t SD_LAYOUT = 1;
+
+    // SD card layout: Two copies of the node configuration (sectors 0 and 1), two copies of the
+    // series header, then the measurement data sectors of the last recording. Configuration and
+    // series header sectors start with a CRC32 of the rest of the sector and an update sequence number.
+    // Series header sectors are saved individually, each one alternating between its two copies, and the
+    // newer valid copy of each sector is the current one. The first sector is always written last and
+    // commits a save: Sector copies with a newer USN (32 bits) than its current copy belong to an
+    // incomplete save and are ignored. The USN is followed by a CRC32 of the sector's data block,
+    // which allows skipping sectors that haven't actually changed.
+    // Length of series header (including sensor configuration) in SD card sectors
+    static const uint32_t seriesHeaderSectors = sizeof(mainBuf.seriesHeader) / sizeof(*mainBuf.block);
+    
+    // First data sector number on the SD card
+    static const uint32_t firstDataSector = 2 + 2 * seriesHeaderSectors;
+
+    // Various interpretations of an SD card sector buffer
+    union __attribute__((packed,aligned(4))) SectorBuf
+    {
+        uint8_t u8[512];
+        uint32_t u32[128];
+        // Measurement data sector (SD_LAYOUT 1). The measurement data stream is stored as a continuous
+        // sequence of pages, spanning measurement data buffer blocks. If pages were lost, the sector
+        // before the gap is only partially filled, and the number of valid pages is stored in the last
+        // word of the last page. The checksum is XORed with the localTime field of the series header,
+        // so that sectors left behind by earlier (longer) recordings can't be mistaken for a continuation.
+        struct __attribute__((packed,aligned(4)))
+        {
+            uint32_t pageSeq;  // Stream sequence number of the first page (bit 31: partially filled)
+            Page data[18];
+            uint32_t crc;
+        } recording;
+        // Measurement data sector (SD_LAYOUT 0, one measurement data buffer block per sector)
+        struct __attribute__((packed,aligned(4)))
+        {
+            uint32_t blockSeq;
+            uint32_t reserved[7];
+            Page data[17];
+            uint32_t crc;
+        } recordingV0;
+    };
+
     extern State state;
     extern bool configDirty;
-    extern bool seriesHeaderDirty;
+    extern uint32_t seriesHeaderDirty;
     extern uint32_t bufferOverflowLost;
 
     extern void init();
     extern void saveConfig();
+    extern void seriesHeaderModified(const void* data, uint32_t len);
     extern void saveSeriesHeader();
     extern void startRecording();
+    extern void startReadback(uint32_t firstBlock, uint32_t blockCount);
+    extern void stopReadback();
     extern void startUpload();
     extern void uploadData(uint8_t index, const void* data);
     extern void writeSector(uint32_t sector);
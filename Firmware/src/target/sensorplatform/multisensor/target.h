@@ -87,6 +87,10 @@
 #define PIN_SD_MISO PIN_B4
 #define PIN_SD_MOSI PIN_B5
 
+#define CRC_DMA_CONTROLLER 0
+#define CRC_DMA_STREAM 0
+#define CRC_DMA_PRIORITY 0
+
 #define IMU_SPI_PRESCALER 5
 #define IMU_SPI_PRESCALER_FAST 1
 #define PIN_IMU_NCS PIN_B12
@@ -126,10 +130,11 @@
 // Tunables:
 // Command reception buffers (uses 32 * N bytes of RAM)
 #define RADIO_RX_BUFFERS 2
-// Data/response transmissions buffers (uses 32 * N bytes of RAM)
-#define RADIO_TX_BUFFERS 32 // 64
-// How many TX buffers should be reserved for responses
-#define RADIO_TX_BUFFER_RESERVE 0
+// Command response transmission buffers (uses 33 * N bytes of RAM)
+#define RADIO_TX_BUFFERS 8
+// Measurement data packets that may be in flight, these are transmitted straight from the
+// measurement data buffer (uses 7 * N bytes of RAM, at most 127 minus RADIO_TX_BUFFERS)
+#define RADIO_TX_PAGES 96
 // Maximum number of attempts to transmit a command response
 // (ignored, currently forced to unlimited in code)
 #define TX_ATTEMPTS_RESPONSE 15
@@ -140,8 +145,24 @@
 #define IDENT_ATTEMPT_INTERVAL 200000
 // Drop NodeId if it didn't get any time slots for N usec
 #define NODE_ID_TIMEOUT 3000000
+// Keep predicting SOF packet arrival times based on our clock rate estimate for up to N usec without a good timestamp
+#define RADIO_CLOCK_HOLDOVER 1000000
+// Acquire a new clock rate estimate if N consecutive SOF packets arrived outside the jitter window
+#define RADIO_CLOCK_OUTLIERS 3
+// Announce our NodeId again if we didn't receive SOF packets for more than N usec (the base station will stop polling us)
+#define RADIO_REJOIN_GAP 50000
+// After waking up, listen for SOF packets on the last channel that we were a member of for N msec before looking for beacons
+#define RADIO_REJOIN_WINDOW 20
+// Keep trying to rejoin the last channel directly for up to N sleep cycles
+#define RADIO_REJOIN_ATTEMPTS 8
 // Number of measurement data buffers (must be at least 16, uses 476 * N bytes of RAM)
-#define MAINBUF_BLOCK_COUNT 24
+#define MAINBUF_BLOCK_COUNT 23
+// Number of measurement records that can be waiting for an asynchronous (I2C) capture to complete
+// before the sensor task has to stop and wait for it (uses 24 * N bytes of RAM)
+#define SENSOR_RECORD_QUEUE_SIZE 12
+// Maximum number of gyroscope samples to read from the IMU FIFO at once (FIFO mode, uses 6 * N bytes of RAM).
+// The IMU FIFO (512 bytes) needs to be able to hold 2.5 bursts, and a burst must fit into a shared SPI transfer.
+#define IMU_FIFO_MAX_BURST 32
 // (Main) stack size in bytes. The other stacks are configured in sensortask.cpp and storagetask.cpp.
 //#define STACK_SIZE 1024
 
@@ -0,0 +1,76 @@
+// Sensor node sensor task schedule queue
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "taskqueue.h"
+#include "sys/time.h"
+
+
+namespace SensorTask
+{
+    // Whether task a needs to be run before task b (earlier time first, then insertion order)
+    bool TaskQueue::runsBefore(const ScheduledTask* a, const ScheduledTask* b)
+    {
+        if (a->time != b->time) return TIME_BEFORE(a->time, b->time);
+        return (int32_t)(a->seq - b->seq) < 0;
+    }
+
+    // Remove all tasks from the queue
+    void TaskQueue::clear()
+    {
+        count = 0;
+    }
+
+    // Insert a task into the queue in O(log n) time, returns false if the queue is full
+    bool TaskQueue::insert(ScheduledTask* task)
+    {
+        if (count >= CAPACITY) return false;
+        task->seq = nextSeq++;
+        // Move parents down until we have found the insertion point
+        int i = count++;
+        while (i)
+        {
+            int parent = (i - 1) >> 1;
+            if (!runsBefore(task, heap[parent])) break;
+            heap[i] = heap[parent];
+            i = parent;
+        }
+        heap[i] = task;
+        return true;
+    }
+
+    // Remove the task that needs to run next from the queue in O(log n) time (NULL if the queue is empty)
+    ScheduledTask* TaskQueue::pop()
+    {
+        if (!count) return NULL;
+        ScheduledTask* task = heap[0];
+        // Move the last task to the top and let it sink down to where it belongs
+        ScheduledTask* last = heap[--count];
+        int i = 0;
+        while (true)
+        {
+            int child = 2 * i + 1;
+            if (child >= count) break;
+            if (child + 1 < count && runsBefore(heap[child + 1], heap[child])) child++;
+            if (!runsBefore(heap[child], last)) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = last;
+        return task;
+    }
+}
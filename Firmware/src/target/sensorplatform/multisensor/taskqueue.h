@@ -0,0 +1,47 @@
+#pragma once
+
+// Sensor node sensor task schedule queue
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "sensortask.h"
+
+
+namespace SensorTask
+{
+    // Binary min-heap of pending ScheduledTasks, ordered by their target time.
+    // Tasks with the same target time are run in the order in which they were inserted.
+    // (The client software mirrors this in MultiSensorDevice.scheduleSensor() to figure out
+    // which record belongs to which sensor, so this tie breaking rule must not be changed.)
+    class TaskQueue
+    {
+    public:
+        static const int CAPACITY = 64;  // One capture task per possible sensor ID (see SeriesHeader)
+
+        void clear();
+        bool insert(ScheduledTask* task);
+        ScheduledTask* pop();
+        ScheduledTask* peek() const { return count ? heap[0] : NULL; }
+
+    private:
+        ScheduledTask* heap[CAPACITY];  // heap[0] is the task that needs to run next
+        uint8_t count = 0;  // Number of tasks in the heap
+        uint32_t nextSeq = 0;  // Sequence number to be assigned to the next inserted task
+
+        static bool runsBefore(const ScheduledTask* a, const ScheduledTask* b);
+    };
+}
@@ -40,20 +40,20 @@ namespace Clock
     // Turn on a clock to a peripheral with preemption lockout
     inline void __attribute__((always_inline)) onWithLock(int clkgate)
     {
-        volatile uint32_t* reg = &STM32_RCC_REGS.CLKGATES.d32[clkgate >> 5];
+        int index = clkgate >> 5;
         int bit = clkgate & 0x1f;
         __asm__ volatile("cpsid if");
-        *reg |= 1 << bit;
+        STM32_RCC_REGS.CLKGATES.d32[index] |= 1 << bit;
         __asm__ volatile("cpsie if");
     }
 
     // Turn off a clock to a peripheral with preemption lockout
     inline void __attribute__((always_inline)) offWithLock(int clkgate)
     {
-        volatile uint32_t* reg = &STM32_RCC_REGS.CLKGATES.d32[clkgate >> 5];
+        int index = clkgate >> 5;
         int bit = clkgate & 0x1f;
         __asm__ volatile("cpsid if");
-        *reg &= ~(1 << bit);
+        STM32_RCC_REGS.CLKGATES.d32[index] &= ~(1 << bit);
         __asm__ volatile("cpsie if");
     }
 
@@ -20,37 +20,90 @@
 #include "global.h"
 #include "hub.h"
 #include "sys/time.h"
+#include "cpu/arm/cortexm/cmsis.h"
 #include "usb.h"
 #include "radio.h"
 
 
 namespace Hub
 {
-    // Counts "RF packet received" notification USB messages
-    static uint16_t pktIndex;
+    // Maximum number of USB packets per NID_RFPacketBatch notification (0 or 1: no batching)
+    static uint8_t batchSize;
+    // Radio whose received packets are currently being sent straight out of its RX ring buffer
+    static uint8_t txRadio;
+    // Number of packets of that radio that are currently being sent (0: none)
+    static uint8_t txCount;
+
+    // Zero-copy forwarding of received packets (if batching is enabled): Hand the next batch of received
+    // packets of one of the radios (which take turns) to USB, to be sent straight out of its RX ring buffer.
+    USB::Packet* getTxPackets(int* count)
+    {
+        if (batchSize <= 1) return NULL;
+        for (int i = 0; i < Radio::COUNT; i++)
+        {
+            if (++txRadio >= Radio::COUNT) txRadio = 0;
+            Radio* radio = Radio::instance + txRadio;
+            uint32_t startCycles = DWT->CYCCNT;
+            USB::Packet* batch = radio->getRxBatch(batchSize, count);
+            if (!batch) continue;
+            txCount = batch->notify.rfPacketBatch.count;
+            radio->stats.fwdCycles += DWT->CYCCNT - startCycles;
+            radio->stats.fwdPackets += txCount;
+            return batch;
+        }
+        return NULL;
+    }
+
+    // Called by USB once the packets returned by getTxPackets have been sent
+    void releaseTxPackets()
+    {
+        Radio* radio = Radio::instance + txRadio;
+        uint32_t startCycles = DWT->CYCCNT;
+        radio->releaseRxPackets(txCount);
+        txCount = 0;
+        radio->stats.fwdCycles += DWT->CYCCNT - startCycles;
+    }
 
     void dpcHandlePackets()
     {
-        USB::Packet* txBuf = USB::getPacketBuf();
-        RF::Packet* rxPacket;
+        int txFree;
+        USB::Packet* txBuf = USB::getPacketBuf(&txFree);
         
         // Handle received RF packet while there are any (and free USB buffers).
         // This has higher priority than command handling in order to avoid buffer overruns.
         // Back pressure can be put both on USB commands and radio communication,
         // but the latter should be avoided because of limited buffer space on the sensor nodes.
-        while (txBuf && (rxPacket = Radio::getNextRxPacket()))
+        // The radios take turns, so that a busy channel can't lock out the others.
+        // (With batching, USB picks up the packets by itself, see getTxPackets.)
+        bool pending = batchSize <= 1;
+        while (txBuf && pending)
         {
-            // Build and enqueue "RF packet received" notification USB packet
-            memset(txBuf, 0, 32);
-            txBuf->header.type = USB::NID_RFPacketReceived;
-            txBuf->notify.rfPacketReceived.sofCount = Radio::stats.sofTotal;
-            txBuf->notify.rfPacketReceived.rxCount = Radio::stats.rxAcked;
-            txBuf->notify.rfPacketReceived.index = pktIndex++;
-            memcpy(txBuf->notify.rfPacketReceived.packet, rxPacket, sizeof(*rxPacket));
-            Radio::releaseRxPacket();
-            USB::submitPacket();
-            // Grab new USB buffer for the next iteration
-            txBuf = USB::getPacketBuf();
+            pending = false;
+            for (int i = 0; txBuf && i < Radio::COUNT; i++)
+            {
+                // Leave the radio alone if USB is still sending from its ring buffer (which must be released in order)
+                if (txCount && txRadio == i) continue;
+                Radio* radio = Radio::instance + i;
+                USB::Packet::Notify::RxPacket* rxPacket = radio->getNextRxPackets();
+                if (!rxPacket) continue;
+                pending = true;
+                uint32_t startCycles = DWT->CYCCNT;
+                // Build and enqueue "RF packet received" notification USB packet
+                memset(txBuf, 0, 32);
+                txBuf->header.type = USB::NID_RFPacketReceived;
+                txBuf->header.radio = i;
+                txBuf->notify.rfPacketReceived.sofCount = radio->stats.sofTotal;
+                txBuf->notify.rfPacketReceived.rxCount = radio->stats.rxAcked;
+                txBuf->notify.rfPacketReceived.index = radio->forwardRxPackets();
+                memcpy(&txBuf->notify.rfPacketReceived.info, &rxPacket->info, sizeof(rxPacket->info));
+                memcpy(txBuf->notify.rfPacketReceived.packet, rxPacket->packet, sizeof(rxPacket->packet));
+                radio->releaseRxPackets();
+                USB::submitPacket();
+                radio->stats.fwdCycles += DWT->CYCCNT - startCycles;
+                radio->stats.fwdPackets++;
+                // Grab new USB buffer for the next iteration
+                txBuf = USB::getPacketBuf(&txFree);
+            }
         }
         
         // Process USB command packets while we still have USB buffer space left
@@ -61,6 +114,7 @@ namespace Hub
             memset(txBuf, 0, sizeof(*txBuf));
             txBuf->header.type = USB::RID_CommandResult;
             txBuf->header.seq = cmd->header.seq;
+            txBuf->header.radio = cmd->header.radio;
             // Every handler should set this. If one doesn't, the status will be HandlerFailed.
             txBuf->reply.commandResult.status = USB::Status_HandlerFailed;
             // This flag can be set to false if we are unable to handle a command immediately.
@@ -69,24 +123,34 @@ namespace Hub
             // This flag is set by handlers to indicate whether a response packet should be sent.
             // We will only send responses of the sequence number in the command was non-zero.
             bool tx = !!cmd->header.seq;
-            switch (cmd->header.type)
+            // All other commands refer to a specific radio
+            Radio* radio = Radio::instance + cmd->header.radio;
+            if (cmd->header.type == USB::CID_SetPacketBatching)
+            {
+                // Configure radio packet notification batching
+                batchSize = MIN(cmd->cmd.setPacketBatching.maxSize, USB_TX_BUFFERS);
+                txBuf->reply.commandResult.status = USB::Status_OK;
+            }
+            else if (cmd->header.radio >= Radio::COUNT)
+                txBuf->reply.commandResult.status = USB::Status_InvalidArgument;
+            else switch (cmd->header.type)
             {
             case USB::CID_GetRadioStats:
                 // Get radio interface statistics / telemetry
-                memcpy(&txBuf->reply.commandResult.getRadioStats, &Radio::stats, sizeof(Radio::stats));
+                memcpy(&txBuf->reply.commandResult.getRadioStats, &radio->stats, sizeof(radio->stats));
                 txBuf->reply.commandResult.getRadioStats.localTime = read_usec_timer();
                 txBuf->reply.commandResult.status = USB::Status_OK;
                 break;
 
             case USB::CID_StopRadio:
                 // Stop radio communication
-                Radio::shutdown();
+                radio->shutdown();
                 txBuf->reply.commandResult.status = USB::Status_OK;
                 break;
 
             case USB::CID_StartRadio:
                 // Configure the radio interface as specified and start communication
-                Radio::configure(&cmd->cmd.startRadio.channel);
+                radio->configure(&cmd->cmd.startRadio.channel);
                 txBuf->reply.commandResult.status = USB::Status_OK;
                 break;
 
@@ -97,22 +161,22 @@ namespace Hub
                     {
                         // Check if that NodeId is already enqueued to be polled
                         uint32_t slot;
-                        for (slot = 0; slot < ARRAYLEN(Radio::nextPacketSlots); slot++)
-                            if (Radio::nextPacketSlots[slot].owner == cmd->cmd.assignSlots.slot[i].owner) break;
-                        if (slot >= ARRAYLEN(Radio::nextPacketSlots))  // If not:
+                        for (slot = 0; slot < ARRAYLEN(radio->nextPacketSlots); slot++)
+                            if (radio->nextPacketSlots[slot].owner == cmd->cmd.assignSlots.slot[i].owner) break;
+                        if (slot >= ARRAYLEN(radio->nextPacketSlots))  // If not:
                         {
                             // Attempt to find a free time slot during the next frame
                             // (Race conditions don't matter here because slots will
                             // never be allocated from a higher priority level)
-                            for (slot = 0; slot < ARRAYLEN(Radio::nextPacketSlots); slot++)
-                                if (!Radio::nextPacketSlots[slot].sticky && !Radio::nextPacketSlots[slot].owner) break;
-                            if (slot >= ARRAYLEN(Radio::nextPacketSlots))  // If there are none:
+                            for (slot = 0; slot < ARRAYLEN(radio->nextPacketSlots); slot++)
+                                if (!radio->nextPacketSlots[slot].sticky && !radio->nextPacketSlots[slot].owner) break;
+                            if (slot >= ARRAYLEN(radio->nextPacketSlots))  // If there are none:
                             {
                                 handled = false;  // Retry later
                                 break;
                             }
                             // If the node wasn't already enqueued and there is free slot, assign it
-                            Radio::nextPacketSlots[slot].owner = cmd->cmd.assignSlots.slot[i].owner;
+                            radio->nextPacketSlots[slot].owner = cmd->cmd.assignSlots.slot[i].owner;
                         }
                         // Remove the node from the list in the USB packet,
                         // in case we can't honor all requests immediately and re-run this later.
@@ -124,20 +188,29 @@ namespace Hub
 
             case USB::CID_AssignSlots:
                 // Set permanent time slot assignments (0: Assign dynamically)
-                memcpy(Radio::nextPacketSlots, cmd->cmd.assignSlots.slot, sizeof(Radio::nextPacketSlots));
+                memcpy(radio->nextPacketSlots, cmd->cmd.assignSlots.slot, sizeof(radio->nextPacketSlots));
+                txBuf->reply.commandResult.status = USB::Status_OK;
+                break;
+
+            case USB::CID_SetNodeWeights:
+                // Configure dynamic slot assignment weights
+                for (uint32_t i = 0; i < ARRAYLEN(cmd->cmd.setNodeWeights.node); i++)
+                    if (cmd->cmd.setNodeWeights.node[i].nodeId)
+                        radio->scheduler.setNodeWeight(cmd->cmd.setNodeWeights.node[i].nodeId,
+                                                 cmd->cmd.setNodeWeights.node[i].weight);
                 txBuf->reply.commandResult.status = USB::Status_OK;
                 break;
 
             case USB::CID_TransmitCommand:
             {
                 // Transmit a radio packet
-                RF::Packet* packet = Radio::getCommandBuffer();
+                RF::Packet* packet = radio->getCommandBuffer();
                 if (!packet) handled = false;  // If there was no buffer space, retry later
                 else
                 {
                     // Enqueue the radio packet
                     memcpy(packet, cmd->cmd.transmitCommand.command, sizeof(*packet));
-                    Radio::enqueueCommand(cmd->cmd.transmitCommand.targetNode);
+                    radio->enqueueCommand(cmd->cmd.transmitCommand.targetNode);
                     txBuf->reply.commandResult.status = USB::Status_OK;
                 }
                 break;
@@ -153,7 +226,7 @@ namespace Hub
             if (tx)
             {
                 USB::submitPacket();
-                txBuf = USB::getPacketBuf();
+                txBuf = USB::getPacketBuf(&txFree);
             }
             // If we have fully processed the USB command, discard it
             if (handled) USB::markProcessed();
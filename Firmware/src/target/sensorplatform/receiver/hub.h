@@ -18,9 +18,12 @@
 
 
 #include "global.h"
+#include "../common/protocol/usbproto.h"
 
 
 namespace Hub
 {
+    extern USB::Packet* getTxPackets(int* count);
+    extern void releaseTxPackets();
     extern void dpcHandlePackets();
 }
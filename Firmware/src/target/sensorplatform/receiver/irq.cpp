@@ -45,11 +45,15 @@ namespace IRQ
 
         // Radio interrupt priority class:
         // These IRQs preempt everything else, but not each other to avoid race conditions.
-        // At the time when a timer IRQ arrives, none of the other IRQ handlers should be active.
-        irq_set_priority(dma1_stream3_IRQn, 0);  // Radio RX DMA
-        irq_set_priority(dma1_stream4_IRQn, 0);  // Radio TX DMA
-        irq_set_priority(exti4_IRQn, 0);  // Radio IRQ
-        irq_set_priority(tim7_IRQn, 0);  // Radio timer
+        // At the time when a timer IRQ arrives, none of the other IRQ handlers of that radio should be active.
+        // (Handlers of different radios delay each other by a few microseconds, which the guard bits absorb.)
+#define DEFINE_RADIO(prefix) \
+        irq_set_priority(RADIO_IRQN(prefix ## _DMA_RX_VECTOR), 0);  /* Radio RX DMA */ \
+        irq_set_priority(RADIO_IRQN(prefix ## _DMA_TX_VECTOR), 0);  /* Radio TX DMA */ \
+        irq_set_priority(RADIO_IRQN(prefix ## _NIRQ_VECTOR), 0);  /* Radio IRQ */ \
+        irq_set_priority(RADIO_IRQN(prefix ## _TIMER_VECTOR), 0);  /* Radio timer */
+#include "radio_defs.h"
+#undef DEFINE_RADIO
 
         // Background task priority class:
         irq_set_priority(otg_hs_IRQn, 3);  // Main USB IRQ
@@ -57,27 +61,6 @@ namespace IRQ
         irq_set_priority(PendSV_IRQn, 3);  // Deferred procedure calls
     }
 
-    void enableRadioIRQ(bool on)
-    {
-        irq_enable(exti4_IRQn, on);
-    }
-
-    void enableRadioTimerIRQ(bool on)
-    {
-        irq_enable(tim7_IRQn, on);
-    }
-
-    void enableRadioDMAIRQs(bool on)
-    {
-        irq_enable(dma1_stream3_IRQn, on);
-        irq_enable(dma1_stream4_IRQn, on);
-    }
-
-    void clearRadioTimerIRQ()
-    {
-        irq_clear_pending(tim7_IRQn);
-    }
-
     void setPending(DPCNumber dpc)
     {
         dpcPending[dpc] = true;
@@ -85,27 +68,30 @@ namespace IRQ
     }
 }
 
-extern "C" void dma1_stream3_irqhandler()  // Radio RX DMA
-{
-    DMA::clearIRQFromPri0(0, 3);
-    Radio::handleRXDMACompletion();
-}
-
-extern "C" void dma1_stream4_irqhandler()  // Radio TX DMA
-{
-    DMA::clearIRQFromPri0(0, 4);
-    Radio::handleTXDMACompletion();
-}
-
-extern "C" void exti4_irqhandler()  // Radio IRQ
-{
-    Radio::handleIRQ();
-}
-
-extern "C" void tim7_irqhandler()  // Radio timer
-{
-    Radio::timerTick();
+#define DEFINE_RADIO(prefix) \
+extern "C" void RADIO_IRQ_HANDLER(prefix ## _DMA_RX_VECTOR)()  /* Radio RX DMA */ \
+{ \
+    DMA::clearIRQFromPri0(prefix ## _DMA_RX_CONTROLLER, prefix ## _DMA_RX_STREAM); \
+    Radio::instance[Radio::Index_ ## prefix].handleRXDMACompletion(); \
+} \
+ \
+extern "C" void RADIO_IRQ_HANDLER(prefix ## _DMA_TX_VECTOR)()  /* Radio TX DMA */ \
+{ \
+    DMA::clearIRQFromPri0(prefix ## _DMA_TX_CONTROLLER, prefix ## _DMA_TX_STREAM); \
+    Radio::instance[Radio::Index_ ## prefix].handleTXDMACompletion(); \
+} \
+ \
+extern "C" void RADIO_IRQ_HANDLER(prefix ## _NIRQ_VECTOR)()  /* Radio IRQ */ \
+{ \
+    Radio::instance[Radio::Index_ ## prefix].handleIRQ(); \
+} \
+ \
+extern "C" void RADIO_IRQ_HANDLER(prefix ## _TIMER_VECTOR)()  /* Radio timer */ \
+{ \
+    Radio::instance[Radio::Index_ ## prefix].timerTick(); \
 }
+#include "radio_defs.h"
+#undef DEFINE_RADIO
 
 extern "C" void PendSV_faulthandler()  // Deferred procedure calls
 {
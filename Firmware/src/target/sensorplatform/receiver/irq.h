@@ -31,9 +31,5 @@ namespace IRQ
     };
 
     extern void init();
-    extern void enableRadioIRQ(bool on);
-    extern void enableRadioTimerIRQ(bool on);
-    extern void enableRadioDMAIRQs(bool on);
-    extern void clearRadioTimerIRQ();
     extern void setPending(DPCNumber dpc);
 }
@@ -20,6 +20,7 @@
 #include "sys/time.h"
 #include "sys/util.h"
 #include "soc/stm32/gpio.h"
+#include "cpu/arm/cortexm/cmsis.h"
 #include "driver/dma.h"
 #include "driver/random.h"
 #include "irq.h"
@@ -32,6 +33,10 @@ int main()
     // Setup IRQ priorities
     IRQ::init();
 
+    // Start the CPU cycle counter (used for performance statistics)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
     // Start up true random number generator
     Random::init();
 
@@ -47,7 +52,7 @@ int main()
     GPIO::enableFast(PIN_D0, true);
 
     // Radio one-time initialization (hardware setup)
-    Radio::init();
+    for (int i = 0; i < Radio::COUNT; i++) Radio::instance[i].init();
 
     // Start up USB stack and message processing
     USB::start();
@@ -19,24 +19,170 @@
 
 #include "global.h"
 #include "device/nrf/nrf24l01p/nrf24l01p.h"
+#include "cpu/arm/cortexm/irq.h"
+#include "interface/gpio/gpio.h"
 #include "sys/util.h"
+#include "driver/spi.h"
+#include "driver/dma.h"
+#include "../common/driver/timer.h"
 #include "../common/protocol/usbproto.h"
+#include "scheduler.h"
 
 
-namespace Radio
+// Translate IRQ vector names (from target.h) into IRQ numbers and handler function names
+#define RADIO_IRQN2(vector) vector ## _IRQn
+#define RADIO_IRQN(vector) RADIO_IRQN2(vector)
+#define RADIO_IRQ_HANDLER2(vector) vector ## _irqhandler
+#define RADIO_IRQ_HANDLER(vector) RADIO_IRQ_HANDLER2(vector)
+
+
+// One nRF24L01+ radio operating its own channel (with its own SPI bus, DMA streams and frame timer).
+// The instances are defined in radio_defs.h, their index is the radio number used in USB packet headers.
+class Radio final
 {
-    extern USB::RadioStats stats;
-    extern RF::TimeSlotOwner nextPacketSlots[ARRAYLEN(RF::Packet::SOF::slot)];
-
-    extern void init();
-    extern void shutdown();
-    extern void configure(RF::ExtendedChannelAttributes* channelAttrs);
-    extern void handleRXDMACompletion();
-    extern void handleTXDMACompletion();
-    extern void handleIRQ();
-    extern void timerTick();
-    extern RF::Packet* getCommandBuffer();
-    extern void enqueueCommand(uint8_t target);
-    extern RF::Packet* getNextRxPacket();
-    extern void releaseRxPacket();
-}
+public:
+    enum Index
+    {
+#define DEFINE_RADIO(prefix) Index_ ## prefix,
+#include "radio_defs.h"
+#undef DEFINE_RADIO
+        COUNT
+    };
+
+    // Hardware resources used by a radio instance
+    struct Hardware
+    {
+        volatile STM32_SPI_REG_TYPE* spi;  // SPI bus that the radio chip is connected to
+        int spiClk;  // SPI bus clock gate
+        uint8_t spiPrescaler;  // SPI bus clock divider
+        uint8_t dmaRxController;  // SPI RX DMA controller number
+        uint8_t dmaRxStream;  // SPI RX DMA stream number
+        uint8_t dmaTxController;  // SPI TX DMA controller number
+        uint8_t dmaTxStream;  // SPI TX DMA stream number
+        volatile STM32_DMA_STREAM_REG_TYPE* dmaRx;  // SPI RX DMA stream registers
+        volatile STM32_DMA_STREAM_REG_TYPE* dmaTx;  // SPI TX DMA stream registers
+        DMA::Config dmaRxCfg;  // Packet download configuration
+        DMA::Config dmaTxCfg;  // Packet upload configuration
+        DMA::Config dummyTxCfg;  // Dummy data upload configuration (during packet downloads)
+        volatile STM32_TIM_REG_TYPE* timer;  // Frame timer
+        int timerClk;  // Frame timer clock gate
+        ::GPIO::Pin ncs;  // Radio chip select pin
+        ::GPIO::Pin ce;  // Radio chip enable pin
+        ::GPIO::Pin nirq;  // Radio IRQ pin
+        IRQn_Type irq;  // EXTI IRQ of the radio IRQ pin
+        IRQn_Type timerIrq;  // Frame timer IRQ
+        IRQn_Type dmaRxIrq;  // SPI RX DMA IRQ
+        IRQn_Type dmaTxIrq;  // SPI TX DMA IRQ
+    };
+
+    USB::RadioStats stats;  // Radio statistics
+    RF::TimeSlotOwner nextPacketSlots[ARRAYLEN(RF::Packet::SOF::slot)];  // Planned slot owners for the next frame
+    Scheduler scheduler;  // Dynamic time slot assignment state
+
+    Radio(const Hardware* hw) : hw(hw) {}
+    void init();
+    void shutdown();
+    void configure(RF::ExtendedChannelAttributes* channelAttrs);
+    void handleRXDMACompletion();
+    void handleTXDMACompletion();
+    void handleIRQ();
+    void timerTick();
+    RF::Packet* getCommandBuffer();
+    void enqueueCommand(uint8_t target);
+    USB::Packet::Notify::RxPacket* getNextRxPackets(int* count = NULL);
+    USB::Packet* getRxBatch(int maxSize, int* size);
+    uint16_t forwardRxPackets(int count = 1);
+    void releaseRxPackets(int count = 1);
+
+    static Radio instance[COUNT];
+
+private:
+    enum State
+    {
+        State_WaitForRx = 0,  // Waiting for data packets to arrive, blocked on radio IRQ or timer
+        State_DownloadRx,  // Downloading received packet, blocked on RX DMA
+        State_DownloadBeforePTX,  // We were downloading a packet when the timer hit, switch to PTX once that finishes
+        State_DownloadBeforeSOF,  // Downloading received packet while locking PLL for SOF TX, blocked on RX DMA
+        State_UploadSOF,  // Uploading SOF packet, blocked on TX DMA
+        State_WaitSentBeforeSOF,  // Transmitting dummy packet, blocked on radio IRQ, the next packet is SOF
+        State_UploadBeacon,  // Uploading beacon packet, blocked on TX DMA
+        State_WaitSentBeforeBeacon,  // Transmitting SOF packet, blocked on radio IRQ, this will be a beacon frame
+        State_UploadCommand,  // Uploading command packet, blocked on TX DMA
+        State_WaitSentBeforeCommand,  // Transmitting something packet, blocked on radio IRQ, there will more commands
+        State_WaitSentBeforePRX,  // Transmitting last packet, blocked on radio IRQ, will switch to PRX mode after that
+    };
+
+    const Hardware* const hw;  // Hardware resources used by this instance
+    bool operating = false;  // Whether the radio was configured since the last shutdown (and is thus currently operating)
+    State currentState = State_WaitForRx;  // Current state of the radio state machine
+    bool dmaActive = false;  // Whether a DMA transfer is currently controlling the SPI bus (locking out IRQs)
+    RF::Packet::Beacon beaconPacket;  // Beacon packet that advertizes the channel controlled by this device
+    RF::Packet::SOF sofPacket;  // Buffer that is used to build SOF packets, also keeps track of the sequence number
+    int sofTimestamp = 0;  // The full timestamp from the current SOF packet
+    int frameStartTime = 0;  // The time at which the transmission of the last SOF packet was completed
+    int frameBits = 0;  // Frame timer period (in bit times) of a frame with all 28 slots
+    uint8_t frameSlots = ARRAYLEN(RF::Packet::SOF::slot);  // Number of RX slots of the current frame
+    uint32_t burstSlots = 0;  // Slots of the current frame that continue a burst (see RF::getBurstSlots)
+    // Current radio configuration, switches between PTX and PRX mode
+    NRF::NRF24L01P::Config radioCfg{NRF::Radio::Role_PTX, true, NRF::Radio::CrcMode_16Bit, true, false, false};
+    // Current radio RF setup, cached here so that we can switch back to the
+    // settings of our own channel easily after sending a beacon packet.
+    NRF::NRF24L01P::RfSetup rfSetup;
+    // This counts the number of consecutive frames that have been used to send commands, including the current one.
+    // If it is nonzero, the current frame contains command slots instead of a beacon. It is also used to ensure
+    // that beacons are sent periodically even if command packets are available during every frame by enforcing a limit.
+    uint8_t cmdFrameCount = 0;
+    int lastRxTime = 0;  // The time at which we received the packet that's currently being downloaded via DMA
+    int8_t prevRxSlot = 0;  // The slot number that we associated the previously received packet with.
+    uint8_t commandsSent = 0;  // How many command packets we have already uploaded during this frame
+    // Ring buffer of pending commands and their target addresses
+    uint8_t cmdTarget[RADIO_CMD_BUFFERS];
+    RF::Packet cmdData[RADIO_CMD_BUFFERS];
+    uint8_t cmdWritePtr = 0;
+    uint8_t cmdReadPtr = 0;
+    // Ring buffer of received packets and their reception info. The entries are laid out like those of
+    // a NID_RFPacketBatch notification, so that a run of them can be sent to the host as it is, once the
+    // notification header was put in front of it (see getRxBatch). The ones between rxReadPtr and rxSendPtr
+    // have been forwarded to USB already, but need to be kept around until their transmission has finished.
+    struct RxRing
+    {
+        uint8_t header[__builtin_offsetof(USB::Packet::Notify::RFPacketBatch, packet)];  // Header of a batch at entry 0
+        USB::Packet::Notify::RxPacket entry[RADIO_RX_BUFFERS];
+        uint8_t padding[sizeof(USB::Packet)];  // Rest of the last USB packet of a batch ending at the last entry
+    } rxRing;
+    uint16_t rxWritePtr = 0;
+    uint16_t rxSendPtr = 0;
+    uint16_t rxReadPtr = 0;
+    uint16_t rxIndex = 0;  // Number of packets that were forwarded to USB
+    // Measurement data acknowledgement window of each node (see RF::Packet::Command::DataAck).
+    // Windows that changed are broadcast in command slots that aren't needed for anything else.
+    struct DataAckWindow
+    {
+        uint16_t seq;  // Highest measurement data sequence number received from the node
+        bool valid : 1;  // Whether we received any measurement data since the node last reported NoData
+        bool changed : 1;  // Whether the window changed since it was last broadcast
+        uint32_t bitmap;  // Bit N set: seq - 1 - N was received as well
+    } dataAck[RF::MaxNode + 1];  // Array element 0 should never be accessed
+    uint8_t dataAckChanged = 0;  // Number of windows that need to be broadcast
+    uint8_t dataAckNext = RF::MinNode;  // Node ID to start searching for changed windows at
+    bool sendingDataAck = false;  // Whether the command packet being uploaded is dataAckPacket
+    RF::Packet dataAckPacket;  // Buffer that is used to build data acknowledgement broadcasts
+
+    void setState(State newState);
+    void spiOn();
+    void spiOff();
+    void enableIRQ(bool on);
+    NRF::SPI::Status sendCmd(uint8_t cmd);
+    NRF::SPI::Status getStatus();
+    NRF::SPI::Status writeReg(uint8_t reg, uint8_t data);
+    void startPacketUpload(void* packet, size_t len);
+    void startPacketDownload(void* packet, size_t len);
+    void sendSOF();
+    bool checkReceived(State downloadState, int time);
+    void prepareNextDummyPacket();
+    void switchToPTX();
+    bool trySendCommand();
+    bool trySendDataAck();
+    void resetDataAck(int nodeId);
+    void updateDataAck(const RF::Packet::Reply* reply);
+};
@@ -0,0 +1,20 @@
+// SensorPlatform Base Station Radio Instances
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// One line per radio, the argument is the prefix of its hardware resource definitions in target.h
+// (<prefix>_SPI_BUS, <prefix>_TIMER, <prefix>_DMA_RX_STREAM, <prefix>_NIRQ_VECTOR, PIN_<prefix>_NCS etc.)
+
+DEFINE_RADIO(RADIO)
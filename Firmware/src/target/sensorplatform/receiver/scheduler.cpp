@@ -0,0 +1,330 @@
+// SensorPlatform Base Station Slot Scheduler
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Dynamic time slot assignment, based on buffer level information reported back by the nodes.
+// This doesn't touch any hardware, so that it can also be built for the host simulation target.
+//
+// Slots are distributed using deficit round robin: Every frame, each node that has data to send
+// earns credit according to its weight and urgency level, and pays for every slot it gets.
+// Slots that aren't backed by any node's credit are handed out anyway if there is demand,
+// driving the credit of the receiving nodes negative, which they will have to pay back later.
+// Unused credit is carried over to the next frames (up to SCHEDULER_CREDIT_LIMIT slots).
+//
+// Nodes that are running a measurement report the bit rate of their sensor schedule in NoData packets.
+// That rate is translated into a number of slots per frame, which are reserved for the node before
+// anything else is handed out, so that it doesn't have to build up a backlog to be served.
+// Such nodes are never put into NoDataSkip state, their reservation takes care of polling them.
+//
+// The passes below only count the slots that each node gets. They are laid out at the end, such that
+// every node gets a contiguous run of slots, which it can send back to back (see ChannelAttributes::burst).
+
+
+#include "global.h"
+#include "scheduler.h"
+#include "sys/util.h"
+#include "sys/time.h"
+
+
+// Credit is accounted for in fractional slots, 1 slot = 1 << CREDIT_SHIFT
+#define CREDIT_SHIFT 4
+#define CREDIT_LIMIT (SCHEDULER_CREDIT_LIMIT << CREDIT_SHIFT)
+// Slot reservations are accounted for in fractional slots, 1 slot = 1 << RESERVE_SHIFT
+#define RESERVE_SHIFT 12
+// Measurement data bits per packet
+#define RESERVE_PACKET_BITS (sizeof(RF::Packet::Reply::MeasurementData::data) * 8)
+
+
+// Move a node to a different priority list
+void Scheduler::setNodePriority(int nodeId, NodePriority newPriority)
+{
+    // Calculate list entry address
+    NodeInfo* node = nodeInfo + nodeId;
+    int oldPriority = node->priority;
+    // If the priority didn't change, we don't need to do anything.
+    if (oldPriority == newPriority) return;
+    node->priority = newPriority;
+    // Update list element counts. (This whole function can't be preempted, don't worry about races here.)
+    priorityCount[oldPriority]--;
+    priorityCount[newPriority]++;
+    // Unlink the node from its current list
+    if (node->next) nodeInfo[node->next].prev = node->prev;
+    else priorityTail[oldPriority] = node->prev;
+    if (node->prev) nodeInfo[node->prev].next = node->next;
+    else priorityHead[oldPriority] = node->next;
+    // Insert it as the head of its target list
+    node->prev = 0;
+    node->next = priorityHead[newPriority];
+    priorityHead[newPriority] = nodeId;
+    if (node->next) nodeInfo[node->next].prev = nodeId;
+    else priorityTail[newPriority] = nodeId;
+}
+
+
+// Rotate a priority list, such that nodeId becomes its head (and its predecessor the tail)
+void Scheduler::rotateList(int priority, int nodeId)
+{
+    if (!nodeId || nodeId == priorityHead[priority]) return;
+    NodeInfo* node = nodeInfo + nodeId;
+    int oldTail = priorityTail[priority];
+    int oldHead = priorityHead[priority];
+    nodeInfo[oldTail].next = oldHead;
+    nodeInfo[oldHead].prev = oldTail;
+    int newTail = node->prev;
+    nodeInfo[newTail].next = 0;
+    node->prev = 0;
+    priorityHead[priority] = nodeId;
+    priorityTail[priority] = newTail;
+}
+
+
+// Assign a number of slots to a node, starting the search for free slots at *slot
+static void assign(RF::Packet::SOF* sof, int* slot, int nodeId, int count)
+{
+    while (count--)
+    {
+        // Find the next free slot.
+        while (sof->slot[*slot].owner != RF::Address::Notify) (*slot)++;
+        // Assign the slot to the current node.
+        sof->slot[*slot].owner = nodeId;
+    }
+}
+
+
+// Assign free slots (marked as RF::Address::Notify) of a SOF packet to nodes, until timeout is hit
+void Scheduler::assignSlots(RF::Packet::SOF* sof, int freeSlots, int timeout)
+{
+    int slot = 0;
+    // Active nodes that could make use of more slots than their credit covers (in round robin order)
+    uint8_t wanting[RF::MaxNode];
+    int wantingCount = 0;
+    // Nodes that get polled with a single slot
+    uint8_t polled[ARRAYLEN(sof->slot)];
+    int polledCount = 0;
+    // First node that we didn't get to, will be the head of the list during the next frame
+    int resume = 0;
+    // Hold back a slot for polling (third pass), otherwise busy active nodes could starve
+    // the polled nodes for so long that they would drop their node IDs.
+    int pollSlots = MIN(freeSlots, priorityCount[Priority_SingleSlotPoll] ? 1 : 0);
+    freeSlots -= pollSlots;
+
+    // First pass: Assign the slots that active nodes have reserved based on their measurement data rate.
+    int nodeId = priorityHead[Priority_Active];
+    for (int count = priorityCount[Priority_Active]; count--; nodeId = nodeInfo[nodeId].next)
+    {
+        NodeInfo* node = nodeInfo + nodeId;
+        node->demand = 0;
+        node->slots = 0;
+        if (!node->reservation) continue;
+        // Accumulate the reservation, but don't let a node build up a huge backlog if we can't serve it.
+        node->reserved = MIN(node->reserved + node->reservation, MAX_SLOTS_PER_NODE << RESERVE_SHIFT);
+        if (!freeSlots || TIMEOUT_EXPIRED(timeout)) continue;
+        // Don't hand out more than the node can make use of (as far as we know), to avoid wasting
+        // slots on nodes with bursty sampling schedules. It will catch up later using its accumulated
+        // reservation once it reports pending packets again.
+        int demand = MIN(MAX(node->info.pendingPackets, 1), MAX_SLOTS_PER_NODE);
+        int grant = MIN(node->reserved >> RESERVE_SHIFT, (uint32_t)demand);
+        grant = MIN(grant, freeSlots);
+        freeSlots -= grant;
+        node->reserved -= grant << RESERVE_SHIFT;
+        node->slots = grant;
+    }
+
+    // Second pass: Hand out credit to active nodes, and assign as many slots as their credit covers.
+    nodeId = priorityHead[Priority_Active];
+    for (int count = priorityCount[Priority_Active]; count--; nodeId = nodeInfo[nodeId].next)
+    {
+        NodeInfo* node = nodeInfo + nodeId;
+        if (!freeSlots || TIMEOUT_EXPIRED(timeout))
+        {
+            if (!resume) resume = nodeId;
+            continue;
+        }
+        // Credit scales with the urgency level that the node reported (1x for level 0 up to 4.5x for level 7)
+        int weight = nodeWeight[nodeId] ? nodeWeight[nodeId] : SCHEDULER_DEFAULT_WEIGHT;
+        node->credit += (weight * (node->info.urgency + 2)) >> 1;
+        // Figure out how many slots we can (sensibly) assign to that node. Always offer at least one,
+        // it will respond with a NoData packet if it has nothing to send, unless the node has a
+        // reservation, which will poll it often enough.
+        int demand = node->reservation ? node->info.pendingPackets : MAX(node->info.pendingPackets, 1);
+        demand = MIN(demand, MAX_SLOTS_PER_NODE) - node->slots;
+        demand = MAX(demand, 0);
+        int grant = MAX(node->credit, 0) >> CREDIT_SHIFT;
+        grant = MIN(grant, demand);
+        grant = MIN(grant, freeSlots);
+        freeSlots -= grant;
+        node->credit = MIN(node->credit - (grant << CREDIT_SHIFT), CREDIT_LIMIT);
+        node->demand = demand - grant;
+        if (node->demand) wanting[wantingCount++] = nodeId;
+        node->slots += grant;
+    }
+    // If we ran out of slots, start with the first node that didn't get any during the next frame.
+    rotateList(Priority_Active, resume);
+
+    // Third pass: Poll nodes which we don't know much about with a single slot each.
+    freeSlots += pollSlots;
+    int count = MIN(freeSlots, priorityCount[Priority_SingleSlotPoll]);
+    nodeId = priorityHead[Priority_SingleSlotPoll];
+    while (!TIMEOUT_EXPIRED(timeout) && count--)
+    {
+        NodeInfo* node = nodeInfo + nodeId;
+        polled[polledCount++] = nodeId;
+        freeSlots--;
+        node->frames++;
+        nodeId = node->next;
+    }
+    // Move the nodes that we have processed to the tail of the list.
+    rotateList(Priority_SingleSlotPoll, nodeId);
+
+    // Fourth pass: Distribute the remaining slots one by one to active nodes that could use more
+    // than their credit covered. They will pay for that by going into debt.
+    while (freeSlots && wantingCount && !TIMEOUT_EXPIRED(timeout))
+        for (int i = 0; freeSlots && i < wantingCount; )
+        {
+            nodeId = wanting[i];
+            NodeInfo* node = nodeInfo + nodeId;
+            freeSlots--;
+            node->credit = MAX(node->credit - (1 << CREDIT_SHIFT), -CREDIT_LIMIT);
+            node->slots++;
+            // Drop the node from the list once it doesn't want any more slots
+            if (--node->demand) i++;
+            else wanting[i] = wanting[--wantingCount];
+        }
+
+    // Lay out the slots of active nodes as contiguous runs, and increment the frame loss counters of
+    // those that got any. (Will be reset to 0 if we receive any packets from the node during the frame.)
+    nodeId = priorityHead[Priority_Active];
+    for (int count = priorityCount[Priority_Active]; count--; nodeId = nodeInfo[nodeId].next)
+    {
+        NodeInfo* node = nodeInfo + nodeId;
+        if (!node->slots) continue;
+        assign(sof, &slot, nodeId, node->slots);
+        node->frames++;
+    }
+    // Polled nodes go last.
+    for (int i = 0; i < polledCount; i++) assign(sof, &slot, polled[i], 1);
+}
+
+
+// Drop unassigned slots from the end of the frame (but keep FRAME_SPARE_SLOTS notification slots and at least minSlots
+// slots in total) by marking them as RF::Address::FrameEnd. Returns the number of slots that remain part of the frame.
+int Scheduler::trimFrame(RF::Packet::SOF* sof, int minSlots)
+{
+    int slots = ARRAYLEN(sof->slot);
+    while (slots && sof->slot[slots - 1].owner == RF::Address::Notify) slots--;
+    slots = MIN(MAX(slots + FRAME_SPARE_SLOTS, minSlots), (int)ARRAYLEN(sof->slot));
+    for (uint32_t i = slots; i < ARRAYLEN(sof->slot); i++) sof->slot[i].owner = RF::Address::FrameEnd;
+    return slots;
+}
+
+
+// Set the deficit round robin weight of a node (0: SCHEDULER_DEFAULT_WEIGHT).
+// It is reset to the default when the node is disconnected (see finishFrame) or the scheduler is reset.
+void Scheduler::setNodeWeight(int nodeId, int weight)
+{
+    if (nodeId < 1 || nodeId >= (int)ARRAYLEN(nodeWeight)) return;
+    nodeWeight[nodeId] = weight;
+}
+
+
+// Decrement frame skip counters and move nodes that have lost too many frames to single-slot polling.
+// Called after the SOF packet has been handed off to the radio. The IDs of nodes that were dropped
+// (disconnected or moved back to polling due to frame loss) are stored in dropped, which must have
+// space for ARRAYLEN(sof->slot) entries. Returns the number of dropped nodes.
+int Scheduler::finishFrame(const RF::Packet::SOF* sof, uint8_t* dropped)
+{
+    int count = 0;
+    for (int nodeId = priorityHead[Priority_NoDataSkip], next; nodeId; nodeId = next)
+    {
+        // Grab the next node ID first, setNodePriority will move this node to a different list
+        next = nodeInfo[nodeId].next;
+        if (!--nodeInfo[nodeId].frames)
+            setNodePriority(nodeId, Priority_SingleSlotPoll);
+    }
+    for (uint32_t i = 0; i < ARRAYLEN(sof->slot); i++)
+    {
+        uint32_t nodeId = sof->slot[i].owner;
+        if (!nodeId || nodeId >= ARRAYLEN(nodeInfo)) continue;
+        NodeInfo* node = nodeInfo + nodeId;
+        if (node->priority == Priority_SingleSlotPoll)
+        {
+            if (node->frames > NODE_FRAME_LOSS_DISCONNECT)
+            {
+                // The node ID will be handed out again, the host has to set the weight again as well
+                node->credit = 0;
+                node->reservation = 0;
+                nodeWeight[nodeId] = 0;
+                setNodePriority(nodeId, Priority_Disconnected);
+                dropped[count++] = nodeId;
+            }
+        }
+        else if (node->frames > NODE_FRAME_LOSS_SINGLESLOT)
+        {
+            node->frames = 0;
+            setNodePriority(nodeId, Priority_SingleSlotPoll);
+            dropped[count++] = nodeId;
+        }
+    }
+    return count;
+}
+
+
+// Update slot assignment priority info from an acknowledged reply packet
+void Scheduler::handleReply(const RF::Packet::Reply* reply)
+{
+    int nodeId = reply->header.nodeId;
+    if (nodeId >= (int)ARRAYLEN(nodeInfo)) return;
+    nodeInfo[nodeId].info = reply->header.bufferInfo;
+    NodePriority priority = Priority_Active;
+    if (reply->noData.messageId == RF::RID_NoData)
+    {
+        // Update the slot reservation of the node from the data rate that it announced.
+        // It has caught up with its data, so anything it might have accumulated is dropped.
+        nodeInfo[nodeId].reservation = ((uint64_t)reply->noData.bitrate) * reserveScale / 1000000;
+        nodeInfo[nodeId].reserved = 0;
+        // We have polled a node that has no data. Lock it out for the next frames if it requests that,
+        // unless it is measuring, in which case its reservation will poll it when it should have data.
+        nodeInfo[nodeId].frames = reply->noData.pollInFrames;
+        if (nodeInfo[nodeId].reservation) nodeInfo[nodeId].frames = 0;
+        else if (nodeInfo[nodeId].frames) priority = Priority_NoDataSkip;
+        else priority = Priority_SingleSlotPoll;
+    }
+    else nodeInfo[nodeId].frames = 0;
+    // Update linked lists
+    setNodePriority(nodeId, priority);
+}
+
+
+// Clean out slot assignment linked lists, all nodes start out disconnected.
+// frameTime is the length of a frame in microseconds, used to translate data rates to slot reservations.
+void Scheduler::reset(int frameTime)
+{
+    reserveScale = (((uint64_t)frameTime) << RESERVE_SHIFT) * (100 + SCHEDULER_RESERVE_HEADROOM)
+                 / (100 * RESERVE_PACKET_BITS);
+    memset(nodeInfo, 0, sizeof(nodeInfo));
+    memset(nodeWeight, 0, sizeof(nodeWeight));
+    memset(priorityCount, 0, sizeof(priorityCount));
+    memset(priorityHead, 0, sizeof(priorityHead));
+    memset(priorityTail, 0, sizeof(priorityTail));
+    priorityCount[0] = ARRAYLEN(nodeInfo) - 1;
+    priorityHead[Priority_Disconnected] = 1;
+    priorityTail[Priority_Disconnected] = ARRAYLEN(nodeInfo) - 1;
+    for (uint32_t i = 1; i < ARRAYLEN(nodeInfo); i++)
+    {
+        nodeInfo[i].prev = i - 1;
+        nodeInfo[i].next = i + 1;
+    }
+    nodeInfo[ARRAYLEN(nodeInfo) - 1].next = 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+// SensorPlatform Base Station Slot Scheduler
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "global.h"
+#include "../common/protocol/rfproto.h"
+
+
+// Dynamic slot assignment state of one radio channel
+class Scheduler final
+{
+    // Slot to node assignment tracking info.
+    enum NodePriority
+    {
+        Priority_Disconnected = 0,  // Not assigned any slots
+        Priority_NoDataSkip,  // Not polled for a number of frames (node had nothing to send)
+        Priority_SingleSlotPoll,  // Polled with a single slot every frame (new or unreliable nodes)
+        Priority_Active,  // Takes part in deficit round robin slot assignment
+        PRIORITY_COUNT
+    };
+    struct NodeInfo
+    {
+        uint8_t prev;
+        uint8_t next;
+        NodePriority priority : 4;
+        uint8_t : 4;
+        uint8_t slots;  // Number of slots that were assigned to the node during the current frame
+        uint8_t frames;  // Number of frames to be skipped if priority == 1, number of lost frames otherwise
+        RF::Packet::Reply::Header::BufferInfo info;
+        uint8_t demand;  // Number of slots that the node could still make use of during the current frame
+        int16_t credit;  // Deficit round robin credit (in 1 / (1 << CREDIT_SHIFT) slots)
+        uint32_t reservation;  // Slots reserved per frame (in 1 / (1 << RESERVE_SHIFT) slots)
+        uint32_t reserved;  // Reserved slots accumulated, but not assigned yet (same unit)
+    } nodeInfo[RF::MaxNode + 1];  // Array element 0 should never be accessed
+    uint8_t priorityCount[PRIORITY_COUNT];  // Number of elements in each priority level's linked list
+    uint8_t priorityHead[PRIORITY_COUNT];  // Linked list head node IDs for each priority level
+    uint8_t priorityTail[PRIORITY_COUNT];  // Linked list tail node IDs for each priority level
+    uint8_t nodeWeight[RF::MaxNode + 1];  // Per-node credit weight (0: SCHEDULER_DEFAULT_WEIGHT)
+    uint32_t reserveScale;  // Bit rate (in bits/s) to slot reservation conversion factor (times 1000000)
+
+    void setNodePriority(int nodeId, NodePriority newPriority);
+    void rotateList(int priority, int nodeId);
+
+public:
+    void reset(int frameTime);
+    void assignSlots(RF::Packet::SOF* sof, int freeSlots, int timeout);
+    int trimFrame(RF::Packet::SOF* sof, int minSlots);
+    int finishFrame(const RF::Packet::SOF* sof, uint8_t* dropped);
+    void handleReply(const RF::Packet::Reply* reply);
+    void setNodeWeight(int nodeId, int weight);
+};
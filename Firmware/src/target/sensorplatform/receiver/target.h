@@ -109,6 +109,10 @@
 #define PIN_RADIO_NCS PIN_C1
 #define PIN_RADIO_CE PIN_C0
 #define PIN_RADIO_NIRQ PIN_C4
+#define RADIO_NIRQ_VECTOR exti4
+#define RADIO_TIMER_VECTOR tim7
+#define RADIO_DMA_RX_VECTOR dma1_stream3
+#define RADIO_DMA_TX_VECTOR dma1_stream4
 
 #define PIN_LED1 PIN_A8
 #define PIN_LED2 PIN_A9
@@ -120,19 +124,30 @@
 #define TICK_TIMER_CLK STM32_TIM2_CLOCKGATE
 #define TICK_TIMER_FREQ (STM32_APB1_CLOCK * 2)
 
+// USB core that the host is connected to: OTG_FS (PA11/PA12) or OTG_HS (internal full speed PHY, PB14/PB15)
+#define USB_CORE OTG_FS
+// Whether USB transfers should be handled by the core's DMA controller instead of the CPU (OTG_HS only)
+#define USB_DMA false
+
 // Tunables:
 // Maximum number of USB packets per transmission (double buffered, thus 128 * N bytes of RAM)
 #define USB_TX_BUFFERS 64
-// Number of radio packet reception buffers (N * 32 bytes of RAM)
+// Number of radio packet reception buffers per radio (N * 40 bytes of RAM)
 #define RADIO_RX_BUFFERS 1024
-// Number of radio packet transmission buffers (N * 32 bytes of RAM)
+// Number of radio packet transmission buffers per radio (N * 32 bytes of RAM)
 #define RADIO_CMD_BUFFERS 16
 // Maximum number of consecutive frames that don't contain a beacon packet
 #define MAX_CONSECUTIVE_CMD_FRAMES 3
-// Maximum number of time slots to assign to a single urgency level (for dynamic slot assignment)
-#define MAX_SLOTS_PER_PRIORITY 24
 // Maximum number of time slots to assign to a single NodeId (for dynamic slot assignment)
 #define MAX_SLOTS_PER_NODE 24
+// Dynamic slot assignment credit that a node gets per frame at urgency level 0 (1/16 slots, can be set per node)
+#define SCHEDULER_DEFAULT_WEIGHT 16
+// Maximum amount of credit (or debt) in slots that a node can carry over to later frames
+#define SCHEDULER_CREDIT_LIMIT 24
+// Extra slots reserved for nodes on top of their announced measurement data rate (in percent)
+#define SCHEDULER_RESERVE_HEADROOM 10
+// Number of notification slots to keep at the end of shortened frames (if the channel allows for those)
+#define FRAME_SPARE_SLOTS 2
 // Only offer one slot to a node if it has missed at least N frames
 #define NODE_FRAME_LOSS_SINGLESLOT 3
 // Kick a node from the channel if it has missed at least N frames
@@ -22,6 +22,7 @@
 #include "soc/stm32/f2/usb.h"
 #include "interface/usb/wcid.h"
 #include "irq.h"
+#include "hub.h"
 
 
 namespace USB
@@ -105,6 +106,8 @@ namespace USB
             {
                 uint8_t nextBuf;  // Double buffering toggle
                 uint8_t bufUsed;  // Number of used packets inside the next buffer
+                uint8_t extUsed;  // Number of packets being sent straight from a radio RX buffer (0: sending own buffer)
+                bool extTurn;  // Whether radio RX buffers should be preferred over our own buffer next time
                 bool txActive;  // Whether a buffer is currently being transmitted
                 bool sendZLP;  // Whether we should send a Zero-Length Packet if a transmission
                                // finishes and we don't have anything else to send. This ensures
@@ -123,6 +126,9 @@ namespace USB
                     // A transmission has finished.
                     GPIO::setLevelFast(PIN_LED1, false);
                     txActive = false;
+                    // If we were sending packets straight from a radio RX buffer, those can be released now.
+                    if (extUsed) Hub::releaseTxPackets();
+                    extUsed = 0;
                     // If we have anything left to send, start doing so.
                     if (!tryStartTx(usb) && sendZLP)
                     {
@@ -147,32 +153,50 @@ namespace USB
             public:
                 constexpr DataInEndpoint(int number)
                     : Endpoint(EndpointNumber(In, number)),
-                      nextBuf(0), bufUsed(0), txActive(false), sendZLP(false), connected(false) {}
+                      nextBuf(0), bufUsed(0), extUsed(0), extTurn(false), txActive(false), sendZLP(false), connected(false) {}
 
-                Packet* getPacketBuf()
+                Packet* getPacketBuf(int* count)
                 {
-                    // Returns a pointer to the next free transmission buffer if there is one
+                    // Returns a pointer to the next free transmission buffer if there is one,
+                    // and optionally how many consecutive free buffers follow (including that one).
                     if (bufUsed >= ARRAYLEN(*txBuf)) return NULL;
+                    if (count) *count = ARRAYLEN(*txBuf) - bufUsed;
                     return &txBuf[nextBuf][bufUsed];
                 }
 
-                void submitPacket()
+                void submitPacket(int count)
                 {
-                    // Mark the next transmission buffer as used (and ready to be sent)
-                    bufUsed++;
+                    // Mark the next transmission buffer(s) as used (and ready to be sent)
+                    bufUsed += count;
                 }
 
                 bool tryStartTx(USB* usb)
                 {
                     // Attempt to start sending data if we are connected,
                     // not already sending and actually have data in the TX buffer.
-                    if (!connected || txActive || !bufUsed) return false;
-                    usb->startTx(number, txBuf[nextBuf], bufUsed * sizeof(**txBuf));
+                    // This takes turns between our own buffer (command responses, unbatched notifications)
+                    // and batches of received radio packets, which are sent straight out of the radios' RX buffers.
+                    if (!connected || txActive) return false;
+                    int count = 0;
+                    Packet* packets = NULL;
+                    if (!bufUsed || extTurn) packets = Hub::getTxPackets(&count);
+                    if (packets)
+                    {
+                        usb->startTx(number, packets, count * sizeof(*packets));
+                        extUsed = count;
+                        extTurn = false;
+                    }
+                    else if (bufUsed)
+                    {
+                        usb->startTx(number, txBuf[nextBuf], bufUsed * sizeof(**txBuf));
+                        nextBuf ^= 1;
+                        bufUsed = 0;
+                        extTurn = true;
+                    }
+                    else return false;
                     GPIO::setLevelFast(PIN_LED1, true);
                     txActive = true;
                     sendZLP = true;
-                    nextBuf ^= 1;
-                    bufUsed = 0;
                     return true;
                 }
             };
@@ -355,8 +379,10 @@ namespace USB
     static const uint16_t fifoSizes[] = { 0x40, 0x60, 0x40 };
 
     // USB stack instance
+    static_assert(!USB_DMA || STM32::USB_CORE == STM32::OTG_HS, "Only the OTG_HS core supports DMA");
     static STM32::USB usb(&usbDevDesc, &usbBOSDesc.bos, usbStrDescs, ARRAYLEN(usbStrDescs), usbConfigs,
-                          ARRAYLEN(usbConfigs), STM32::OTG_FS, fifoSizes, ARRAYLEN(fifoSizes));
+                          ARRAYLEN(usbConfigs), STM32::USB_CORE, fifoSizes, ARRAYLEN(fifoSizes), USB_DMA,
+                          STM32::USB::Speed_Full);
 
     // GET_DESCRIPTOR hook for WCID descriptor
     static struct WCIDHook
@@ -409,14 +435,14 @@ namespace USB
         mainConfig.receiverInterface.altSetting.outEp.markProcessed(&usb);
     }
 
-    Packet* getPacketBuf()
+    Packet* getPacketBuf(int* count)
     {
-        return mainConfig.receiverInterface.altSetting.inEp.getPacketBuf();
+        return mainConfig.receiverInterface.altSetting.inEp.getPacketBuf(count);
     }
 
-    void submitPacket()
+    void submitPacket(int count)
     {
-        mainConfig.receiverInterface.altSetting.inEp.submitPacket();
+        mainConfig.receiverInterface.altSetting.inEp.submitPacket(count);
     }
 
     void tryStartTx()
@@ -28,7 +28,7 @@ namespace USB
     extern bool isConnected();
     extern Packet* getPacket();
     extern void markProcessed();
-    extern Packet* getPacketBuf();
-    extern void submitPacket();
+    extern Packet* getPacketBuf(int* count = NULL);
+    extern void submitPacket(int count = 1);
     extern void tryStartTx();
 }
@@ -0,0 +1,545 @@
+// SensorPlatform SD Card Image Exporter
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Extracts the last recorded measurement series from a raw image of a sensor node's SD card (made with
+// e.g. dd, or the card's block device itself) without going through the radio link. The image is memory
+// mapped and the checksums of the measurement data sectors are validated by multiple threads. The pages
+// of the measurement data stream are then reassembled in order (see StorageTask::SectorBuf for the sector
+// layouts) and split into the records of the individual sensors, following the same measurement schedule
+// as the sensor node and the client software (MultiSensorDevice.scheduleSensor()).
+//
+// Records are exported as they were captured (raw 16 bit words, packed records are decompressed first),
+// along with their schedule timestamps. Converting them into physical units is sensor specific and
+// left to the client software's sensor decoders. Records that were lost or corrupted are skipped.
+//
+// Usage: sdexport.elf <image> <output prefix> [csv|bin]
+// csv: One file per sensor, <prefix>-<sensor id>.csv: "time in ms;word 0;word 1;..."
+// bin: One file per sensor and column: <prefix>-<sensor id>-time.bin (64 bit little endian usec unix
+//      timestamps) and <prefix>-<sensor id>-<word index>.bin (16 bit little endian words)
+
+
+#include "global.h"
+#include "sys/util.h"
+#include "sys/time.h"
+#include "lib/crc32/crc32.h"
+#include "../multisensor/common.h"
+#include "../multisensor/codec.h"
+#include "../multisensor/storagetask.h"
+#include "../multisensor/taskqueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+
+namespace Export
+{
+    using StorageTask::SectorBuf;
+
+    static const uint32_t HEADER_PAGES = sizeof(SeriesHeader) / sizeof(Page);  // Series header pages at the start of the stream
+    static const uint32_t BLOCK_PAGES = ARRAYLEN(*mainBuf.block);  // Pages per measurement data buffer block
+
+    // Result of validating a measurement data sector
+    struct SectorInfo
+    {
+        uint32_t pageSeq;  // Stream sequence number of the first page
+        uint8_t pages;  // Number of valid pages (zero if the sector is corrupted)
+    };
+
+    // A range of sectors to be validated by a thread
+    struct Worker
+    {
+        pthread_t thread;
+        uint64_t first;  // First sector number
+        uint32_t count;  // Number of sectors
+        SectorInfo* info;  // Validation results
+    };
+
+    // Export state of an active sensor
+    struct SensorState
+    {
+        SensorTask::ScheduledTask task;  // Position in the measurement schedule
+        uint8_t id;  // Sensor ID (index within the series header)
+        uint8_t words;  // Words per record
+        bool packed;  // Whether records are stored in Format_Packed
+        uint32_t interval;  // Schedule interval in usec
+        uint64_t time;  // usec unix time of the next record
+        uint64_t records;  // Number of exported records
+        uint64_t lost;  // Number of lost records
+        uint32_t prevBlock;  // Packed block that prev belongs to
+        uint16_t prev[Codec::MAX_RECORD_WORDS];  // Previous record within the current packed block (byte swapped)
+        FILE* file[1 + Codec::MAX_RECORD_WORDS];  // Output files (only file[0] for CSV)
+
+        SensorState() : task(NULL, this) {}
+    };
+
+    static const uint8_t* image;  // Memory mapped SD card image
+    static uint64_t imageSectors;  // Size of the image in sectors
+    static uint8_t layout;  // SD_LAYOUT of the measurement data sectors
+    static uint32_t crcKey;  // Value that the checksums of the measurement data sectors are XORed with
+    static bool binary;  // Whether to export columnar binary files instead of CSV
+    static const char* prefix;  // Output file name prefix
+
+    // Measurement data stream reassembly state
+    static uint32_t nextPage;  // Stream sequence number of the next expected page
+    static bool badSector;  // Whether the previous sector was corrupted
+    static bool ended;  // Whether the end of the recording was found
+    static uint64_t dataSectors;  // Number of measurement data sectors of the recording
+    static uint64_t corruptedSectors;  // Number of corrupted sectors within the recording
+    static uint64_t lostPages;  // Number of pages that are missing from the stream
+
+    // Record decoding state
+    static SeriesHeader header;  // Series header from the start of the stream
+    static uint32_t headerLost;  // Number of lost series header pages
+    static SeriesHeader headerCopy;  // Series header from the SD card configuration area
+    static SensorState sensors[ARRAYLEN(header.sensor)];
+    static SensorTask::TaskQueue schedule;
+    static uint8_t recordBuf[Codec::MAX_RECORD_WORDS * 2];  // Raw record being assembled
+    static uint32_t recordBytes;  // Bytes in recordBuf
+    static bool recordLost;  // Whether any of the bytes in recordBuf were lost
+    static uint8_t block[sizeof(*mainBuf.block) + 8];  // Packed block being assembled (zero padded for the bit reader)
+    static uint32_t blockPages;  // Pages in block
+    static uint32_t blockLost;  // Bit mask of lost pages in block
+    static uint32_t blockNum;  // Number of packed blocks decoded so far
+    static uint32_t recordIndex;  // Index of the next record within the measurement (packed format)
+    static bool packedStream;  // Whether the measurement data stream uses the packed format
+
+
+    // Validate a measurement data sector and figure out which pages it contains
+    static void checkSector(uint64_t sector, SectorInfo* info)
+    {
+        const SectorBuf* buf = (const SectorBuf*)(image + sector * sizeof(SectorBuf));
+        info->pages = 0;
+        if ((crc32(buf->u32, sizeof(*buf) - 4) ^ crcKey) != buf->u32[ARRAYLEN(buf->u32) - 1]) return;
+        if (!layout)
+        {
+            info->pageSeq = buf->recordingV0.blockSeq * BLOCK_PAGES;
+            info->pages = BLOCK_PAGES;
+            return;
+        }
+        info->pageSeq = buf->recording.pageSeq & 0x7fffffff;
+        uint32_t pages = ARRAYLEN(buf->recording.data);
+        // Partially filled sectors store the number of pages in the last word
+        if (buf->recording.pageSeq & 0x80000000) pages = buf->recording.data[ARRAYLEN(buf->recording.data) - 1].u32[6];
+        if (pages <= ARRAYLEN(buf->recording.data)) info->pages = pages;
+    }
+
+    static void* worker(void* arg)
+    {
+        Worker* w = (Worker*)arg;
+        for (uint32_t i = 0; i < w->count; i++) checkSector(w->first + i, w->info + i);
+        return NULL;
+    }
+
+
+    // Check whether a series header sector copy is newer than another one. Sectors written by older
+    // firmware versions have no data block checksum and only an 8 bit USN, they are older than any other.
+    static bool seriesHeaderNewer(uint32_t usn, bool legacy, uint32_t otherUSN, bool otherLegacy)
+    {
+        if (legacy != otherLegacy) return otherLegacy;
+        if (legacy) return (int8_t)(usn - otherUSN) > 0;
+        return (int32_t)(usn - otherUSN) > 0;
+    }
+
+    // Load the newest valid copy of each series header sector (same rules as StorageTask::doLoadSeriesHeader()),
+    // returns false if the first sector is corrupted
+    static bool loadSeriesHeader(SeriesHeader* data)
+    {
+        uint32_t committedUSN = 0;
+        bool committedLegacy = false;
+        for (uint32_t i = 0; i < StorageTask::seriesHeaderSectors; i++)
+        {
+            bool found = false;
+            bool foundLegacy = false;
+            uint32_t foundUSN = 0;
+            void* block = data->info.page + i * BLOCK_PAGES;
+            for (uint32_t slot = 0; slot < 2; slot++)
+            {
+                uint64_t sector = 2 + slot * StorageTask::seriesHeaderSectors + i;
+                const SectorBuf* buf = (const SectorBuf*)(image + sector * sizeof(SectorBuf));
+                if (crc32(buf->u32 + 1, sizeof(*buf) - 4) != buf->u32[0]) continue;
+                bool legacy = !buf->u32[2];
+                uint32_t usn = buf->u32[1];
+                // Copies that are newer than the first sector belong to a save that didn't complete
+                if (i && seriesHeaderNewer(usn, legacy, committedUSN, committedLegacy)) continue;
+                if (found && !seriesHeaderNewer(usn, legacy, foundUSN, foundLegacy)) continue;
+                found = true;
+                foundLegacy = legacy;
+                foundUSN = usn;
+                memcpy(block, buf->u8 + sizeof(*buf) - sizeof(*mainBuf.block), sizeof(*mainBuf.block));
+            }
+            if (!i)
+            {
+                if (!found) return false;
+                committedUSN = foundUSN;
+                committedLegacy = foundLegacy;
+            }
+            if (!found) memset(block, 0, sizeof(*mainBuf.block));
+        }
+        return true;
+    }
+
+
+    static FILE* createFile(const char* suffix, uint8_t id)
+    {
+        char name[1024];
+        snprintf(name, sizeof(name), "%s-%d%s", prefix, id, suffix);
+        FILE* f = fopen(name, "wb");
+        if (!f)
+        {
+            perror(name);
+            exit(1);
+        }
+        setvbuf(f, NULL, _IOFBF, EXPORT_FILE_BUFFER);
+        return f;
+    }
+
+
+    // Set up the measurement schedule from the series header (once it has been received completely)
+    static void startSensors()
+    {
+        // If parts of the series header were lost, fall back to the copy in the configuration area
+        // (the sensor configuration can't have been changed while the measurement was running)
+        if (headerLost)
+        {
+            printf("WARNING: %d series header pages lost, using the stored copy\n", headerLost);
+            memcpy(&header, &headerCopy, sizeof(header));
+        }
+        // The client passes the start time in milliseconds
+        uint64_t base = header.info.unixTime * 1000;
+        schedule.clear();
+        for (uint32_t i = 0; i < ARRAYLEN(header.sensor); i++)
+        {
+            const Page::SensorInfo* info = &header.sensor[i].info;
+            SensorState* s = sensors + i;
+            s->id = i;
+            s->words = info->recordSize / 16;
+            if (!info->scheduleInterval || !s->words) continue;
+            if (s->words > Codec::MAX_RECORD_WORDS)
+            {
+                printf("WARNING: Sensor %d has invalid record size %d, ignoring it\n", i, info->recordSize);
+                continue;
+            }
+            s->packed = info->formatVersion == Codec::Format_Packed;
+            // If any active sensor uses the packed format, the whole data stream does.
+            if (s->packed) packedStream = true;
+            s->interval = info->scheduleInterval;
+            s->time = base + info->scheduleOffset;
+            s->task.time = info->scheduleOffset;
+            s->prevBlock = -1;
+            schedule.insert(&s->task);
+            // Open output files
+            if (binary)
+            {
+                s->file[0] = createFile("-time.bin", i);
+                for (int j = 0; j < s->words; j++)
+                {
+                    char suffix[16];
+                    snprintf(suffix, sizeof(suffix), "-%d.bin", j);
+                    s->file[j + 1] = createFile(suffix, i);
+                }
+            }
+            else
+            {
+                s->file[0] = createFile(".csv", i);
+                fprintf(s->file[0], "Time");
+                for (int j = 0; j < s->words; j++) fprintf(s->file[0], ";Word%d", j);
+                fprintf(s->file[0], "\nms\n");
+            }
+        }
+    }
+
+
+    // Move on to the next record in the measurement schedule, returns the sensor that it belongs to
+    static SensorState* nextRecord(uint64_t* time)
+    {
+        SensorTask::ScheduledTask* task = schedule.pop();
+        SensorState* s = (SensorState*)task->arg;
+        *time = s->time;
+        s->time += s->interval;
+        task->time += s->interval;
+        schedule.insert(task);
+        return s;
+    }
+
+    static void skipRecord()
+    {
+        uint64_t time;
+        nextRecord(&time)->lost++;
+        recordIndex++;
+    }
+
+    // Write a record (in the byte order in which it was captured) to the sensor's output files
+    static void exportRecord(SensorState* s, uint64_t time, const uint16_t* words)
+    {
+        s->records++;
+        if (binary)
+        {
+            fwrite(&time, sizeof(time), 1, s->file[0]);
+            for (int j = 0; j < s->words; j++) fwrite(words + j, sizeof(*words), 1, s->file[j + 1]);
+            return;
+        }
+        fprintf(s->file[0], "%llu.%03u", (unsigned long long)(time / 1000), (unsigned)(time % 1000));
+        for (int j = 0; j < s->words; j++) fprintf(s->file[0], ";%u", words[j]);
+        fputc('\n', s->file[0]);
+    }
+
+
+    // Read width bits starting at bit pos of the packed block (little endian bit stream)
+    static uint32_t getBits(uint32_t pos, int width)
+    {
+        uint64_t data;
+        memcpy(&data, block + (pos >> 3), sizeof(data));
+        return (data >> (pos & 7)) & ((1ull << width) - 1);
+    }
+
+    // Decode a packed measurement data block (see codec.h)
+    static void decodeBlock()
+    {
+        // If the block header was lost, skip the block. The next one tells us where to continue.
+        if (blockLost & 1) return;
+        uint32_t count = getBits(0, 16);
+        uint32_t first = getBits(16, 32);
+        uint32_t pos = Codec::PackedEncoder::HEADER_BITS;
+        // Any data beyond the start of the first lost page can't be decoded
+        uint32_t end = Codec::PackedEncoder::BLOCK_BITS;
+        if (blockLost) end = __builtin_ctz(blockLost) * sizeof(Page) * 8;
+        // If previous blocks were lost, skip the records that they contained
+        while ((int32_t)(recordIndex - first) < 0) skipRecord();
+        blockNum++;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            SensorState* s = (SensorState*)schedule.peek()->arg;
+            uint16_t words[Codec::MAX_RECORD_WORDS];
+            if (s->packed)
+            {
+                // Width code followed by zigzag encoded differences to the previous record (big endian words)
+                int width = getBits(pos, 4);
+                if (width == Codec::PackedEncoder::MAX_WIDTH_CODE) width = 16;
+                pos += 4;
+                if (s->prevBlock != blockNum) memset(s->prev, 0, sizeof(s->prev));
+                s->prevBlock = blockNum;
+                for (int j = 0; j < s->words; j++)
+                {
+                    uint32_t code = width ? getBits(pos, width) : 0;
+                    s->prev[j] += (code >> 1) ^ -(code & 1);
+                    words[j] = (s->prev[j] >> 8) | (s->prev[j] << 8);
+                    pos += width;
+                }
+            }
+            else
+                for (int j = 0; j < s->words; j++, pos += 16)
+                    words[j] = getBits(pos, 16);
+            // If the record reached into lost data, skip it and the rest of the block
+            if (pos > end)
+            {
+                for (; i < count; i++) skipRecord();
+                return;
+            }
+            uint64_t time;
+            nextRecord(&time);
+            exportRecord(s, time, words);
+            recordIndex++;
+        }
+    }
+
+    // Process a page of the measurement data stream (NULL if it was lost)
+    static void processPage(uint32_t seq, const Page* page)
+    {
+        if (seq < HEADER_PAGES)
+        {
+            // Series header page, just store it
+            if (page) memcpy(header.info.page + seq, page, sizeof(*page));
+            else headerLost++;
+            if (seq == HEADER_PAGES - 1) startSensors();
+            return;
+        }
+        // No active sensors, nothing to decode
+        if (!schedule.peek()) return;
+        if (packedStream)
+        {
+            // Collect the pages of the block (data starts at a block boundary) and decode it once it is complete
+            if (page) memcpy(block + blockPages * sizeof(*page), page, sizeof(*page));
+            else blockLost |= 1 << blockPages;
+            if (++blockPages < BLOCK_PAGES) return;
+            decodeBlock();
+            blockPages = 0;
+            blockLost = 0;
+            return;
+        }
+        // Raw format: records are just concatenated, split them up
+        for (uint32_t offset = 0; offset < sizeof(*page); )
+        {
+            SensorState* s = (SensorState*)schedule.peek()->arg;
+            uint32_t len = MIN(s->words * 2u - recordBytes, sizeof(*page) - offset);
+            if (page) memcpy(recordBuf + recordBytes, page->u8 + offset, len);
+            else recordLost = true;
+            recordBytes += len;
+            offset += len;
+            if (recordBytes < s->words * 2u) continue;
+            uint64_t time;
+            nextRecord(&time);
+            if (recordLost) s->lost++;
+            else
+            {
+                uint16_t words[Codec::MAX_RECORD_WORDS];
+                memcpy(words, recordBuf, recordBytes);
+                exportRecord(s, time, words);
+            }
+            recordBytes = 0;
+            recordLost = false;
+        }
+    }
+
+
+    // Feed the next measurement data sector (in card order) into the stream reassembly
+    static void processSector(uint64_t sector, const SectorInfo* info)
+    {
+        // A corrupted sector may be the end of the recording (or corrupted data within it).
+        // Consider it part of the recording if the next sector continues it.
+        if (!info->pages)
+        {
+            if (badSector) ended = true;
+            badSector = true;
+            return;
+        }
+        // Sequence numbers must increase, otherwise this is stale data from an older recording.
+        // (The series header is always the first thing in the measurement data stream.)
+        if (info->pageSeq < nextPage || (info->pageSeq && sector == StorageTask::firstDataSector))
+        {
+            ended = true;
+            return;
+        }
+        if (badSector) corruptedSectors++;
+        badSector = false;
+        dataSectors = sector - StorageTask::firstDataSector + 1;
+        // Pages that are missing in between were lost
+        for (; nextPage < info->pageSeq; nextPage++)
+        {
+            processPage(nextPage, NULL);
+            lostPages++;
+        }
+        const SectorBuf* buf = (const SectorBuf*)(image + sector * sizeof(SectorBuf));
+        const Page* data = layout ? buf->recording.data : buf->recordingV0.data;
+        for (uint32_t i = 0; i < info->pages; i++) processPage(nextPage++, data + i);
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    using namespace Export;
+    if (argc < 3 || argc > 4 || (argc == 4 && strcmp(argv[3], "csv") && strcmp(argv[3], "bin")))
+    {
+        printf("Usage: %s <image> <output prefix> [csv|bin]\n", argv[0]);
+        return 2;
+    }
+    prefix = argv[2];
+    binary = argc == 4 && !strcmp(argv[3], "bin");
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    // This also works for block devices, which report a size of zero
+    imageSectors = lseek(fd, 0, SEEK_END) / sizeof(SectorBuf);
+    if (imageSectors <= StorageTask::firstDataSector)
+    {
+        printf("%s is too small to contain a recording\n", argv[1]);
+        return 1;
+    }
+    image = (const uint8_t*)mmap(NULL, imageSectors * sizeof(SectorBuf), PROT_READ, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    madvise((void*)image, imageSectors * sizeof(SectorBuf), MADV_SEQUENTIAL);
+    int start = read_usec_timer();
+
+    // Load the newest valid series header
+    if (!loadSeriesHeader(&headerCopy))
+    {
+        printf("No valid series header found\n");
+        return 1;
+    }
+    layout = headerCopy.info.sdLayout;
+    if (layout) crcKey = headerCopy.info.localTime;
+    if (layout > StorageTask::SD_LAYOUT)
+    {
+        printf("Unsupported SD sector layout version %d\n", layout);
+        return 1;
+    }
+
+    // Validate sectors in parallel, a few chunks at a time, and feed them into the stream reassembly
+    // in order until the end of the recording has been found.
+    int threads = MIN(EXPORT_MAX_THREADS, MAX(1, (int)sysconf(_SC_NPROCESSORS_ONLN)));
+    static Worker workers[EXPORT_MAX_THREADS];
+    SectorInfo* info = (SectorInfo*)malloc(sizeof(*info) * EXPORT_CHUNK_SECTORS * threads);
+    uint64_t sector = StorageTask::firstDataSector;
+    while (!ended && sector < imageSectors)
+    {
+        int count = 0;
+        for (uint64_t first = sector; count < threads && first < imageSectors; count++, first += EXPORT_CHUNK_SECTORS)
+        {
+            workers[count].first = first;
+            workers[count].count = MIN((uint64_t)EXPORT_CHUNK_SECTORS, imageSectors - first);
+            workers[count].info = info + count * EXPORT_CHUNK_SECTORS;
+            pthread_create(&workers[count].thread, NULL, worker, workers + count);
+        }
+        for (int i = 0; i < count; i++)
+        {
+            pthread_join(workers[i].thread, NULL);
+            for (uint32_t j = 0; !ended && j < workers[i].count; j++) processSector(sector++, workers[i].info + j);
+        }
+    }
+    // Decode the last packed block, even if its end is missing
+    if (blockPages)
+    {
+        blockLost |= ~((1 << blockPages) - 1) & ((1 << BLOCK_PAGES) - 1);
+        decodeBlock();
+    }
+    if (nextPage < HEADER_PAGES)
+    {
+        printf("The recording doesn't contain a complete series header\n");
+        return 1;
+    }
+
+    uint64_t records = 0;
+    for (uint32_t i = 0; i < ARRAYLEN(sensors); i++)
+    {
+        SensorState* s = sensors + i;
+        if (!s->file[0]) continue;
+        printf("Sensor %2d: %08X/%08X, %d words every %d usec, %s: %llu records, %llu lost\n", i,
+               header.sensor[i].info.vendor, header.sensor[i].info.product, s->words, s->interval,
+               s->packed ? "packed" : "raw", (unsigned long long)s->records, (unsigned long long)s->lost);
+        records += s->records;
+        for (int j = 0; j <= s->words; j++)
+            if (s->file[j])
+                fclose(s->file[j]);
+    }
+    int time = read_usec_timer() - start;
+    printf("SD sector layout %d, %llu data sectors, %llu pages, %llu pages lost, %llu corrupted sectors\n",
+           layout, (unsigned long long)dataSectors, (unsigned long long)nextPage,
+           (unsigned long long)lostPages, (unsigned long long)corruptedSectors);
+    printf("%llu records exported in %d ms using %d threads (%.1f MB/s)\n", (unsigned long long)records,
+           time / 1000, threads, dataSectors * sizeof(SectorBuf) / (double)MAX(time, 1));
+    return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// SensorPlatform SD Card Image Exporter
+// Copyright (C) 2016-2017 Michael Sparmann
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Sensor node definitions (same meaning as in multisensor/target.h, needed by the shared headers):
+#define MAINBUF_BLOCK_COUNT 24
+#define STORAGETASK_VECTOR "storagetask_yield"
+
+// Tunables (exporter):
+// Maximum number of threads validating sector checksums
+#define EXPORT_MAX_THREADS 64
+// Number of sectors validated by a thread at once (4 MiB)
+#define EXPORT_CHUNK_SECTORS 8192
+// Size of the stdio buffer of each output file
+#define EXPORT_FILE_BUFFER 262144
+
+#include "cpu/host/target.h"
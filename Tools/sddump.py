@@ -0,0 +1,155 @@
+# SensorPlatform SD Card Image Dump Tool
+# Copyright (C) 2016-2017 Michael Sparmann
+# 
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+# 
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Reads an SD card image of a sensor node (e.g. made with dd), validates the measurement data sectors
+# written by the last recording and extracts the measurement data stream (including the series header)
+# from them. Pages that were lost (due to buffer overflows on the sensor node) or are corrupted are
+# replaced by zeros. Supports both the old (one 17 page block per sector) and the packed (18 pages
+# per sector, spanning blocks) sector layout, as indicated by the series header.
+#
+# Usage: sddump.py <image> <output> [lostmap]
+# The optional lostmap file receives one byte per page of the output: 1 if the page was lost, else 0.
+
+import sys
+import struct
+
+SECTOR_SIZE = 512
+PAGE_SIZE = 28
+BLOCK_PAGES = 17  # Pages per measurement data buffer block
+SERIES_HEADER_PAGES = 16 + 64 * 4  # Series info and sensor configuration pages
+SERIES_HEADER_SECTORS = SERIES_HEADER_PAGES // BLOCK_PAGES  # Sectors per series header copy
+FIRST_DATA_SECTOR = 2 + 2 * SERIES_HEADER_SECTORS
+
+
+# Table-driven version of the CRC32 calculated by the STM32 CRC unit
+# (MSB first, polynomial 0x04c11db7, initial value 0xffffffff, little endian 32 bit words)
+crctable = []
+for i in range(256):
+    c = i << 24
+    for bit in range(8): c = ((c << 1) ^ (0x04c11db7 * (c >> 31))) & 0xffffffff
+    crctable.append(c)
+
+def crc32(data):
+    result = 0xffffffff
+    for word in struct.unpack("<%dI" % (len(data) // 4), data):
+        for shift in (24, 16, 8, 0):
+            result = ((result << 8) & 0xffffffff) ^ crctable[(result >> 24) ^ ((word >> shift) & 0xff)]
+    return result
+
+
+# Check whether a series header sector copy (usn, legacy) is newer than another one. Sectors written by older
+# firmware versions have no data block checksum and only an 8 bit USN, they are older than any other.
+def seriesHeaderNewer(copy, other):
+    if copy[1] != other[1]: return other[1]
+    bits = 8 if copy[1] else 32
+    diff = (copy[0] - other[0]) & ((1 << bits) - 1)
+    return diff != 0 and diff < 1 << (bits - 1)
+
+
+# Read the newest valid copy of each series header sector (same rules as the firmware),
+# returns the data or None if the first sector is corrupted
+def readSeriesHeader(image):
+    committed = None
+    data = b""
+    for i in range(SERIES_HEADER_SECTORS):
+        found = None
+        block = bytes(BLOCK_PAGES * PAGE_SIZE)
+        for slot in range(2):
+            image.seek((2 + slot * SERIES_HEADER_SECTORS + i) * SECTOR_SIZE)
+            buf = image.read(SECTOR_SIZE)
+            if len(buf) != SECTOR_SIZE or crc32(buf[4:]) != struct.unpack("<I", buf[:4])[0]: continue
+            usn, blockcrc = struct.unpack("<II", buf[4:12])
+            copy = (usn, blockcrc == 0)
+            # Copies that are newer than the first sector belong to a save that didn't complete
+            if committed is not None and seriesHeaderNewer(copy, committed): continue
+            if found is not None and not seriesHeaderNewer(copy, found): continue
+            found = copy
+            block = buf[-BLOCK_PAGES * PAGE_SIZE:]
+        if committed is None:
+            if found is None: return None
+            committed = found
+        data += block
+    return data
+
+
+# Parse a measurement data sector, returns (first page sequence number, list of pages) or None if it is corrupted
+def parseSector(buf, layout, key):
+    if len(buf) != SECTOR_SIZE or crc32(buf[:-4]) ^ key != struct.unpack("<I", buf[-4:])[0]: return None
+    if layout == 0:
+        # Block sequence number, 7 reserved words, 17 pages, CRC32
+        seq = struct.unpack("<I", buf[:4])[0] * BLOCK_PAGES
+        count = BLOCK_PAGES
+        data = buf[32:-4]
+    else:
+        # Page sequence number (bit 31: partially filled), 18 pages, CRC32 (XORed with the series' localTime)
+        seq = struct.unpack("<I", buf[:4])[0]
+        count = 18
+        data = buf[4:-4]
+        if seq & 0x80000000:
+            seq &= 0x7fffffff
+            count = struct.unpack("<I", buf[-8:-4])[0]
+    return seq, [data[i * PAGE_SIZE:(i + 1) * PAGE_SIZE] for i in range(count)]
+
+
+with open(sys.argv[1], "rb") as image:
+    # Load the newest valid series header
+    header = readSeriesHeader(image)
+    if header is None: sys.exit("No valid series header found")
+    # The layout version is stored in the first byte of the second series info page (zero in old firmware)
+    layout = header[PAGE_SIZE]
+    if layout > 1: sys.exit("Unsupported SD sector layout version %d" % layout)
+    print("Series header found, SD sector layout version %d" % layout)
+    key = struct.unpack("<I", header[12:16])[0] if layout else 0
+
+    out = open(sys.argv[2], "wb")
+    lostmap = open(sys.argv[3], "wb") if len(sys.argv) > 3 else None
+    sector = FIRST_DATA_SECTOR
+    written = 0  # Pages written to the output so far
+    lost = 0  # Pages that were lost or corrupted
+    partial = 0  # Partially filled sectors
+    corrupted = 0  # Sectors with bad checksums within the recording
+    while True:
+        image.seek(sector * SECTOR_SIZE)
+        buf = image.read(SECTOR_SIZE)
+        result = parseSector(buf, layout, key)
+        # A sector with a bad checksum may be corrupted or may be the end of the recording.
+        # Consider it corrupted if the next sector continues the recording.
+        if result is None:
+            if len(buf) == SECTOR_SIZE:
+                result = parseSector(image.read(SECTOR_SIZE), layout, key)
+                if result is not None and result[0] > written:
+                    corrupted += 1
+                    sector += 1
+                    continue
+            break
+        seq, pages = result
+        # Sequence numbers must increase, otherwise this is stale data from an older recording.
+        # (The series header is always the first thing in the measurement data stream.)
+        if seq < written or (seq and not written): break
+        if len(pages) < 18 and layout: partial += 1
+        # Fill gaps with zeros
+        if seq > written:
+            out.write(b"\0" * PAGE_SIZE * (seq - written))
+            if lostmap: lostmap.write(b"\1" * (seq - written))
+            lost += seq - written
+        out.write(b"".join(pages))
+        if lostmap: lostmap.write(b"\0" * len(pages))
+        written = seq + len(pages)
+        sector += 1
+    out.close()
+    if lostmap: lostmap.close()
+    print("%d sectors, %d pages (%d bytes) of measurement data" % (sector - FIRST_DATA_SECTOR, written, written * PAGE_SIZE))
+    print("%d pages lost, %d partially filled sectors, %d corrupted sectors" % (lost, partial, corrupted))